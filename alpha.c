@@ -18,7 +18,7 @@
  
 #include "alpha.h"
 
-void buildAlpha(Uchar *text, const Uint textlen) {
+void buildAlpha(context_t ctx, Uchar *text, const Uint textlen) {
   Uint occ[UCHAR_MAX+1] = {0}, i, j;
   Uchar *tptr;
 
@@ -30,13 +30,13 @@ void buildAlpha(Uchar *text, const Uint textlen) {
   {
     if(occ[i] > 0)
     {
-      characters[j++] = (Uchar) i;
+      ctx->characters[j++] = (Uchar) i;
     }
   }
-  alphasize = j;
+  ctx->alphasize = j;
   
-  for(i=0; i<alphasize; i++)
+  for(i=0; i<ctx->alphasize; i++)
   {
-    alphaindex[(Uint) characters[i]] = i;
+    ctx->alphaindex[(Uint) ctx->characters[i]] = i;
   }
 }
@@ -20,33 +20,25 @@
 #define ALPHA_H
 
 #include "types.h"
-
-/** Alphabet size. */
-Uint alphasize;
-
-/** Characters in text in alphabetical order. */
-Uchar characters[UCHAR_MAX+1]; 
-
-/** Index of each alphabet character */
-Uint alphaindex[UCHAR_MAX+1]; 
+#include "context.h"
 
 /** 
  * Returns the index of the Nth character in the input text. Used in encoder. 
  * @param[in] N position of the character in the input text.
  * @return The index number of the input character.
 */
-#define GETINDEX(N) (N == textlen ? alphasize : alphaindex[text[N]])
+#define GETINDEX(N) (N == ctx->textlen ? ctx->alphasize : ctx->alphaindex[ctx->text[N]])
 
-#define GETINDEX3(N) (N == textlen ? alphasize : alphaindex[text2[N]])
+#define GETINDEX3(N) (N == ctx->textlen ? ctx->alphasize : ctx->alphaindex[text2[N]])
 
 /** 
- * Returns the index of the Nth character in the input text. Used in decoder. 
- * @param[in] N position of the character in the input text.
+ * Returns the index of the Nth character of the label of a decoder tree node. Used in decoder. 
+ * @param[in] N position of the character in the label of <i>node</i>.
  * @return The index number of the input character.
 */
-#define GETINDEX2(N) (alphaindex[(*node->text)[N]])
+#define GETINDEX2(N) (ctx->alphaindex[ctx->labels[node->label + (N)]])
 
 /** Reads input text and initializes alphabet variables */
-void buildAlpha(Uchar *text, const Uint textlen);
+void buildAlpha(context_t ctx, Uchar *text, const Uint textlen);
 
 #endif
@@ -12,131 +12,185 @@
  * routines are ever ported to assembly language the buffering
  * will come in handy.
  *
+ * Bits are moved in groups: the coder hands over all the bits it
+ * can shift out in one renormalization, they are collected in a
+ * bit window and whole bytes are moved between the window and the
+ * buffer.
+ *
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include "coder.h"
 #include "bitio.h"
+#include "../failure.h"
+#include "../libcontext.h"
 
-#define BUFFER_SIZE 256
-static char buffer[ BUFFER_SIZE + 2 ]; /* This is the i/o buffer    */
-static char *current_byte;             /* Pointer to current byte   */
-
-static int output_mask;                /* During output, this byte  */
-                                       /* contains the mask that is */
-                                       /* applied to the output byte*/
-                                       /* if the output bit is a 1  */
-
-static int input_bytes_left;           /* During input, these three */
-static int input_bits_left;            /* variables keep track of my*/
-static int past_eof;                   /* input state.  The past_eof*/
-                                       /* byte comes about because  */
-                                       /* of the fact that there is */
-                                       /* a possibility the decoder */
-                                       /* can legitimately ask for  */
-                                       /* more bits even after the  */
-                                       /* entire file has been      */
-                                       /* sucked dry.               */
+/*
+ * The buffer, the bit window and the input state live in the CODER
+ * structure.  The past_eof counter comes about because of the fact
+ * that there is a possibility the decoder can legitimately ask for
+ * more bits even after the entire file has been sucked dry.
+ */
 
+/*
+ * Makes the coder use a caller provided buffer for its block reads
+ * and writes.  It must be called before the bitstream is initialized.
+ * A NULL buffer selects the buffer inside the CODER structure.
+ */
+void set_bitstream_buffer( CODER *coder, unsigned char *buffer, size_t size )
+{
+    if ( buffer == NULL || size == 0 )
+    {
+        coder->buffer = coder->default_buffer;
+        coder->buffer_size = BUFFER_SIZE;
+    }
+    else
+    {
+        coder->buffer = buffer;
+        coder->buffer_size = size;
+    }
+}
 
 /*
  * This routine is called once to initialze the output bitstream.
- * All it has to do is set up the current_byte pointer, clear out
- * all the bits in my current output byte, and set the output mask
- * so it will set the proper bit next time a bit is output.
+ * All it has to do is set up the current_byte pointer and clear out
+ * the bit window.
  */
-void initialize_output_bitstream()
+void initialize_output_bitstream( CODER *coder )
 {
-    current_byte = buffer;
-    *current_byte = 0;
-    output_mask = 0x80;
+    if ( coder->buffer == NULL )
+        set_bitstream_buffer( coder, NULL, 0 );
+    coder->current_byte = coder->buffer;
+    coder->bit_window = 0;
+    coder->window_bits = 0;
 }
 
 /*
- * The output bit routine just has to set a bit in the current byte
- * if requested to.  After that, it updates the mask.  If the mask
- * shows that the current byte is filled up, it is time to go to the
- * next character in the buffer.  If the next character is past the
- * end of the buffer, it is time to flush the buffer.
+ * The output routine appends the low count bits of the bits
+ * parameter to the bit window, and moves every complete byte to the
+ * buffer.  If the buffer is full, it is time to flush it.  Groups of
+ * more than 16 bits are split, so the window never overflows.
  */
-void output_bit( FILE *stream, int bit )
+void output_bits( CODER *coder, FILE *stream, unsigned long bits, int count )
 {
-    if ( bit )
-        *current_byte |= output_mask;
-    output_mask >>= 1;
-    if ( output_mask == 0 )
+    if ( count > 16 )
     {
-        output_mask = 0x80;
-        current_byte++;
-        if ( current_byte == ( buffer + BUFFER_SIZE ) )
+        output_bits( coder, stream, bits >> 16, count - 16 );
+        bits &= 0xffff;
+        count = 16;
+    }
+    coder->bit_window = ( coder->bit_window << count ) | bits;
+    coder->window_bits += count;
+    while ( coder->window_bits >= 8 )
+    {
+        coder->window_bits -= 8;
+        *coder->current_byte++ =
+            (unsigned char)( coder->bit_window >> coder->window_bits );
+        if ( coder->current_byte == coder->buffer + coder->buffer_size )
         {
-            fwrite( buffer, 1, BUFFER_SIZE, stream );
-            current_byte = buffer;
+            fwrite( coder->buffer, 1, coder->buffer_size, stream );
+            coder->current_byte = coder->buffer;
         }
-        *current_byte = 0;
     }
 }
 
+/*
+ * Writes a run of count copies of the same bit, as needed by the
+ * pending underflow bits.
+ */
+void output_run( CODER *coder, FILE *stream, int bit, long count )
+{
+    while ( count > 16 )
+    {
+        output_bits( coder, stream, bit ? 0xffff : 0, 16 );
+        count -= 16;
+    }
+    output_bits( coder, stream, bit ? ( 1UL << count ) - 1 : 0, (int) count );
+}
+
 /*
  * When the encoding is done, there will still be a lot of bits and
  * bytes sitting in the buffer waiting to be sent out.  This routine
- * is called to clean things up at that point.
+ * is called to clean things up at that point.  The byte holding the
+ * last bits is always written, even if it is empty.
  */
-void flush_output_bitstream( FILE *stream )
+void flush_output_bitstream( CODER *coder, FILE *stream )
 {
-    fwrite( buffer, 1, (size_t)( current_byte - buffer ) + 1, stream );
-    current_byte = buffer;
+    *coder->current_byte++ = (unsigned char)
+        ( coder->bit_window << ( 8 - coder->window_bits ) );
+    fwrite( coder->buffer, 1,
+            (size_t)( coder->current_byte - coder->buffer ), stream );
+    coder->current_byte = coder->buffer;
+    coder->window_bits = 0;
 }
 
 /*
- * Bit oriented input is set up so that the next time the input_bit
- * routine is called, it will trigger the read of a new block.  That
- * is why input_bits_left is set to 0.
+ * Bit oriented input is set up so that the next time a bit is
+ * needed, it will trigger the read of a new block.  That is why the
+ * buffer and the bit window are left empty.
  */
-void initialize_input_bitstream()
+void initialize_input_bitstream( CODER *coder )
 {
-    input_bits_left = 0;
-    input_bytes_left = 1;
-    past_eof = 0;
+    if ( coder->buffer == NULL )
+        set_bitstream_buffer( coder, NULL, 0 );
+    coder->current_byte = coder->buffer;
+    coder->buffer_end = coder->buffer;
+    coder->bit_window = 0;
+    coder->window_bits = 0;
+    coder->past_eof = 0;
 }
 
 /*
- * This routine reads bits in from a file.  The bits are all sitting
- * in a buffer, and this code pulls them out, one at a time.  When the
- * buffer has been emptied, that triggers a new file read, and the
- * pointers are reset.  This routine is set up to allow for two dummy
- * bytes to be read in after the end of file is reached.  This is because
- * we have to keep feeding bits into the pipeline to be decoded so that
- * the old stuff that is 16 bits upstream can be pushed out.
+ * This routine reads the next byte from the buffer, reading a new
+ * block when it is empty.  It is set up to allow for as many dummy
+ * bytes as the coder registers hold to be read in after the end of
+ * file is reached.  This is because we have to keep feeding bits into
+ * the pipeline to be decoded so that the old stuff that is 16 or 32
+ * bits upstream can be pushed out.
  */
-short int input_bit( FILE *stream )
+static unsigned int input_byte( CODER *coder, FILE *stream )
 {
-    if ( input_bits_left == 0 )
+    size_t count;
+
+    if ( coder->current_byte == coder->buffer_end )
     {
-        current_byte++;
-        input_bytes_left--;
-        input_bits_left = 8;
-        if ( input_bytes_left == 0 )
+        count = fread( coder->buffer, 1, coder->buffer_size, stream );
+        if ( count == 0 )
         {
-            input_bytes_left = fread( buffer, 1, BUFFER_SIZE, stream );
-            if ( input_bytes_left == 0 )
-            {
-                if ( past_eof )
-                {
-		    perror("Bad input file");
-                    exit( -1 );
-                }
-                else
-                {
-                    past_eof = 1;
-                    input_bytes_left = 2;
-                }
-            }
-            current_byte = buffer;
+            if ( coder->past_eof++ == coder->bits / 8 )
+                failure( CTX_ERR_FORMAT, "Bad input file" );
+            return( 0 );
         }
+        coder->current_byte = coder->buffer;
+        coder->buffer_end = coder->buffer + count;
     }
-    input_bits_left--;
-    return ( ( *current_byte >> input_bits_left ) & 1 );
+    return( *coder->current_byte++ );
+}
+
+/*
+ * This routine returns the next count bits of the input, the first
+ * one in the most significant position.  Bytes are only taken from
+ * the buffer when the bit window does not hold enough bits.  Groups
+ * of more than 16 bits are split, as in the output.
+ */
+unsigned long input_bits( CODER *coder, FILE *stream, int count )
+{
+    unsigned long bits;
+
+    if ( count > 16 )
+    {
+        bits = input_bits( coder, stream, count - 16 );
+        return( ( bits << 16 ) | input_bits( coder, stream, 16 ) );
+    }
+    while ( coder->window_bits < count )
+    {
+        coder->bit_window = ( coder->bit_window << 8 ) |
+                            input_byte( coder, stream );
+        coder->window_bits += 8;
+    }
+    coder->window_bits -= count;
+    return( ( coder->bit_window >> coder->window_bits ) &
+            ( ( 1UL << count ) - 1 ) );
 }
 
 /*
@@ -145,13 +199,13 @@ short int input_bit( FILE *stream )
  * how many bytes have been output, including pending bytes that
  * haven't actually been written out.
  */
-long bit_ftell_output( FILE *stream )
+long bit_ftell_output( CODER *coder, FILE *stream )
 {
     long total;
 
     total = ftell( stream );
-    total += current_byte - buffer;
-    total += underflow_bits/8;
+    total += coder->current_byte - coder->buffer;
+    total += coder->underflow_bits/8;
     return( total );
 }
 
@@ -160,8 +214,8 @@ long bit_ftell_output( FILE *stream )
  * have been read in so far.  This routine tells how many bytes have
  * been read in, excluding bytes that are pending in the buffer.
  */
-long bit_ftell_input( FILE *stream )
+long bit_ftell_input( CODER *coder, FILE *stream )
 {
-    return( ftell( stream ) - input_bytes_left + 1 );
+    return( ftell( stream ) - ( coder->buffer_end - coder->current_byte ) -
+            coder->window_bits / 8 );
 }
-
@@ -5,11 +5,17 @@
  * the bitstream i/o routines.
  *
  */
-short int input_bit( FILE *stream );
-void initialize_output_bitstream( void );
-void output_bit( FILE *stream, int bit );
-void flush_output_bitstream( FILE *stream );
-void initialize_input_bitstream( void );
-long bit_ftell_output( FILE *stream );
-long bit_ftell_input( FILE *stream );
+#ifndef BITIO_H
+#define BITIO_H
 
+void set_bitstream_buffer( CODER *coder, unsigned char *buffer, size_t size );
+unsigned long input_bits( CODER *coder, FILE *stream, int count );
+void initialize_output_bitstream( CODER *coder );
+void output_bits( CODER *coder, FILE *stream, unsigned long bits, int count );
+void output_run( CODER *coder, FILE *stream, int bit, long count );
+void flush_output_bitstream( CODER *coder, FILE *stream );
+void initialize_input_bitstream( CODER *coder );
+long bit_ftell_output( CODER *coder, FILE *stream );
+long bit_ftell_input( CODER *coder, FILE *stream );
+
+#endif
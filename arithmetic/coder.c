@@ -14,19 +14,22 @@
  */
 
 #include <stdio.h>
+#include <limits.h>
 #include "coder.h"
 #include "bitio.h"
+#include "../failure.h"
+#include "../libcontext.h"
 
 /*
- * These four variables define the current state of the arithmetic
- * coder/decoder.  They are assumed to be 16 bits long.  Note that
- * by declaring them as short ints, they will actually be 16 bits
- * on most 80X86 and 680X0 machines, as well as VAXen.
+ * The code, low, high and underflow_bits fields of the CODER
+ * structure define the current state of the arithmetic coder/decoder.
+ * The registers are either 16 bits long, as in the original code, or
+ * 32 bits long.  They are stored in unsigned longs, so the masks
+ * below are used to keep them in their size.
  */
-static unsigned short int code;  /* The present input code value       */
-static unsigned short int low;   /* Start of the current code range    */
-static unsigned short int high;  /* End of the current code range      */
-long underflow_bits;             /* Number of underflow bits pending   */
+#define TOP_BIT( c )   ( 1UL << ( ( c )->bits - 1 ) )
+#define SECOND_BIT( c ) ( 1UL << ( ( c )->bits - 2 ) )
+#define ALL_BITS( c )  ( ( TOP_BIT( c ) << 1 ) - 1 )
 
 /*
  * This routine must be called to initialize the encoding process.
@@ -34,11 +37,80 @@ long underflow_bits;             /* Number of underflow bits pending   */
  * it has an infinite string of 1s to be shifted into the lower bit
  * positions when needed.
  */
-void initialize_arithmetic_encoder()
+void initialize_arithmetic_encoder( CODER *coder, int bits )
 {
-    low = 0;
-    high = 0xffff;
-    underflow_bits = 0;
+    coder->bits = bits;
+    coder->low = 0;
+    coder->high = ALL_BITS( coder );
+    coder->underflow_bits = 0;
+}
+
+/*
+ * Returns the number of leading 0 bits of the value x in a register.
+ * When x is high ^ low, this is the number of MSDigits that match.
+ * GCC counts them with a single instruction, other compilers test
+ * one bit at a time.
+ */
+#ifdef __GNUC__
+
+static int leading_zeros( CODER *coder, unsigned long x )
+{
+    x &= ALL_BITS( coder );
+    if ( x == 0 )
+        return( coder->bits );
+    return( __builtin_clzl( x ) -
+            ( (int)( sizeof( unsigned long ) * CHAR_BIT ) - coder->bits ) );
+}
+
+#else
+
+static int leading_zeros( CODER *coder, unsigned long x )
+{
+    unsigned long top = TOP_BIT( coder );
+    int n;
+
+    for ( n = 0 ; n < coder->bits && !( x & top ) ; n++ )
+        x <<= 1;
+    return( n );
+}
+
+#endif
+
+/*
+ * Returns the number of consecutive bits, starting from the 2nd
+ * MSDigit, in which low has a 1 and high has a 0.  Each of these
+ * bits is an underflow step.
+ */
+static int underflow_run( CODER *coder, unsigned long low, unsigned long high )
+{
+    return( leading_zeros( coder, ( ~( low & ~high ) << 1 ) | 1 ) );
+}
+
+/*
+ * These lines rescale high and low for the new symbol.  The 16 bit
+ * coder computes the products of the original code.  The 32 bit coder
+ * works as a range coder: it divides the range by the scale first so
+ * no product needs more than 32 bits, and the remainder of the
+ * division goes to the last symbol of the scale.
+ */
+static void rescale_range( CODER *coder, SYMBOL *s,
+                           unsigned long *low, unsigned long *high )
+{
+    unsigned long range, step;
+
+    if ( coder->bits == CODER_BITS )
+    {
+        range = ( *high - *low ) + 1;
+        *high = *low + ( range * s->high_count ) / s->scale - 1;
+        *low = *low + ( range * s->low_count ) / s->scale;
+    }
+    else
+    {
+        step = ( *high - *low ) / s->scale;
+        if ( s->high_count < s->scale )
+            *high = *low + step * s->high_count - 1;
+        *low = *low + step * s->low_count;
+    }
 }
 
 /*
@@ -50,54 +122,59 @@ void initialize_arithmetic_encoder()
  * new symbol.  Then, as many bits as possible are shifted out to
  * the output stream.  Finally, high and low are stable again and
  * the routine returns.
+ *
+ * All the MSDigits that match are shifted out at once, and then all
+ * the pending underflow steps are taken at once.  Once the underflow
+ * steps are taken the MSDigits can not match, so nothing else can
+ * be shifted out.  The range never gets empty, so n is always smaller
+ * than the register size.
  */
-void encode_symbol( FILE *stream, SYMBOL *s )
+void encode_symbol( CODER *coder, FILE *stream, SYMBOL *s )
 {
-    long range;
-/*
- * These three lines rescale high and low for the new symbol.
- */
-    range = (long) ( high-low ) + 1;
-    high = low + (unsigned short int )
-                 (( range * s->high_count ) / s->scale - 1 );
-    low = low + (unsigned short int )
-                 (( range * s->low_count ) / s->scale );
+    unsigned long low = coder->low;
+    unsigned long high = coder->high;
+    unsigned long mask = ALL_BITS( coder );
+    int n, bits = coder->bits;
+
+    rescale_range( coder, s, &low, &high );
 /*
- * This loop turns out new bits until high and low are far enough
- * apart to have stabilized.
+ * If this test passes, it means that the n MSDigits match, and can
+ * be sent to the output stream, the first one followed by the
+ * pending underflow bits.
  */
-    for ( ; ; )
+    n = leading_zeros( coder, high ^ low );
+    if ( n > 0 )
     {
-/*
- * If this test passes, it means that the MSDigits match, and can
- * be sent to the output stream.
- */
-        if ( ( high & 0x8000 ) == ( low & 0x8000 ) )
+        if ( coder->underflow_bits > 0 )
         {
-            output_bit( stream, high & 0x8000 );
-            while ( underflow_bits > 0 )
-            {
-                output_bit( stream, ~high & 0x8000 );
-                underflow_bits--;
-            }
+            output_bits( coder, stream, high >> ( bits - 1 ), 1 );
+            output_run( coder, stream, !( high & TOP_BIT( coder ) ),
+                        coder->underflow_bits );
+            coder->underflow_bits = 0;
+            output_bits( coder, stream,
+                         ( high >> ( bits - n ) ) & ( ( 1UL << ( n - 1 ) ) - 1 ),
+                         n - 1 );
         }
+        else
+            output_bits( coder, stream, high >> ( bits - n ), n );
+        low = ( low << n ) & mask;
+        high = ( ( high << n ) | ( ( 1UL << n ) - 1 ) ) & mask;
+    }
 /*
  * If this test passes, the numbers are in danger of underflow, because
- * the MSDigits don't match, and the 2nd digits are just one apart.
+ * the MSDigits don't match, and the n following digits of low are 1s
+ * and those of high are 0s.  They are removed keeping the MSDigits.
  */
-        else if ( ( low & 0x4000 ) && !( high & 0x4000 ))
-        {
-            underflow_bits += 1;
-            low &= 0x3fff;
-            high |= 0x4000;
-        }
-        else {
-            return ;
-	}
-        low <<= 1;
-        high <<= 1;
-        high |= 1;
+    n = underflow_run( coder, low, high );
+    if ( n > 0 )
+    {
+        coder->underflow_bits += n;
+        low = ( low << n ) & ( mask >> 1 );
+        high = ( ( high << n ) & ( mask >> 1 ) ) | TOP_BIT( coder ) |
+               ( ( 1UL << n ) - 1 );
     }
+    coder->low = low;
+    coder->high = high;
 }
 
 /*
@@ -105,12 +182,13 @@ void encode_symbol( FILE *stream, SYMBOL *s )
  * bits left in the high and low registers.  We output two bits,
  * plus as many underflow bits as are necessary.
  */
-void flush_arithmetic_encoder( FILE *stream )
+void flush_arithmetic_encoder( CODER *coder, FILE *stream )
 {
-    output_bit( stream, low & 0x4000 );
-    underflow_bits++;
-    while ( underflow_bits-- > 0 )
-        output_bit( stream, ~low & 0x4000 );
+    int bit = ( coder->low & SECOND_BIT( coder ) ) != 0;
+
+    output_bits( coder, stream, bit, 1 );
+    output_run( coder, stream, !bit, coder->underflow_bits + 1 );
+    coder->underflow_bits = 0;
 }
 
 /*
@@ -121,86 +199,93 @@ void flush_arithmetic_encoder( FILE *stream )
  *
  *  code = count / s->scale
  */
-short int get_current_count( SYMBOL *s )
+long get_current_count( CODER *coder, SYMBOL *s )
 {
-    long range;
-    short int count;
+    unsigned long range, count;
 
-    range = (long) ( high - low ) + 1;
-    count = (short int)
-            ((((long) ( code - low ) + 1 ) * s->scale-1 ) / range );
-    return( count );
+    if ( s->scale == 0 || s->scale > CODER_MAXIMUM_SCALE( coder ) )
+        failure( CTX_ERR_FORMAT, "Bad input file" );
+    if ( coder->bits == CODER_BITS )
+    {
+        range = ( coder->high - coder->low ) + 1;
+        count = ( ( coder->code - coder->low + 1 ) * s->scale - 1 ) / range;
+        if ( count >= s->scale )
+            failure( CTX_ERR_FORMAT, "Bad input file" );
+    }
+    else
+    {
+        count = ( coder->code - coder->low ) /
+                ( ( coder->high - coder->low ) / s->scale );
+        if ( count >= s->scale )
+            count = s->scale - 1;
+    }
+    return( (long) count );
 }
 
 /*
  * This routine is called to initialize the state of the arithmetic
  * decoder.  This involves initializing the high and low registers
  * to their conventional starting values, plus reading the first
- * 16 bits from the input stream into the code value.
+ * bits from the input stream into the code value.
  */
-void initialize_arithmetic_decoder( FILE *stream )
+void initialize_arithmetic_decoder( CODER *coder, FILE *stream, int bits )
 {
-    int i;
-
-    code = 0;
-    for ( i = 0 ; i < 16 ; i++ )
-    {
-        code <<= 1;
-        code += input_bit( stream );
-    }
-    low = 0;
-    high = 0xffff;
+    coder->bits = bits;
+    coder->code = input_bits( coder, stream, bits );
+    coder->low = 0;
+    coder->high = ALL_BITS( coder );
 }
 
 /*
  * Just figuring out what the present symbol is doesn't remove
  * it from the input bit stream.  After the character has been
  * decoded, this routine has to be called to remove it from the
- * input stream.
+ * input stream.  The bits are shifted out in the same two steps as
+ * in the encoder.
  */
-void remove_symbol_from_stream( FILE *stream, SYMBOL *s )
+void remove_symbol_from_stream( CODER *coder, FILE *stream, SYMBOL *s )
 {
-    long range;
+    unsigned long code = coder->code;
+    unsigned long low = coder->low;
+    unsigned long high = coder->high;
+    unsigned long mask = ALL_BITS( coder );
+    int n;
 
 /*
- * First, the range is expanded to account for the symbol removal.
- */
-    range = (long)( high - low ) + 1;
-    high = low + (unsigned short int)
-                 (( range * s->high_count ) / s->scale - 1 );
-    low = low + (unsigned short int)
-                 (( range * s->low_count ) / s->scale );
-/*
- * Next, any possible bits are shipped out.
+ * A symbol outside the scale can only come from a corrupt model.
  */
-    for ( ; ; )
-    {
+    if ( s->scale == 0 || s->scale > CODER_MAXIMUM_SCALE( coder ) ||
+         s->low_count >= s->high_count || s->high_count > s->scale )
+        failure( CTX_ERR_FORMAT, "Bad input file" );
 /*
- * If the MSDigits match, the bits will be shifted out.
+ * First, the range is expanded to account for the symbol removal.
  */
-        if ( ( high & 0x8000 ) == ( low & 0x8000 ) )
-        {
-        }
+    rescale_range( coder, s, &low, &high );
 /*
- * Else, if underflow is threatining, shift out the 2nd MSDigit.
+ * If the n MSDigits match, the bits will be shifted out.
  */
-        else if ((low & 0x4000) == 0x4000  && (high & 0x4000) == 0 )
-        {
-            code ^= 0x4000;
-            low   &= 0x3fff;
-            high  |= 0x4000;
-        }
+    n = leading_zeros( coder, high ^ low );
+    if ( n > 0 )
+    {
+        low = ( low << n ) & mask;
+        high = ( ( high << n ) | ( ( 1UL << n ) - 1 ) ) & mask;
+        code = ( ( code << n ) | input_bits( coder, stream, n ) ) & mask;
+    }
 /*
- * Otherwise, nothing can be shifted out, so I return.
+ * Then, if underflow is threatining, shift out the n digits after
+ * the MSDigit.  The MSDigit of code ends up being the last of them
+ * inverted.
  */
-        else
-            return;
-        low <<= 1;
-        high <<= 1;
-        high |= 1;
-        code <<= 1;
-        code += input_bit( stream );
+    n = underflow_run( coder, low, high );
+    if ( n > 0 )
+    {
+        low = ( low << n ) & ( mask >> 1 );
+        high = ( ( high << n ) & ( mask >> 1 ) ) | TOP_BIT( coder ) |
+               ( ( 1UL << n ) - 1 );
+        code = ( ( ( code ^ ( TOP_BIT( coder ) >> n ) ) << n ) |
+                 input_bits( coder, stream, n ) ) & mask;
     }
+    coder->code = code;
+    coder->low = low;
+    coder->high = high;
 }
-
-
@@ -8,7 +8,14 @@
  *
  */
 
+#ifndef CODER_H
+#define CODER_H
+
 #define MAXIMUM_SCALE   16383  /* Maximum allowed frequency count */
+#define MAXIMUM_SCALE_WIDE 16777215 /* Same with 32 bit registers     */
+#define CODER_BITS      16     /* Register size of the original   */
+                               /* coder                           */
+#define CODER_BITS_WIDE 32     /* Register size of the range coder*/
 #define ESCAPE          256    /* The escape symbol               */
 #define DONE            -1     /* The output stream empty  symbol */
 #define FLUSH           -2     /* The symbol to flush the model   */
@@ -19,20 +26,49 @@
  * defining it as a pair of counts.
  */
 typedef struct {
-                unsigned short int low_count;
-                unsigned short int high_count;
-                unsigned short int scale;
+                unsigned int low_count;
+                unsigned int high_count;
+                unsigned int scale;
                } SYMBOL;
 
-extern long underflow_bits;    /* The present underflow count in  */
-                               /* the arithmetic coder.           */
+#define BUFFER_SIZE 65536
+
+/*
+ * The complete state of the arithmetic coder/decoder and of its
+ * bitstream.  Every coding routine receives a pointer to one of
+ * these, so independent streams can be coded at the same time.
+ */
+typedef struct {
+                unsigned long code;       /* The present input code value   */
+                unsigned long low;        /* Start of the current code range*/
+                unsigned long high;       /* End of the current code range  */
+                int bits;                 /* Size of the registers          */
+                long underflow_bits;      /* Number of underflow bits       */
+                                          /* pending                        */
+                unsigned char *buffer;    /* This is the i/o buffer         */
+                size_t buffer_size;       /* Size of the i/o buffer         */
+                unsigned char *current_byte; /* Pointer to current byte     */
+                unsigned char *buffer_end; /* End of the input in buffer    */
+                unsigned long bit_window; /* Bits not yet moved to or from  */
+                int window_bits;          /* the buffer, and their number   */
+                int past_eof;             /* Dummy bytes read after eof     */
+                unsigned char default_buffer[ BUFFER_SIZE ];
+               } CODER;
+
+/*
+ * Largest scale that can be used with the registers of a coder.
+ */
+#define CODER_MAXIMUM_SCALE( c ) \
+        ( ( c )->bits == CODER_BITS ? MAXIMUM_SCALE : MAXIMUM_SCALE_WIDE )
+
 /*
  * Function prototypes.
  */
-void initialize_arithmetic_decoder( FILE *stream );
-void remove_symbol_from_stream( FILE *stream, SYMBOL *s );
-void initialize_arithmetic_encoder( void );
-void encode_symbol( FILE *stream, SYMBOL *s );
-void flush_arithmetic_encoder( FILE *stream );
-short int get_current_count( SYMBOL *s );
+void initialize_arithmetic_decoder( CODER *coder, FILE *stream, int bits );
+void remove_symbol_from_stream( CODER *coder, FILE *stream, SYMBOL *s );
+void initialize_arithmetic_encoder( CODER *coder, int bits );
+void encode_symbol( CODER *coder, FILE *stream, SYMBOL *s );
+void flush_arithmetic_encoder( CODER *coder, FILE *stream );
+long get_current_count( CODER *coder, SYMBOL *s );
 
+#endif
@@ -0,0 +1,81 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#include "bitset.h"
+#include "failure.h"
+#include "libcontext.h"
+
+#ifndef __GNUC__
+
+/**
+ * @param[in] x the word.
+ * @returns the number of bits set.
+ */
+Uint popcount(Uint x) {
+  Uint n = 0;
+
+  for (; x; x &= x - 1) {
+    n++;
+  }
+  return n;
+}
+
+#endif
+
+/**
+ * @param[in] mask the set.
+ * @param[in] end an alphabet index, at most the alphabet size.
+ * @returns the number of indexes in the set lower than <i>end</i>.
+ */
+Uint countMasked(const symbolMask *mask, const Uint end) {
+  Uint i, word = end >> LOGWORDSIZE, count = 0;
+
+  for (i=0; i<word; i++) {
+    count += POPCOUNT(mask->bits[i]);
+  }
+  if (word < MASK_WORDS) {
+    count += POPCOUNT(mask->bits[word] & ((UintConst(1) << (end & (SET_WORD_BITS - 1))) - 1));
+  }
+  return count;
+}
+
+/**
+ * @param[in] mask the set.
+ * @param[in] end the alphabet size.
+ * @param[in] rank number of indexes outside the set before the wanted one. If it is not
+ * lower than the number of indexes of the alphabet outside the set the data is corrupt.
+ * @returns the alphabet index.
+ */
+Uint selectUnmasked(const symbolMask *mask, const Uint end, Uint rank) {
+  Uint i, word, free, pos, words = (end + SET_WORD_BITS - 1) >> LOGWORDSIZE;
+
+  for (i=0; i<words && rank >= (free = SET_WORD_BITS - POPCOUNT(mask->bits[i])); i++) {
+    rank -= free;
+  }
+  if (i == words) {
+    failure(CTX_ERR_FORMAT, "Invalid compressed file");
+  }
+  for (word = ~mask->bits[i]; rank > 0; rank--) {
+    word &= word - 1; /* clear the lowest free index */
+  }
+  pos = (i << LOGWORDSIZE) + POPCOUNT((word & -word) - 1);
+  if (pos >= end) {
+    failure(CTX_ERR_FORMAT, "Invalid compressed file");
+  }
+  return pos;
+}
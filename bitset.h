@@ -0,0 +1,82 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <string.h>
+#include <limits.h>
+#include "types.h"
+
+/** Number of bits in a word of a bit set. */
+#define SET_WORD_BITS (UintConst(1) << LOGWORDSIZE)
+
+/** Number of words of a set of alphabet indexes. */
+#define MASK_WORDS ((UCHAR_MAX + 1) / SET_WORD_BITS)
+
+#ifdef __GNUC__
+
+/**
+ * Counts the bits set in a word.
+ * @param[in] X the word.
+ * @returns the number of bits set.
+ */
+#define POPCOUNT(X) ((Uint)__builtin_popcountl(X))
+
+#else
+
+/** Counts the bits set in a word. */
+Uint popcount(Uint);
+
+#define POPCOUNT(X) popcount(X)
+
+#endif
+
+/** Set of alphabet indexes, used for the symbols excluded while coding a symbol. */
+typedef struct symbolMask {
+  Uint bits[MASK_WORDS]; /**< One bit for each alphabet index. */
+} symbolMask;
+
+/**
+ * Empties a set of alphabet indexes.
+ * @param[out] M the set.
+ */
+#define CLEARMASK(M) memset((M).bits, 0, sizeof((M).bits))
+
+/**
+ * Indicates if an alphabet index is in a set.
+ * @param[in] M the set.
+ * @param[in] P the alphabet index.
+ * @returns True if the index is in the set.
+ */
+#define ISMASKED(M,P) (((M).bits[(P) >> LOGWORDSIZE] >> ((P) & (SET_WORD_BITS - 1))) & 1)
+
+/**
+ * Adds an alphabet index to a set.
+ * @param[in,out] M the set.
+ * @param[in] P the alphabet index.
+ */
+#define SETMASKED(M,P) ((M).bits[(P) >> LOGWORDSIZE] |= UintConst(1) << ((P) & (SET_WORD_BITS - 1)))
+
+/** Returns the number of indexes of a set lower than a given one. */
+Uint countMasked(const symbolMask *, const Uint);
+
+/** Returns the index with a given number of lower indexes outside a set. */
+Uint selectUnmasked(const symbolMask *, const Uint, Uint);
+
+#endif
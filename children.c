@@ -0,0 +1,164 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#include <string.h>
+#ifndef WIN32
+#include <obstack.h>
+#endif
+#include "children.h"
+#include "bitset.h"
+#include "spacedef.h"
+
+#ifndef WIN32
+#define obstack_chunk_alloc malloc
+#define obstack_chunk_free free
+#endif
+
+/** Initial size of the list of children. */
+#define INITIAL_CHILDREN 2
+
+/**
+ * Returns the number of children with an alphabet index lower than a given one.
+ * @param[in] children the children of the node.
+ * @param[in] pos the alphabet index.
+ * @returns the position in the list of the child at that index.
+ */
+static Uint rank(const childSet *children, const Uint pos) {
+  Uint i, word = pos >> LOGWORDSIZE, count = 0;
+
+  for (i=0; i<word; i++) {
+    count += POPCOUNT(children->bits[i]);
+  }
+  return count + POPCOUNT(children->bits[word] & ((UintConst(1) << (pos & (CHILD_WORD_BITS - 1))) - 1));
+}
+
+/**
+ * @param[out] children the set to initialize.
+ * @param[in] stack obstack where the list will be allocated, NULL to use malloc.
+ */
+void initChildren(childSet *children, struct obstack *stack) {
+  memset(children, 0, sizeof(childSet));
+  children->stack = stack;
+}
+
+/**
+ * @param[in] children the set to release.
+ */
+void freeChildren(childSet *children) {
+  if (!children->stack) {
+    FREE(children->list);
+  }
+}
+
+/**
+ * @param[in] children the children of the node.
+ * @param[in] pos the alphabet index.
+ * @returns the child or NULL.
+ */
+void *getChild(const childSet *children, const Uint pos) {
+  return HASCHILD(*children, pos) ? children->list[rank(children, pos)] : NULL;
+}
+
+/**
+ * Grows the list of children. Lists allocated in an obstack are copied to a new area 
+ * and the old one is released with the obstack.
+ * @param[in] children the children of the node.
+ */
+static void growChildren(childSet *children) {
+  Ushort alloc = (children->alloc ? children->alloc << 1 : INITIAL_CHILDREN);
+  void **list;
+
+#ifndef WIN32
+  if (children->stack) {
+    list = (void **)obstack_alloc(children->stack, sizeof(void *) * alloc);
+    if (children->size) {
+      memcpy(list, children->list, sizeof(void *) * children->size);
+    }
+    children->list = list;
+  }
+  else
+#endif
+  {
+    REALLOC(list, children->list, void *, alloc);
+    children->list = list;
+  }
+  children->alloc = alloc;
+}
+
+/**
+ * Replaces the child at the index if there is one, otherwise the child is inserted in
+ * the list.
+ * @param[in,out] children the children of the node.
+ * @param[in] pos the alphabet index.
+ * @param[in] child the new child.
+ */
+void setChild(childSet *children, const Uint pos, void *child) {
+  Uint r = rank(children, pos);
+
+  if (!HASCHILD(*children, pos)) {
+    if (children->size == children->alloc) {
+      growChildren(children);
+    }
+    memmove(children->list + r + 1, children->list + r, sizeof(void *) * (children->size - r));
+    children->size++;
+    children->bits[pos >> LOGWORDSIZE] |= UintConst(1) << (pos & (CHILD_WORD_BITS - 1));
+  }
+  children->list[r] = child;
+}
+
+/**
+ * @param[in] children the children of the node.
+ * @param[in] k position in the list, lower than the number of children.
+ * @returns the alphabet index of the child.
+ */
+Uint getChildIndex(const childSet *children, const Uint k) {
+  Uint i, count, word, bits;
+
+  for (i=0, count=0; count + POPCOUNT(children->bits[i]) <= k; i++) {
+    count += POPCOUNT(children->bits[i]);
+  }
+  for (word = children->bits[i], bits = k - count; bits > 0; bits--) {
+    word &= word - 1; /* clear the lowest bit */
+  }
+  return (i << LOGWORDSIZE) + POPCOUNT((word & -word) - 1);
+}
+
+/**
+ * Marks as traversed all the edges from an alphabet index up to the first child whose
+ * edge was not traversed, which is also marked. Edges without a child are only marked, 
+ * so visiting the children like this is equivalent to traversing every edge in order.
+ * @param[in,out] children the children of the node.
+ * @param[in] from first alphabet index to traverse.
+ * @param[in] end alphabet size.
+ * @returns the index of the child or <i>end</i> if all the remaining edges were marked.
+ */
+Uint traverseNextChild(childSet *children, const Uint from, const Uint end) {
+  Uint word, mask, candidates, lowest;
+
+  for (word = from >> LOGWORDSIZE; (word << LOGWORDSIZE) < end; word++) {
+    mask = (word == (from >> LOGWORDSIZE) ? ~UintConst(0) << (from & (CHILD_WORD_BITS - 1)) : ~UintConst(0));
+    candidates = children->bits[word] & ~children->traversed[word] & mask;
+    if (candidates) {
+      lowest = candidates & -candidates;
+      children->traversed[word] |= mask & ((lowest << 1) - 1);
+      return (word << LOGWORDSIZE) + POPCOUNT(lowest - 1);
+    }
+    children->traversed[word] |= mask;
+  }
+  return end;
+}
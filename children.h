@@ -0,0 +1,89 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#ifndef CHILDREN_H
+#define CHILDREN_H
+
+#include <limits.h>
+#include "types.h"
+
+struct obstack;
+
+/** Number of bits in each word of the children bitmap. */
+#define CHILD_WORD_BITS (UintConst(1) << LOGWORDSIZE)
+
+/** Number of words of the children bitmap. There is room for every alphabet index and the end of text index. */
+#define CHILD_WORDS ((UCHAR_MAX + 1) / CHILD_WORD_BITS + 1)
+
+/**
+ * Indicates if a node has a child at an alphabet index.
+ * @param[in] C the children of the node.
+ * @param[in] P the alphabet index.
+ * @returns True if there is a child at that index.
+ */
+#define HASCHILD(C,P) (((C).bits[(P) >> LOGWORDSIZE] >> ((P) & (CHILD_WORD_BITS - 1))) & 1)
+
+/**
+ * Indicates if the edge of a node at an alphabet index has been traversed.
+ * @param[in] C the children of the node.
+ * @param[in] P the alphabet index.
+ * @returns True if the edge has been traversed.
+ */
+#define TRAVERSED(C,P) (((C).traversed[(P) >> LOGWORDSIZE] >> ((P) & (CHILD_WORD_BITS - 1))) & 1)
+
+/**
+ * Marks the edge of a node at an alphabet index as traversed.
+ * @param[in] C the children of the node.
+ * @param[in] P the alphabet index.
+ */
+#define SETTRAVERSED(C,P) ((C).traversed[(P) >> LOGWORDSIZE] |= UintConst(1) << ((P) & (CHILD_WORD_BITS - 1)))
+
+/** 
+ * Children of a context tree node. A bitmap tells which alphabet indexes have a child and
+ * the children are packed in a list in alphabet order, so the position of a child in the
+ * list is the number of bits set before its index. The same structure holds the FSM 
+ * transitions defined at each node.
+ */
+typedef struct childSet {
+  Uint bits[CHILD_WORDS], /**< Bitmap of the alphabet indexes that have a child. */
+       traversed[CHILD_WORDS]; /**< Bitmap of the edges an attempt was made to traverse. */
+  void **list; /**< Children in alphabet order. */
+  Ushort size, /**< Number of children. */
+         alloc; /**< Allocated size of the list. */
+  struct obstack *stack; /**< Obstack where the list is allocated, NULL if it is allocated with malloc. */
+} childSet;
+
+/** Initializes an empty set of children. */
+void initChildren(childSet *, struct obstack *);
+
+/** Releases the list of children if it was allocated with malloc. */
+void freeChildren(childSet *);
+
+/** Returns the child at an alphabet index or NULL if there is none. */
+void *getChild(const childSet *, const Uint);
+
+/** Sets the child at an alphabet index. */
+void setChild(childSet *, const Uint, void *);
+
+/** Returns the alphabet index of the child at a position of the list. */
+Uint getChildIndex(const childSet *, const Uint);
+
+/** Marks the edges from an index up to the next child not yet traversed as traversed and returns its index. */
+Uint traverseNextChild(childSet *, const Uint, const Uint);
+
+#endif
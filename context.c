@@ -0,0 +1,55 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#include "context.h"
+#include "spacedef.h"
+#include "statistics.h"
+
+#define obstack_chunk_alloc malloc
+#define obstack_chunk_free free
+
+/**
+ * @returns a new context. 
+ */
+context_t initContext() {
+  context_t ctx;
+
+  CALLOC(ctx, struct context, 1);
+#ifndef WIN32
+  obstack_init (&(ctx->nodeStack));
+  if (obstack_chunk_size (&(ctx->nodeStack)) < 16384) {
+    obstack_chunk_size (&(ctx->nodeStack)) = 16384;
+  }
+#endif
+  return ctx;
+}
+
+
+/**
+ * @param[in] ctx context to delete. 
+ */
+void freeContext(context_t ctx) {
+  FREE(ctx->text);
+  FREE(ctx->labels);
+  FREE(ctx->coderBuffer);
+  freeBuffer(&ctx->stats);
+#ifndef WIN32
+  obstack_free(&(ctx->nodeStack), NULL);
+#endif
+  FREE(ctx);
+}
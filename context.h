@@ -0,0 +1,90 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#ifndef WIN32
+#include <obstack.h>
+#endif
+#include "types.h"
+#include "arithmetic/coder.h"
+
+/** 
+ * Executes the input code only if progress messages are enabled. Needs the context in 
+ * a variable called ctx.
+ * @param[in] S the code to execute.
+ */
+#define VERBOSE(S) if (ctx->verbose) { S; }
+
+/** Number of entries in the SEE table. */
+#define SEE_SIZE (1<<14)
+
+/** Statistics no longer used by a tree builder, kept to be reused. */
+typedef struct statsBuffer {
+  Uint top, /**< Number of statistics stored in the buffer. */
+       alloc, /**< Allocated size of the buffer. */
+       *stats; /**< The stored statistics. */
+} *statsBuffer_t;
+
+/** 
+ * State of one compression or decompression stream. Every function of the encoder, 
+ * the decoder, the tree builders and the arithmetic coder receives it, so independent 
+ * streams can be processed at the same time, each one with its own instance.
+ */
+typedef struct context {
+  Uint textlen; /**< Length of the input text in the encoder. */
+  Uchar *text; /**< Input text to the encoder. */
+
+  Uint alphasize; /**< Alphabet size. */
+  Uchar characters[UCHAR_MAX+1]; /**< Characters in text in alphabetical order. */
+  Uint alphaindex[UCHAR_MAX+1]; /**< Index of each alphabet character */
+
+  Uint maxCount; /**< Reset threshold. */
+  Uint See[SEE_SIZE][2]; /**< SEE table. */
+
+  double alphasizeLog; /**< Log2 of the alphabet size. */
+  double alphaEntropy; /**< Binary entropy of 1/alphasize. */
+  Uint cachedAlphasize; /**< Alphabet size used to compute the cached values above. */
+
+  struct statsBuffer stats; /**< Statistics no longer used by the tree builders. */
+
+  Uint labelsLen, /**< Number of characters stored in the label buffer. */
+       labelsAlloc; /**< Allocated size of the label buffer. */
+  Uchar *labels; /**< Labels of the decoder tree nodes followed by the decoded text in reverse order. */
+
+#ifndef WIN32
+  struct obstack nodeStack; /**< Obstack used to allocate the decoder tree nodes. */
+#endif
+
+  CODER coder; /**< Arithmetic coder state. */
+  Uchar *coderBuffer; /**< Buffer of the arithmetic coder, NULL if it uses the one inside the coder. */
+
+  int threads; /**< Number of threads that build the context tree with the WOTD algorithm. */
+
+  BOOL verbose; /**< If progress messages are printed. */
+  FILE *messages; /**< Stream where the progress messages are printed. */
+} *context_t;
+
+/** Creates and initializes a new context. */
+context_t initContext();
+
+/** Deletes a context and all the memory it owns. */
+void freeContext(context_t);
+
+#endif
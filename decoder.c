@@ -20,6 +20,9 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h> 
+#ifndef WIN32
+#include <obstack.h>
+#endif
 #include "decoder.h"
 #include "debug.h"
 #include "alpha.h"
@@ -27,27 +30,139 @@
 #include "stack.h"
 #include "see.h"
 #include "reset.h"
+#include "bitset.h"
+#include "symbols.h"
 #include "arithmetic/coder.h"
 #include "arithmetic/bitio.h"
+#include "failure.h"
+#include "libcontext.h"
+
+#ifndef WIN32
+#define obstack_chunk_alloc malloc
+#define obstack_chunk_free free
+#endif
+
+/** Number of consecutive symbols of a node whose counts are added in one block. */
+#define BLOCK_SYMS 16
+
+/** Number of symbols from which a node keeps the sums of the counts of its blocks. */
+#define WIDE_NODE 64
+
+/**
+ * Returns the number of blocks of the symbols of a node.
+ * @param[in] N number of symbols.
+ * @returns the number of blocks.
+ */
+#define BLOCKS(N) (((N) + BLOCK_SYMS - 1) / BLOCK_SYMS)
+
+/**
+ * Returns the position in the label buffer of a decoded symbol. The part is decoded backwards
+ * at the end of the buffer, so the context of every symbol is read forwards from its position
+ * and the leaves added while decoding use it as their label.
+ * @param[in] I position of the symbol in the part.
+ * @returns the position in the label buffer.
+ */
+#define DECODED(I) (ctx->labelsLen - 1 - (I))
+
+/** Initial size of the list of nodes escaped while decoding a symbol. */
+#define INITIAL_PATH 64
+
+/**
+ * Appends a node to the list of nodes escaped while decoding the current symbol, so they
+ * are not searched again to add the symbol. Needs the list in path, its size in 
+ * pathAlloc and the number of nodes in length.
+ * @param[in] T the node.
+ */
+#define PUSHPATH(T) {\
+    if (length == pathAlloc) {\
+      pathAlloc *= 2;\
+      REALLOC(path, path, decoderStats_t, pathAlloc);\
+    }\
+    path[length++] = (T);\
+  }
+
+/**
+ * Recomputes the sums of the counts of the blocks of a state that hold a range of
+ * symbols, and the positions of their symbols. Does nothing if the state does not 
+ * keep them.
+ * @param[in,out] tree statistics of the state.
+ * @param[in] first position of the first symbol whose count has changed.
+ * @param[in] last position of the last symbol whose count has changed.
+ */
+static void updateBlocks (decoderStats_t tree, Uint first, Uint last) {
+  Uint b, k, end;
+
+  if (!tree->blocksValid) {
+    return;
+  }
+  for (b = first / BLOCK_SYMS; b <= last / BLOCK_SYMS; b++) {
+    end = (b + 1) * BLOCK_SYMS < tree->totalSyms ? (b + 1) * BLOCK_SYMS : tree->totalSyms;
+    tree->blockCount[b] = 0;
+    for (k = b * BLOCK_SYMS; k < end; k++) {
+      tree->blockCount[b] += tree->symbols[k].count;
+      tree->position[tree->symbols[k].symbol] = k;
+    }
+  }
+}
+
+/**
+ * Computes the sums of the counts of the blocks of a state and the positions of its
+ * symbols if they are not up to date. They are allocated the first time, in the 
+ * obstack of the nodes.
+ * @param[in,out] tree statistics of the state, with at least WIDE_NODE symbols.
+ */
+static void buildBlocks (context_t ctx, decoderStats_t tree) {
+  if (tree->blocksValid) {
+    return;
+  }
+  if (!tree->blockCount) {
+#ifndef WIN32
+    tree->blockCount = (Uint *)obstack_alloc(&ctx->nodeStack, sizeof(Uint) * BLOCKS(ctx->alphasize));
+    tree->position = (Uchar *)obstack_alloc(&ctx->nodeStack, sizeof(Uchar) * ctx->alphasize);
+#else
+    CALLOC(tree->blockCount, Uint, BLOCKS(ctx->alphasize));
+    CALLOC(tree->position, Uchar, ctx->alphasize);
+#endif
+  }
+  tree->blocksValid = True;
+  updateBlocks(tree, 0, tree->totalSyms - 1);
+}
+
+/**
+ * Finds a symbol in a state, in its position map if it keeps the sums of its blocks.
+ * @param[in] tree statistics of the state.
+ * @param[in] pos alphabet index of the symbol.
+ * @returns the position of the symbol or totalSyms if the state does not have it.
+ */
+static Uint symbolPosition (decoderStats_t tree, Uchar pos) {
+  Uint j;
+
+  if (!tree->blocksValid) {
+    return findSymbol(tree->symbols, tree->totalSyms, pos);
+  }
+  /* the map is not cleared, so the entries of missing symbols may be stale */
+  j = tree->position[pos];
+  return j < tree->totalSyms && tree->symbols[j].symbol == pos ? j : tree->totalSyms;
+}
 
 /**
  * Remove symbols from the statistics of the ancestors of this node in case that is necessary.
  * Symbols are removed from the ancestors if they only have the same symbols as the child node
  * (including the ones indicated in deletedChars).
- * @param[in] tree node of the tree.
- * @param[in] deletedChars bit vector indicating which characters have been erased from the node statistics.
+ * @param[in] tree statistics of the node.
+ * @param[in] deletedChars set of the characters that have been erased from the node statistics.
  */
-static void fixParents (decoderTree_t tree, BOOL *deletedChars) {
+static void fixParents (context_t ctx, decoderStats_t tree, const symbolMask *deletedChars) {
   Uint i; /*, numEscapes;*/
-  decoderTree_t parTree = tree;
+  decoderStats_t parTree = tree;
   BOOL newChars;
 
-  while (!isRootDecoderTree(parTree)) {
-    parTree = parTree->parent->origin;
+  while (parTree->parent) {
+    parTree = parTree->parent;
     newChars = False;
 
     for (i=0; i<parTree->totalSyms && !newChars; i++) {
-      newChars |= parTree->count[i] > 1;
+      newChars |= parTree->symbols[i].count > 1;
     }
 
     if (!newChars) { /* there are no new symbols */
@@ -55,12 +170,12 @@ static void fixParents (decoderTree_t tree, BOOL *deletedChars) {
       /*numEscapes = parTree->totalCount;*/
       parTree->totalCount = 0;
       for (i=0; i<parTree->totalSyms; i++) {  
-	/*numEscapes -= parTree->count[i];*/
-	if (deletedChars[alphaindex[parTree->symbols[i]]]) {
-	  parTree->count[i] = 0;
+	/*numEscapes -= parTree->symbols[i].count;*/
+	if (ISMASKED(*deletedChars, parTree->symbols[i].symbol)) {
+	  parTree->symbols[i].count = 0;
 	}
 	else {
-	  parTree->totalCount += parTree->count[i];
+	  parTree->totalCount += parTree->symbols[i].count;
 	}
       }
 
@@ -68,54 +183,62 @@ static void fixParents (decoderTree_t tree, BOOL *deletedChars) {
       if (numEscapes == 0) numEscapes = 1;  es necesario esto? 
       parTree->totalCount += numEscapes;*/
       parTree->totalCount *= 2;
+      if (ORDERED_SYMBOLS(ctx)) {
+	sortSymbols(parTree->symbols, parTree->totalSyms);
+      }
+      parTree->blocksValid = False;
     }
     else break;
   }
 }
     
-static void rescale (decoderTree_t tree) {
-  BOOL *charFlags, needToFix = False;
+static void rescale (context_t ctx, decoderStats_t tree) {
+  symbolMask charFlags;
+  BOOL needToFix = False;
   Uint numEscapes, i;
   DEBUGCODE(printf("rescalo %p\n", (void *)tree));
 
-  numEscapes = tree->totalCount; /* - tree->count[0];*/
-  /*tree->count[0] = tree->count[0] >> 1;*/
-  tree->totalCount = 0; /*tree->count[0];*/
-  CALLOC(charFlags, BOOL, alphasize);    
+  numEscapes = tree->totalCount; /* - tree->symbols[0].count;*/
+  /*tree->symbols[0].count = tree->symbols[0].count >> 1;*/
+  tree->totalCount = 0; /*tree->symbols[0].count;*/
+  CLEARMASK(charFlags);
 
   for (i=0; i<tree->totalSyms; i++) {  
-    if (tree->count[i] > 0) {
-      numEscapes -= tree->count[i];
-      tree->count[i] = tree->count[i] >> 1;
-      if (tree->count[i] == 0) {
-	/*DEBUGCODE(printf("needtofix %d\n", tree->symbols[i]));*/
-	charFlags[alphaindex[tree->symbols[i]]] = True;
+    if (tree->symbols[i].count > 0) {
+      numEscapes -= tree->symbols[i].count;
+      tree->symbols[i].count = tree->symbols[i].count >> 1;
+      if (tree->symbols[i].count == 0) {
+	/*DEBUGCODE(printf("needtofix %d\n", tree->symbols[i].symbol));*/
+	SETMASKED(charFlags, tree->symbols[i].symbol);
 	needToFix = True;
       }
       else {
-	tree->totalCount += tree->count[i];
+	tree->totalCount += tree->symbols[i].count;
       }
     }
   }
 
+  if (ORDERED_SYMBOLS(ctx)) {
+    sortSymbols(tree->symbols, tree->totalSyms);
+  }
+  tree->blocksValid = False;
   if (needToFix) {
-   fixParents(tree, charFlags);
+   fixParents(ctx, tree, &charFlags);
   }
-  FREE(charFlags);
   numEscapes = numEscapes >> 1;
   if (numEscapes == 0) numEscapes = 1; /* es necesario esto? */
   tree->totalCount += numEscapes;
 }
 
-static void printStats (decoderTree_t origTree, Uint *maskedChars, Uint i) {
+static void printStats (context_t ctx, decoderStats_t origTree, symbolMask *masked) {
   int j;
 
   printf ("## ");
   for(j=0; j<origTree->totalSyms; j++) {
-    printf("count[%d] = %ld %s", origTree->symbols[j], origTree->count[j], 
-	   (maskedChars[alphaindex[origTree->symbols[j]]] == i+1 ? "(masked) " : ""));
+    printf("count[%d] = %u %s", ctx->characters[origTree->symbols[j].symbol], origTree->symbols[j].count, 
+	   (ISMASKED(*masked, origTree->symbols[j].symbol) ? "(masked) " : ""));
   }
-  printf("Total: %ld %ld (%p)\n", origTree->totalCount, origTree->totalSyms, (void *)origTree);
+  printf("Total: %u %u (%p)\n", origTree->totalCount, origTree->totalSyms, (void *)origTree);
   /*printf("Total: %d %d\n", origTree->totalCount, origTree->totalSyms);*/
   
   /*if (!isRootDecoderTree (origTree)) {
@@ -127,20 +250,20 @@ static void printStats (decoderTree_t origTree, Uint *maskedChars, Uint i) {
   else printf("\n");*/
 }
 
-static void addNodes (Uchar * text, Uchar sym, decoderTree_t * tree, decoderTree_t * prevTree, Uint i, Uint * zPrevLeft, Uint * zPrevRight) {
+static void addNodes (context_t ctx, Uchar sym, decoderTree_t * tree, decoderTree_t * prevTree, Uint i, Uint * zPrevLeft, Uint * zPrevRight) {
   decoderTree_t sNext, child, newChild, new, newLeaf;
   Uint zLeft = 1, zRight = 0, uSize, uLeft, zNextLeft, j, k, b;
   BOOL end;
 
-  text[i] = sym;
-  sNext = (*tree)->transitions[alphaindex[sym]];
+  ctx->labels[DECODED(i)] = sym;
+  sNext = getDecoderTransition(*tree, ctx->alphaindex[sym]);
   new = NULL;
 
   /* calculo u */
   if (!isRootDecoderTree(sNext) && sNext->right >= (*tree)->right + 1) {
     /* u is empty */
     if (*zPrevLeft <= *zPrevRight) {
-      child = sNext->children[alphaindex[(*(*prevTree)->text)[*zPrevLeft]]];
+      child = DECCHILD(sNext, ctx->alphaindex[DECLABEL(*prevTree, *zPrevLeft)]);
       if (child) {
 	*zPrevLeft = child->left;
 	zLeft = child->left;
@@ -160,12 +283,12 @@ static void addNodes (Uchar * text, Uchar sym, decoderTree_t * tree, decoderTree
     if (isRootDecoderTree(sNext)) {
       uSize = (*tree)->right + 1;
       uLeft = 0;
-      child = sNext->children[alphaindex[sym]];
+      child = DECCHILD(sNext, ctx->alphaindex[sym]);
     }
     else {
       uSize = (*tree)->right - sNext->right;
-      uLeft = sNext->right + 1; /* points to tree->text */
-      child = sNext->children[alphaindex[(*(*tree)->text)[sNext->right]]];
+      uLeft = sNext->right + 1; /* points to the label of tree */
+      child = DECCHILD(sNext, ctx->alphaindex[DECLABEL(*tree, sNext->right)]);
     }
 
     if (child) {
@@ -173,14 +296,14 @@ static void addNodes (Uchar * text, Uchar sym, decoderTree_t * tree, decoderTree
       end = False;
       zNextLeft = child->left; /* will be zPrevLeft when the do-while loop ends */
       do {
-	for (k=child->left+1; j < uSize && k <= child->right && (*(*tree)->text)[uLeft+j] == (*child->text)[k]; j++, k++);
+	for (k=child->left+1; j < uSize && k <= child->right && DECLABEL(*tree, uLeft+j) == DECLABEL(child, k); j++, k++);
 	if (j == uSize) { /* all u belongs to WORD T */
 	  if (k > child->right) { /* sz already is a node = child */
 	    new = child;
 	  }
 	  else {
 	    if ((*zPrevLeft <= *zPrevRight) && 
-		((*(*prevTree)->text)[*zPrevLeft] == (*child->text)[k])) { /* head z belongs to WORD T */
+		(DECLABEL(*prevTree, *zPrevLeft) == DECLABEL(child, k))) { /* head z belongs to WORD T */
 	      if (k == child->right) {
 		new = child;
 		/* TODO: esto es dudoso, ¿hay que seguir bajando? */
@@ -200,7 +323,7 @@ static void addNodes (Uchar * text, Uchar sym, decoderTree_t * tree, decoderTree
 	}
 	else { 
 	  if (k > child->right) { /* standing in a node */
-	    newChild = child->children[alphaindex[(*(*tree)->text)[uLeft+j]]];
+	    newChild = DECCHILD(child, ctx->alphaindex[DECLABEL(*tree, uLeft+j)]);
 	    if (newChild) {
 	      sNext = child;
 	      child = newChild;
@@ -229,45 +352,35 @@ static void addNodes (Uchar * text, Uchar sym, decoderTree_t * tree, decoderTree
   /* insert z if necessary */
   if (new == NULL) {
     if (zLeft <= zRight) {
-      new  = initDecoderTree(False);
+      new  = initDecoderTree(ctx);
       DEBUGCODE(printf("New node4: %p\n", (void *)new));
       new->internal = child->internal;
       new->internalFSM = child->internalFSM;
       new->left = (!isRootDecoderTree(sNext) ? sNext->right + 1 : 0);
       new->right = new->left + zRight - zLeft;
 
-      new->children[alphaindex[(*child->text)[new->right+1]]] = child;
+      setChild(&new->children, ctx->alphaindex[DECLABEL(child, new->right+1)], child);
       child->left = new->right + 1;
       child->parent = new; 
-      new->text = child->text;
+      new->label = child->label;
 
       new->parent = sNext;
       if (isRootDecoderTree(sNext)) {
-	sNext->children[alphaindex[sym]] = new;
+	setChild(&sNext->children, ctx->alphaindex[sym], new);
       }
       else {
-	sNext->children[alphaindex[(*(*tree)->text)[sNext->right]]] = new;
+	setChild(&sNext->children, ctx->alphaindex[DECLABEL(*tree, sNext->right)], new);
       }
 
-      new->totalSyms = child->totalSyms;
-      new->totalCount = 0;
-
-      memcpy(new->transitions, sNext->transitions, alphasize * sizeof(decoderTree_t));
-      for (j=0; j < new->totalSyms; j++) {
-	new->count[j] = (child->count[j] == 0 ? 0 : 1);
-	new->totalCount += new->count[j];
-	new->symbols[j] = child->symbols[j];
-      }
-      new->totalCount *= 2; /* symbols and escapes */
-
       if (sNext->internal) {
 	new->origin = new;
       }
       else {
 	new->origin = child->origin;
       }
+      splitDecoderStats(ctx, new, child);
 
-      verifyDecoder((isRootDecoderTree(sNext) ? sNext : sNext->tail), new);
+      verifyDecoder(ctx, (isRootDecoderTree(sNext) ? sNext : sNext->tail), new);
     }
     else {
       /* Hay que llamar a verify? */
@@ -284,34 +397,23 @@ static void addNodes (Uchar * text, Uchar sym, decoderTree_t * tree, decoderTree
   if (new->internalFSM) {
     /*if (new->internal) {*/
     if (!isRootDecoderTree(new) && new->right < i) {
-      b = text[i - new->right - 1];
+      b = ctx->labels[DECODED(i - new->right - 1)];
     }
     else if (isRootDecoderTree(new)) {
-      b = text[i];
+      b = sym;
     }
   }
 
   if (b != -1) {
     /* insert b */
-    newLeaf = initDecoderTree(False);
+    newLeaf = initDecoderTree(ctx);
     DEBUGCODE(printf("New node5: %p\n", (void *)newLeaf));
     newLeaf->internal = False;
     newLeaf->internalFSM = False;
     newLeaf->left = newLeaf->right = new->right + 1;
     newLeaf->parent = new; 
-    new->children[alphaindex[b]] = newLeaf;
-
-    MALLOC(newLeaf->text, Uchar *, 1);
-    MALLOC(*newLeaf->text,Uchar, newLeaf->right + 1);
-    if (newLeaf->right > 0) {
-      memcpy(*newLeaf->text, *new->text, newLeaf->left);
-    }
-    (*newLeaf->text)[newLeaf->left] = b;      
-
-    memcpy(newLeaf->transitions, new->transitions, alphasize * sizeof(decoderTree_t));
-    /*for (j=0; j<alphasize; j++) {
-      newLeaf->transitions[j] = new->transitions[j];
-      }*/
+    setChild(&new->children, ctx->alphaindex[b], newLeaf);
+    newLeaf->label = DECODED(i);
 
     if (new->internal) {
       newLeaf->origin = newLeaf;
@@ -319,8 +421,9 @@ static void addNodes (Uchar * text, Uchar sym, decoderTree_t * tree, decoderTree
     else {
       newLeaf->origin = new->origin;
     }
+    attachDecoderStats(ctx, newLeaf);
 
-    verifyDecoder((isRootDecoderTree(new) ? new : new->tail), newLeaf);
+    verifyDecoder(ctx, (isRootDecoderTree(new) ? new : new->tail), newLeaf);
     *tree = newLeaf;
   }
   else {
@@ -328,76 +431,101 @@ static void addNodes (Uchar * text, Uchar sym, decoderTree_t * tree, decoderTree
   }
 }
 
-void decode (decoderTree_t tree, const Uint textlen, FILE *compressedFile, FILE *output, const BOOL useSee) {
-  Uint i, j, k, length, count, numMasked, prevCount, allCount, low, *maskedChars, state;
-  Uint zPrevLeft = 1, zPrevRight = 0;
-  Uchar sym = 0;
+void decode (context_t ctx, decoderTree_t tree, const Uint textlen, FILE *compressedFile, FILE *output, const BOOL useSee) {
+  Uint i, j, k, b, length, count, numMasked, allCount, low, pos = 0, state, pathAlloc = INITIAL_PATH;
+  Uint zPrevLeft = 1, zPrevRight = 0, maskedCount[BLOCKS(UCHAR_MAX+1)];
+  Uchar sym = 0, maskedSyms[UCHAR_MAX+1];
+  symbolMask masked;
   SYMBOL s;
-  decoderTree_t origTree, prevTree = NULL;
+  decoderTree_t prevTree = NULL;
+  decoderStats_t origTree, *path;
   BOOL found, escape;
-  Uchar * text;
+  Uchar *text;
 
-  printf("MAX_COUNT: %ld\n", MAX_COUNT);
-  MALLOC(text, Uchar, textlen);
-  CALLOC(maskedChars, Uint, alphasize);
+  VERBOSE(fprintf(ctx->messages, "MAX_COUNT: %ld\n", ctx->maxCount));
+  if (ctx->labelsLen + textlen > ctx->labelsAlloc) {
+    ctx->labelsAlloc = ctx->labelsLen + textlen;
+    REALLOC(ctx->labels, ctx->labels, Uchar, ctx->labelsAlloc);
+  }
+  ctx->labelsLen += textlen;
+  MALLOC(path, decoderStats_t, pathAlloc);
 
   if (useSee) {
-    initSee();
+    initSee(ctx);
   }
 
   for (i=0; i<textlen; i++) {
-    origTree = tree->origin;
+    origTree = tree->origin->stats;
     numMasked = 0;
+    CLEARMASK(masked);
     DEBUGCODE(printf("index: %ld\n", i));
-    /*DEBUGCODE(printf("orig: "); printStats(tree, maskedChars));*/
+    /*DEBUGCODE(printf("orig: "); printStats(ctx, tree, maskedChars));*/
 
-    if (origTree->totalCount > MAX_COUNT && origTree->used) {
-      rescale (origTree);
+    if (origTree->totalCount > ctx->maxCount && origTree->used) {
+      rescale (ctx, origTree);
     }
 
-    DEBUGCODE(printStats(origTree, maskedChars, i));
+    DEBUGCODE(printStats(ctx, origTree, &masked));
     length = 0;
     found = False;
     do {
       escape = False;
       if (origTree->totalSyms > numMasked && origTree->totalCount > 0) { /* found a parent with more data */
 	low = allCount = 0;
-	for (j=0; j < origTree->totalSyms; j++) {
-	  allCount += origTree->count[j];
-	  if (maskedChars[alphaindex[origTree->symbols[j]]] != i+1) {
-	    low += origTree->count[j];
+	if (origTree->totalSyms >= WIDE_NODE) {
+	  /* add the blocks and take out the counts of the masked symbols */
+	  buildBlocks(ctx, origTree);
+	  for (b=0; b < BLOCKS(origTree->totalSyms); b++) {
+	    allCount += origTree->blockCount[b];
+	    maskedCount[b] = 0;
+	  }
+	  low = allCount;
+	  for (k=0; k < numMasked; k++) {
+	    j = symbolPosition(origTree, maskedSyms[k]);
+	    if (j < origTree->totalSyms) {
+	      maskedCount[j / BLOCK_SYMS] += origTree->symbols[j].count;
+	      low -= origTree->symbols[j].count;
+	    }
+	  }
+	}
+	else {
+	  for (j=0; j < origTree->totalSyms; j++) {
+	    allCount += origTree->symbols[j].count;
+	    if (!ISMASKED(masked, origTree->symbols[j].symbol)) {
+	      low += origTree->symbols[j].count;
+	    }
 	  }
 	}
 
 	if (low > 0 && useSee) {
-	  state = getSeeStateDecoder(origTree, allCount, i, numMasked, text, alphasize);
+	  state = getSeeStateDecoder(origTree, allCount, i, numMasked, ctx->labels + DECODED(i), ctx->alphasize);
 	  if (state != -1) {
-	    /*DEBUGCODE(printf("-- state %d %d\n", See[state][0], See[state][1]));*/
-	    s.scale = See[state][1];
-	    count = get_current_count(&s);
-	    if (count < See[state][0]) { /* escape */
+	    /*DEBUGCODE(printf("-- state %d %d\n", ctx->See[state][0], ctx->See[state][1]));*/
+	    s.scale = ctx->See[state][1];
+	    count = get_current_count(&ctx->coder, &s);
+	    if (count < ctx->See[state][0]) { /* escape */
 	      s.low_count = 0;
-	      s.high_count = See[state][0];
+	      s.high_count = ctx->See[state][0];
 	      DEBUGCODE(printf("--scale: %d diff: %d symbol: %d\n", s.scale, s.high_count - s.low_count, -1));
-	      remove_symbol_from_stream(compressedFile, &s);
+	      remove_symbol_from_stream(&ctx->coder, compressedFile, &s);
 	      escape = True;
 	      
 	      for(j=0; j < origTree->totalSyms; j++) {
-		if (origTree->count[j] > 0 && maskedChars[alphaindex[origTree->symbols[j]]] != i+1) {
-		  maskedChars[alphaindex[origTree->symbols[j]]] = i+1;
-		  numMasked++;
+		if (origTree->symbols[j].count > 0 && !ISMASKED(masked, origTree->symbols[j].symbol)) {
+		  SETMASKED(masked, origTree->symbols[j].symbol);
+		  maskedSyms[numMasked++] = origTree->symbols[j].symbol;
 		}
 	      }
 	    }
 	    else {
-	      s.low_count = See[state][0];
-	      s.high_count = See[state][1];
+	      s.low_count = ctx->See[state][0];
+	      s.high_count = ctx->See[state][1];
 	      DEBUGCODE(printf("--scale: %d diff: %d symbol: %d\n", s.scale, s.high_count - s.low_count, -2));
-	      remove_symbol_from_stream(compressedFile, &s);
+	      remove_symbol_from_stream(&ctx->coder, compressedFile, &s);
 	      s.scale = low;
 	    }
 	    
-	    updateSee(state, escape, alphasize);
+	    updateSee(ctx, state, escape, ctx->alphasize);
 	  }
 	  else {
 	    s.scale = low + origTree->totalCount - allCount; /* low + escapes */
@@ -408,123 +536,145 @@ void decode (decoderTree_t tree, const Uint textlen, FILE *compressedFile, FILE
 	}
 	
 	if (!escape) {
-	  count = get_current_count(&s);
+	  count = get_current_count(&ctx->coder, &s);
 	  /*DEBUGCODE(printf("scale: %d count: %d\n", s.scale, count));*/
 
-	  for (j=0; maskedChars[alphaindex[origTree->symbols[j]]] == i+1; j++);
-	  s.high_count = origTree->count[j];
-	  for (j++; (j < origTree->totalSyms) && (s.high_count <= count); j++) {
-	    if (maskedChars[alphaindex[origTree->symbols[j]]] != i+1) {
-	      s.high_count += origTree->count[j];
+	  s.high_count = 0;
+	  j = 0;
+	  if (origTree->totalSyms >= WIDE_NODE) {
+	    /* skip the blocks that end before the count */
+	    for (b=0; b < BLOCKS(origTree->totalSyms) && 
+		   s.high_count + origTree->blockCount[b] - maskedCount[b] <= count; b++) {
+	      s.high_count += origTree->blockCount[b] - maskedCount[b];
+	    }
+	    j = b * BLOCK_SYMS;
+	  }
+	  for (; (j < origTree->totalSyms) && (s.high_count <= count); j++) {
+	    if (!ISMASKED(masked, origTree->symbols[j].symbol)) {
+	      s.high_count += origTree->symbols[j].count;
 	    }
 	  }
 
-	  if ((j == origTree->totalSyms) && (s.high_count <= count)) { /* not found */
+	  if (s.high_count <= count) { /* not found */
 	    s.low_count = s.high_count;
 	    s.high_count = s.scale;
 	    DEBUGCODE(printf("--scale: %d diff: %d symbol: %d\n", s.scale, s.high_count - s.low_count, -1));
 
-	    for(j--; j != -1; j--) {
-	      if (origTree->count[j] > 0 && maskedChars[alphaindex[origTree->symbols[j]]] != i+1) {
-		maskedChars[alphaindex[origTree->symbols[j]]] = i+1;
-		numMasked++;
+	    for(j=0; j < origTree->totalSyms; j++) {
+	      if (origTree->symbols[j].count > 0 && !ISMASKED(masked, origTree->symbols[j].symbol)) {
+		SETMASKED(masked, origTree->symbols[j].symbol);
+		maskedSyms[numMasked++] = origTree->symbols[j].symbol;
 	      }
 	    }
 	  }
 	  else { /* found */
 	    found = True;
 	    j--;
-	    s.low_count = s.high_count - origTree->count[j] ;
-	    sym = origTree->symbols[j];
-	    putc(sym, output);
+	    s.low_count = s.high_count - origTree->symbols[j].count ;
+	    pos = origTree->symbols[j].symbol;
+	    sym = ctx->characters[pos];
 	    origTree->used = True;
 	    DEBUGCODE(printf("++scale: %d diff: %d symbol: %d\n", s.scale, s.high_count - s.low_count, sym));
 	    origTree->totalCount+=2;
-	    origTree->count[j]+=2;
+	    origTree->symbols[j].count+=2;
+	    k = j;
+	    if (ORDERED_SYMBOLS(ctx)) {
+	      k = promoteSymbol(origTree->symbols, j);
+	    }
+	    updateBlocks(origTree, k, j);
 	  }
-	  remove_symbol_from_stream(compressedFile, &s);
+	  remove_symbol_from_stream(&ctx->coder, compressedFile, &s);
 	}
       }
       else {
 	DEBUGCODE(printf("--escape\n"));
       }
 
-      if (isRootDecoderTree(origTree) && !found) {
+      if (!origTree->parent && !found) {
 	found = True;
-	for (j=0, count=0, prevCount=0; j<alphasize; j++) {
-	  if (maskedChars[j] != i+1) {
-	    count++;
-	  }
-	}
-	s.scale = count;
-	count = get_current_count(&s);
+	s.scale = ctx->alphasize - countMasked(&masked, ctx->alphasize);
+	count = get_current_count(&ctx->coder, &s);
 	/*DEBUGCODE(printf("scale: %d count: %d\n", s.scale, count));*/
 
-	s.high_count=0;
-	for (j=0; (j < alphasize) && (s.high_count <= count); j++) {
-	  if (maskedChars[j] != i+1) {
-	    s.high_count ++;
-	  }
-	} 
-	s.low_count = s.high_count - 1;
-	sym = characters[j-1];
-	remove_symbol_from_stream(compressedFile, &s);
-	putc(sym, output);
+	/* the symbol is the one with count symbols not masked before it */
+	s.low_count = count;
+	s.high_count = count + 1;
+	pos = selectUnmasked(&masked, ctx->alphasize, count);
+	sym = ctx->characters[pos];
+	remove_symbol_from_stream(&ctx->coder, compressedFile, &s);
 
 	origTree->totalCount += 2; /* symbol and escape */
 
-	for (k=0; (k < origTree->totalSyms) && (origTree->symbols[k] != sym); k++);
+	k = symbolPosition(origTree, pos);
 	if (k == origTree->totalSyms) {
 	  origTree->totalSyms++;	    
 	}
-	origTree->count[k] = 1;
-	origTree->symbols[k] = sym;
+	origTree->symbols[k].count = 1;
+	origTree->symbols[k].symbol = pos;
+	j = k;
+	if (ORDERED_SYMBOLS(ctx)) {
+	  j = promoteSymbol(origTree->symbols, k);
+	}
+	updateBlocks(origTree, j, k);
 
 	DEBUGCODE(printf("++scale: %d diff: %d symbol: %d\n", s.scale, s.high_count - s.low_count, sym));
       }
 
       if (!found) {
-	origTree = origTree->parent->origin;
-	length++;
+	PUSHPATH(origTree);
+	origTree = origTree->parent;
 
-	if (origTree->totalCount > MAX_COUNT && origTree->used) {
-	  rescale (origTree);
+	if (origTree->totalCount > ctx->maxCount && origTree->used) {
+	  rescale (ctx, origTree);
 	}
-	DEBUGCODE(printStats(origTree, maskedChars, i));
+	DEBUGCODE(printStats(ctx, origTree, &masked));
 
 	/* search for a parent with more information */
-	while (!isRootDecoderTree(origTree) && origTree->totalSyms == numMasked) {
+	while (origTree->parent && origTree->totalSyms == numMasked) {
 	  DEBUGCODE(printf("--escape\n"));
-	  origTree = origTree->parent->origin;  
-	  length++;
+	  PUSHPATH(origTree);
+	  origTree = origTree->parent;  
       
-	  if (origTree->totalCount > MAX_COUNT && origTree->used) {
-	    rescale (origTree);
+	  if (origTree->totalCount > ctx->maxCount && origTree->used) {
+	    rescale (ctx, origTree);
 	  }
-	  DEBUGCODE(printStats(origTree, maskedChars, i));
+	  DEBUGCODE(printStats(ctx, origTree, &masked));
 	  DEBUGCODE(printf("--escape\n"));
 	}
       }
     }
     while (!found);
 
-    origTree = tree->origin;
     for (j=0; j<length; j++) {
+      origTree = path[j];
       origTree->totalCount += 2; /* symbol and escape */
-      for (k=0; (k < origTree->totalSyms) && (origTree->symbols[k] != sym); k++);
+      k = symbolPosition(origTree, pos);
       if (k == origTree->totalSyms) {
 	origTree->totalSyms++;	    
       }
 
-      origTree->count[k] = 1;
-      origTree->symbols[k] = sym;
-      assert(origTree->parent);
-      origTree = origTree->parent->origin;  
+      origTree->symbols[k].count = 1;
+      origTree->symbols[k].symbol = pos;
+      b = k;
+      if (ORDERED_SYMBOLS(ctx)) {
+	b = promoteSymbol(origTree->symbols, k);
+      }
+      updateBlocks(origTree, b, k);
     }
 
     DEBUGCODE(printf("\n"));
-    addNodes(text, sym, &tree, &prevTree, i, &zPrevLeft, &zPrevRight);
+    addNodes(ctx, sym, &tree, &prevTree, i, &zPrevLeft, &zPrevRight);
   } /* for */
-  FREE(maskedChars);
-  FREE(text);
+
+  /* the decoded part is kept in the label buffer so it is written at once */
+  text = ctx->labels + ctx->labelsLen - textlen;
+  for (i=0; i<textlen/2; i++) {
+    sym = text[i];
+    text[i] = text[textlen - 1 - i];
+    text[textlen - 1 - i] = sym;
+  }
+  if (fwrite(text, 1, textlen, output) != textlen) {
+    failure(CTX_ERR_IO, "Could not write output");
+  }
+  FREE(path);
 }
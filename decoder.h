@@ -22,9 +22,9 @@
 #include "decoderTree.h"
 
 /** Decodes the compressed file data to the output file (for non-binary alphabet). */
-void decode (decoderTree_t, const Uint textlen, FILE *compressed_file, FILE *output, const BOOL useSee);
+void decode (context_t, decoderTree_t, const Uint textlen, FILE *compressed_file, FILE *output, const BOOL useSee);
 
 /** Decodes the compressed file data to the output file (for binary alphabet). */
-void decodeBin (decoderTree_t, const Uint textlen, FILE *compressed_file, FILE *output);
+void decodeBin (context_t, decoderTree_t, const Uint textlen, FILE *compressed_file, FILE *output);
 
 #endif
@@ -19,8 +19,11 @@
 #include <assert.h>
 #include "spacedef.h"
 #include "debug.h"
+#include "failure.h"
+#include "libcontext.h"
 #include "decoderTree.h"
 #include "alpha.h"
+#include "symbols.h"
 #include "arithmetic/coder.h"
 #include "arithmetic/bitio.h"
 #ifndef WIN32
@@ -33,27 +36,40 @@
 #define obstack_chunk_alloc malloc
 #define obstack_chunk_free free
 
-/** Number of internal nodes in the tree. Equals the number of ones in the natural code file. */
-static Ushort internalNodes;
-
-/** Total number of nodes in the tree. */
-static Uint totalNodes;
+static void  updateChildrenTransitions(context_t ctx, decoderTree_t node, Uint cidx, decoderTree_t origTrans, decoderTree_t newTrans) {
+  Uint i;
 
-#ifndef WIN32
-static struct obstack nodeStack;
-#endif
+  for (i=0; i<node->children.size; i++) {
+    if (getDecoderTransition(DECCHILDAT(node, i), cidx) == origTrans) {
+      setChild(&DECCHILDAT(node, i)->transitions, cidx, newTrans);
+    }
+    updateChildrenTransitions(ctx, DECCHILDAT(node, i), cidx, origTrans, newTrans);
+  }
+}
 
-static void  updateChildrenTransitions(decoderTree_t node, Uint cidx, decoderTree_t origTrans, decoderTree_t newTrans) {
+/**
+ * Sets a transition of a state. While decoding the nodes keep the transitions they had when
+ * they were added, so the children of the state that inherit the transition get a copy of
+ * its previous value first.
+ * @param[in,out] tree the state.
+ * @param[in] sym alphabet index of the symbol.
+ * @param[in] next the next state after the symbol.
+ * @param[in] decoder flag to indicate it is called from the decoder routine.
+ */
+static void setTransition(decoderTree_t tree, const Uint sym, decoderTree_t next, BOOL decoder) {
+  decoderTree_t prev, child;
   Uint i;
 
-  for (i=0; i<alphasize; i++) {
-    if (node->children[i]) {
-      if (node->children[i]->transitions[cidx] == origTrans) {
-	node->children[i]->transitions[cidx] = newTrans;
+  if (decoder) {
+    prev = getDecoderTransition(tree, sym);
+    for (i=0; i<tree->children.size; i++) {
+      child = DECCHILDAT(tree, i);
+      if (!HASCHILD(child->transitions, sym)) {
+	setChild(&child->transitions, sym, prev);
       }
-      updateChildrenTransitions(node->children[i], cidx, origTrans, newTrans);
     }
   }
+  setChild(&tree->transitions, sym, next);
 }
 
 /** 
@@ -70,7 +86,7 @@ static void  updateChildrenTransitions(decoderTree_t node, Uint cidx, decoderTre
  * @param[out] vLeft index of the leftmost character of the remaining part of the string (after <i>ru</i>).
  * @param[out] vRight index of the rightmost character of the remaining part of the string (after <i>ru</i>).
  */
-static void fastCanonize(decoderTree_t tree, Uint xLeft, Uint xRight, decoderTree_t node, decoderTree_t *r, Uint *uLeft, Uint *uRight, Uint *vLeft, Uint *vRight) {
+static void fastCanonize(context_t ctx, decoderTree_t tree, Uint xLeft, Uint xRight, decoderTree_t node, decoderTree_t *r, Uint *uLeft, Uint *uRight, Uint *vLeft, Uint *vRight) {
   BOOL end;
   decoderTree_t child = NULL;
 
@@ -83,7 +99,7 @@ static void fastCanonize(decoderTree_t tree, Uint xLeft, Uint xRight, decoderTre
   end = xLeft > xRight;
 
   while (!end) {
-    child = tree->children[GETINDEX2(xLeft)];
+    child = DECCHILD(tree, GETINDEX2(xLeft));
     if ((child->right - child->left) <= (xRight - xLeft)) {
       xLeft += child->right - child->left + 1;
       tree = child;
@@ -119,7 +135,7 @@ static void fastCanonize(decoderTree_t tree, Uint xLeft, Uint xRight, decoderTre
  * @param[out] vLeft index of the leftmost character of the remaining part of the string (after <i>ru</i>).
  * @param[out] vRight index of the rightmost character of the remaining part of the string (after <i>ru</i>).
  */
-static void canonize(decoderTree_t tree, Uint xLeft, Uint xRight, decoderTree_t node, decoderTree_t *r, Uint *uLeft, Uint *uRight, Uint *vLeft, Uint *vRight) {
+static void canonize(context_t ctx, decoderTree_t tree, Uint xLeft, Uint xRight, decoderTree_t node, decoderTree_t *r, Uint *uLeft, Uint *uRight, Uint *vLeft, Uint *vRight) {
   decoderTree_t child;
   BOOL end = False;
   Uint i, xLeftStart;
@@ -135,10 +151,10 @@ static void canonize(decoderTree_t tree, Uint xLeft, Uint xRight, decoderTree_t
   }
   
   while (!end) {
-    child = tree->children[GETINDEX2(xLeft)];
+    child = DECCHILD(tree, GETINDEX2(xLeft));
     if (child) { /* there is an edge in the direction of xLeft */
       xLeftStart = xLeft;
-      for (i=child->left; (i<=child->right) && (xLeft<=xRight) && ((*child->text)[i] == (*node->text)[xLeft]); i++, xLeft++); 
+      for (i=child->left; (i<=child->right) && (xLeft<=xRight) && (DECLABEL(child, i) == DECLABEL(node, xLeft)); i++, xLeft++); 
       if (i > child->right) { /* all the edge is in x */
 	tree = child;
 	if (xLeft > xRight) {
@@ -167,7 +183,9 @@ static void canonize(decoderTree_t tree, Uint xLeft, Uint xRight, decoderTree_t
 
 
 /**
- * Inserts a new node in the FSM closure of the tree.
+ * Inserts a new node in the FSM closure of the tree. The labels of the nodes added are
+ * prefixes of the tail of the label of <i>node</i>, so they start one character after it in 
+ * the label buffer and nothing is copied.
  * @param[in] r parent of the new node to be added.
  * @param[in] node tree node with a pointer to the data string. Used by GETINDEX2.
  * @param[in] uLeft index of the leftmost character of the <i>u</i> string.
@@ -177,48 +195,26 @@ static void canonize(decoderTree_t tree, Uint xLeft, Uint xRight, decoderTree_t
  * @param[in] decoder flag to indicate insert is called from the decoder routine
  * @returns a pointer the new added node.
  */
-static decoderTree_t insert (decoderTree_t r, decoderTree_t node, Uint uLeft, Uint uRight, Uint vLeft, Uint vRight, BOOL decoder) {
-  decoderTree_t new  = initDecoderTree(False), newLeaf, ret, child;
-  BOOL leaf;
-  Uint i,j, cidx = GETINDEX2(0);
+static decoderTree_t insert (context_t ctx, decoderTree_t r, decoderTree_t node, Uint uLeft, Uint uRight, Uint vLeft, Uint vRight, BOOL decoder) {
+  decoderTree_t new  = initDecoderTree(ctx), newLeaf, ret, child;
 
   DEBUGCODE(printf("New node1: %p\n", (void *)new));
   if (uLeft > uRight) {
-    for (i=0; i<alphasize && !r->children[i]; i++);
-    leaf = i == alphasize;
-
     if (r->internal && vRight > vLeft) { /* if a non atomical node is added we have to insert the leaf of T(x) which is the parent of this node */
-      newLeaf = initDecoderTree(False);
+      newLeaf = initDecoderTree(ctx);
       DEBUGCODE(printf("New node3: %p\n", (void *)newLeaf));
       newLeaf->left = newLeaf->right = (r->right != ROOT ? r->right + 1 : 0);
       newLeaf->internal = False;
       newLeaf->internalFSM = !decoder;
-
-      if (leaf && (r->left != ROOT)) {
-	newLeaf->text = r->text;
-	REALLOC(*newLeaf->text, *newLeaf->text, Uchar, newLeaf->right + 1);
-      }
-      else {
-	MALLOC(newLeaf->text, Uchar *, 1);
-	CALLOC(*newLeaf->text,Uchar, newLeaf->right + 1);
-	if (newLeaf->left > 0) {
-	  memcpy(*newLeaf->text, *r->text, newLeaf->left); 
-	}
-      }
-      (*newLeaf->text)[newLeaf->left] = (*node->text)[vLeft];
-      r->children[GETINDEX2(vLeft)] = newLeaf;
+      newLeaf->label = node->label + 1;
+      setChild(&r->children, GETINDEX2(vLeft), newLeaf);
       newLeaf->parent = r;
       newLeaf->origin = newLeaf;
-
       if (decoder) {
-	for (i=0; i<alphasize; i++) {
-	  if (i != cidx) {
-	    newLeaf->transitions[i] = r->transitions[i];
-	  }
-	}
+	attachDecoderStats(ctx, newLeaf);
       }
+
       vLeft++;
-      leaf = True;
       r = newLeaf;
     }
  
@@ -226,23 +222,8 @@ static decoderTree_t insert (decoderTree_t r, decoderTree_t node, Uint uLeft, Ui
     new->right = new->left + vRight - vLeft;
     new->internal = False;  
     new->internalFSM = !decoder;  
-
-    if (leaf && (r->left != ROOT)) {
-      new->text = r->text;
-      REALLOC(*new->text, *new->text, Uchar, new->right + 1);
-    }
-    else {
-      MALLOC(new->text, Uchar *, 1);
-      CALLOC(*new->text,Uchar, new->right + 1);
-      /*printf("left: %d, right: %d isRoot: %d\n", new->left, new->right, isRootDecoderTree(r));*/
-      if (new->left > 0) {
-        memcpy(*new->text, *r->text, new->left); /* new->left = r->right + 1 */
-      }
-    }
-    for (i=vLeft, j=new->left; i<=vRight; i++, j++) {
-      (*new->text)[j] = (*node->text)[i];
-    }
-    r->children[GETINDEX2(vLeft)] = new;
+    new->label = node->label + 1;
+    setChild(&r->children, GETINDEX2(vLeft), new);
     new->parent = r;
 
     if (r->internal/* && decoder*/) {
@@ -251,15 +232,11 @@ static decoderTree_t insert (decoderTree_t r, decoderTree_t node, Uint uLeft, Ui
     else {
       new->origin = r->origin;
     }
-
     if (decoder) {
-      for (i=0; i<alphasize; i++) {
-	if (i != cidx) {
-	  new->transitions[i] = r->transitions[i];
-	}
-      }
+      attachDecoderStats(ctx, new);
     }
 
+
     ret = new;
   }
   else {
@@ -267,17 +244,17 @@ static decoderTree_t insert (decoderTree_t r, decoderTree_t node, Uint uLeft, Ui
     new->left = (r->right != ROOT ? r->right + 1 : 0);
     new->right = new->left + uRight - uLeft;
 
-    child = r->children[GETINDEX2(uLeft)];
+    child = DECCHILD(r, GETINDEX2(uLeft));
     new->internal = child->internal;
     new->internalFSM = !decoder || child->internalFSM;
     
-    new->children[alphaindex[(*child->text)[new->right+1]]] = child;
+    setChild(&new->children, ctx->alphaindex[DECLABEL(child, new->right+1)], child);
     child->left = new->right + 1;
     child->parent = new; 
-    new->text = child->text;
+    new->label = child->label;
 
     new->parent = r; 
-    r->children[GETINDEX2(uLeft)] = new;
+    setChild(&r->children, GETINDEX2(uLeft), new);
 
     /*if (!decoder) {
       new->origin = r->origin;
@@ -290,58 +267,36 @@ static decoderTree_t insert (decoderTree_t r, decoderTree_t node, Uint uLeft, Ui
     }
 
     if (decoder) {
-      new->totalSyms = child->totalSyms;
-      new->totalCount = 0;
-      for (i=0; i<alphasize; i++) {
-	if (i != cidx) {
-	  new->transitions[i] = r->transitions[i];
-	}
-
-	if (i < new->totalSyms) {
-	  new->count[i] = (child->count[i] == 0 ? 0 : 1);
-	  new->totalCount += new->count[i];
-	  new->symbols[i] = child->symbols[i];
-        }
-      }
-      new->totalCount *= 2; /* symbols and escapes */
+      splitDecoderStats(ctx, new, child);
     }
 
-    new->traversed[alphaindex[(*new->text)[new->right+1]]] = r->traversed[GETINDEX2(uLeft)];
+    if (TRAVERSED(r->children, GETINDEX2(uLeft))) {
+      SETTRAVERSED(new->children, ctx->alphaindex[DECLABEL(new, new->right+1)]);
+    }
 
     if (vLeft <= vRight) {
 
       /******/
       if (new->internal && vRight > vLeft) { /* if a non atomical node is added we have to insert the leaf of T(x) which is the parent of this node */
-	newLeaf = initDecoderTree(False);
+	newLeaf = initDecoderTree(ctx);
 	DEBUGCODE(printf("New node6: %p\n", (void *)newLeaf));
 	newLeaf->left = newLeaf->right = (new->right != ROOT ? new->right + 1 : 0);
 	newLeaf->internal = False;
 	newLeaf->internalFSM = !decoder;
-
-	MALLOC(newLeaf->text, Uchar *, 1);
-	CALLOC(*newLeaf->text,Uchar, newLeaf->right + 1);
-	if (newLeaf->left > 0) {
-	  memcpy(*newLeaf->text, *new->text, newLeaf->left); 
-	}
-
-	(*newLeaf->text)[newLeaf->left] = (*node->text)[vLeft];
-	new->children[GETINDEX2(vLeft)] = newLeaf;
+	newLeaf->label = node->label + 1;
+	setChild(&new->children, GETINDEX2(vLeft), newLeaf);
 	newLeaf->parent = new;
 	newLeaf->origin = newLeaf;
-
 	if (decoder) {
-	  for (i=0; i<alphasize; i++) {
-	    if (i != cidx) {
-	      newLeaf->transitions[i] = r->transitions[i];
-	    }
-	  }
+	  attachDecoderStats(ctx, newLeaf);
 	}
+
 	vLeft++;
 	new = newLeaf;
       }
       /******/
 
-      newLeaf = initDecoderTree(False);
+      newLeaf = initDecoderTree(ctx);
       DEBUGCODE(printf("New node2: %p\n", (void *)newLeaf));
       /* add */
       newLeaf->internal = False;
@@ -349,14 +304,8 @@ static decoderTree_t insert (decoderTree_t r, decoderTree_t node, Uint uLeft, Ui
       newLeaf->left = new->right + 1;
       newLeaf->right = newLeaf->left + vRight - vLeft;
       newLeaf->parent = new; 
-      new->children[GETINDEX2(vLeft)] = newLeaf;
-
-      MALLOC(newLeaf->text, Uchar *, 1);
-      CALLOC(*newLeaf->text,Uchar, newLeaf->right + 1);
-      memcpy(*newLeaf->text, *new->text, newLeaf->left);
-      for (i=vLeft, j=newLeaf->left; i<=vRight; i++, j++) {
-	(*newLeaf->text)[j] = (*node->text)[i];
-      }
+      setChild(&new->children, GETINDEX2(vLeft), newLeaf);
+      newLeaf->label = node->label + 1;
 
       if (new->internal) {
 	newLeaf->origin = newLeaf;
@@ -364,13 +313,8 @@ static decoderTree_t insert (decoderTree_t r, decoderTree_t node, Uint uLeft, Ui
       else {
 	newLeaf->origin = new->origin;
       }
-
       if (decoder) {
-	for (i=0; i<alphasize; i++) {
-	  if (i != cidx) {
-	    newLeaf->transitions[i] = new->transitions[i];
-	  }
-	}
+	attachDecoderStats(ctx, newLeaf);
       }
 
       ret = newLeaf;
@@ -391,7 +335,7 @@ static decoderTree_t insert (decoderTree_t r, decoderTree_t node, Uint uLeft, Ui
  * @param[in] fast flag to indicate that it is possible to use <i>fastCanonize</i> in this invocation of <i>verify</i>.
  * @param[in] decoder flag to indicate verify is called from the decoder routine
  */
-static void verify(const decoderTree_t root, decoderTree_t node, BOOL fast, BOOL decoder) {
+static void verify(context_t ctx, const decoderTree_t root, decoderTree_t node, BOOL fast, BOOL decoder) {
   Uint xLeft, uLeft, uRight, vLeft, vRight, i, cidx;
   decoderTree_t r, x;
 
@@ -400,21 +344,21 @@ static void verify(const decoderTree_t root, decoderTree_t node, BOOL fast, BOOL
     xLeft = 1;
     
     if (fast) {
-      fastCanonize(root, xLeft, node->right, node, &r, &uLeft, &uRight, &vLeft, &vRight);
+      fastCanonize(ctx, root, xLeft, node->right, node, &r, &uLeft, &uRight, &vLeft, &vRight);
     } 
     else {
-      canonize(root, xLeft, node->right, node, &r, &uLeft, &uRight, &vLeft, &vRight);
+      canonize(ctx, root, xLeft, node->right, node, &r, &uLeft, &uRight, &vLeft, &vRight);
     }
 
     if ((uLeft <= uRight) || (vLeft <= vRight)) {
-      x = insert(r, node, uLeft, uRight, vLeft, vRight, decoder);
+      x = insert(ctx, r, node, uLeft, uRight, vLeft, vRight, decoder);
       if (uLeft <= uRight) {
-	if (r->traversed[GETINDEX2(uLeft)]) {
-	  verify((r->left == ROOT ? r : r->tail), r->children[GETINDEX2(uLeft)], True, decoder);
+	if (TRAVERSED(r->children, GETINDEX2(uLeft))) {
+	  verify(ctx, (r->left == ROOT ? r : r->tail), DECCHILD(r, GETINDEX2(uLeft)), True, decoder);
 	}
       }
-      else if (r->traversed[GETINDEX2(vLeft)]) {
-	verify((r->left == ROOT ? r : r->tail), r->children[GETINDEX2(vLeft)], False, decoder);
+      else if (TRAVERSED(r->children, GETINDEX2(vLeft))) {
+	verify(ctx, (r->left == ROOT ? r : r->tail), DECCHILD(r, GETINDEX2(vLeft)), False, decoder);
       }
     }
     else { /* the node already exists */
@@ -423,88 +367,67 @@ static void verify(const decoderTree_t root, decoderTree_t node, BOOL fast, BOOL
     node->tail = x;
 
     /*if (decoder) {
-      updateChildrenTransitions(x, cidx, x->transitions[cidx], node);
+      updateChildrenTransitions(ctx, x, cidx, getDecoderTransition(x, cidx), node);
       }*/
-    x->transitions[cidx] = node;
+    setTransition(x, cidx, node, decoder);
   } 
   
-  for (i=0; i<alphasize; i++) {
-    if (!node->traversed[i]) {
-      node->traversed[i] = True;
-      if (node->children[i]) {
-	verify((node->left == ROOT ? node : node->tail), node->children[i], False, decoder);
-      }
-    }
+  /* traverse every edge in order, verify may add children to this node */
+  for (i=traverseNextChild(&node->children, 0, ctx->alphasize); i<ctx->alphasize; 
+       i=traverseNextChild(&node->children, i+1, ctx->alphasize)) {
+    verify(ctx, (node->left == ROOT ? node : node->tail), DECCHILD(node, i), False, decoder);
   }  
 }
 
-void verifyDecoder(const decoderTree_t root, decoderTree_t node) {
-  verify(root, node, False, True);
-}
-
-/**
- * Adds to the FSM a set of transitions originating from <i>tree</i> if thew were not defined by <i>verify</i>.
- * @param[in] transitions set of transitions.
- * @param[in] tree origin node of the transitions.
- */
-static void propagateTransitions(decoderTree_t *transitions, decoderTree_t tree) {
-  Uint i;
-
-  for (i=0; i<alphasize; i++) {
-    if (!tree->transitions[i]) {
-      tree->transitions[i] = transitions[i];
-    }
-  }
-
-  for (i=0; i<alphasize; i++) {
-    if (tree->children[i]) {
-      propagateTransitions(tree->transitions, tree->children[i]);
-    }
-  }
+void verifyDecoder(context_t ctx, const decoderTree_t root, decoderTree_t node) {
+  verify(ctx, root, node, False, True);
 }
 
 /**
  * Reads a bit from the file using an arithmetic decoder. Each bit indicates if a node of the tree is internal (True) or a leaf (False).
+ * @param[in] ctx decompression context.
+ * @param[in,out] internalNodes number of internal nodes still to be read.
+ * @param[in,out] totalNodes number of nodes still to be read.
  * @param[in] file input file pointer.
  * @returns the readed bit.
  */
-static BOOL readEncoder(FILE *file) {
+static BOOL readEncoder(context_t ctx, Uint *internalNodes, Uint *totalNodes, FILE *file) {
   SYMBOL s;
-  Uint count, totalN = totalNodes, internalN = internalNodes, shift = 0;
+  Uint count, totalN = *totalNodes, internalN = *internalNodes, shift = 0;
   BOOL internal;
   
-  if (totalNodes == internalNodes) {
+  if (*totalNodes == *internalNodes) {
     return True;
   }
-  else if (internalNodes == 0) {
+  else if (*internalNodes == 0) {
     return False;
   }
   else {
-    while ((totalN & 0xFFFFC000) != 0) { /* some of the most significative 18 bits on */
+    while (totalN > CODER_MAXIMUM_SCALE(&ctx->coder)) {
       totalN >>= 1;
       shift++;
     }
 
     if (shift > 0) {
       internalN >>= shift;
-      totalN = (internalN * alphasize) + 1;
+      totalN = (internalN * ctx->alphasize) + 1;
     }
 
     s.scale = totalN;
-    count = get_current_count(&s);
+    count = get_current_count(&ctx->coder, &s);
     internal = count < internalN;
 
     if (internal) {
       s.low_count = 0; 
       s.high_count = internalN;
-      internalNodes--;
+      (*internalNodes)--;
     }
     else {
       s.low_count = internalN;
       s.high_count = totalN;
     }
-    totalNodes--;
-    remove_symbol_from_stream(file, &s);
+    (*totalNodes)--;
+    remove_symbol_from_stream(&ctx->coder, file, &s);
 
     /* printf("low:%d high:%d scale:%d symbol:%d\n", s.low_count, s.high_count, s.scale, internal); */
     return internal;
@@ -512,19 +435,49 @@ static BOOL readEncoder(FILE *file) {
 }
 
 
+/**
+ * Appends to the label buffer the label of a node that extends the label of its parent with one
+ * character. If the label of the parent is the last one stored only the new character is added.
+ * @param[in] ctx decompression context.
+ * @param[in] parent position of the label of the parent in the buffer.
+ * @param[in] length length of the label of the parent.
+ * @param[in] c character to add.
+ * @returns the position of the new label in the buffer.
+ */
+static Uint appendLabel (context_t ctx, Uint parent, Uint length, Uchar c) {
+  Uint ret = ctx->labelsLen;
+
+  if (ctx->labelsLen + length + 1 > ctx->labelsAlloc) {
+    ctx->labelsAlloc = 2 * (ctx->labelsLen + length + 1);
+    REALLOC(ctx->labels, ctx->labels, Uchar, ctx->labelsAlloc);
+  }
+  if (length > 0 && parent + length == ctx->labelsLen) {
+    ret = parent;
+  }
+  else {
+    memcpy(ctx->labels + ctx->labelsLen, ctx->labels + parent, length);
+    ctx->labelsLen += length;
+  }
+  ctx->labels[ctx->labelsLen++] = c;
+  return ret;
+}
+
 /**
  * Reads a decoder tree from its encoded representation on a file.
+ * @param[in] ctx decompression context.
+ * @param[in,out] internalNodes number of internal nodes still to be read.
+ * @param[in,out] totalNodes number of nodes still to be read.
  * @param[in] t root of the tree.
  * @param[in] file input file pointer.
  */
-static int readDecoderTreeRec (decoderTree_t t, FILE *file) {
+static int readDecoderTreeRec (context_t ctx, Uint *internalNodes, Uint *totalNodes, decoderTree_t t, FILE *file) {
   Uint i;
   int onlyChild = -1 /* no children */, childStatus;
   decoderTree_t child;
   BOOL internal;
 
-  for (i=0; i<alphasize; i++) {
-    internal = readEncoder(file);
+  for (i=0; i<ctx->alphasize; i++) {
+    internal = readEncoder(ctx, internalNodes, totalNodes, file);
     if (internal) {
       if (onlyChild == -1) {
 	onlyChild = i; /* one child */
@@ -534,37 +487,27 @@ static int readDecoderTreeRec (decoderTree_t t, FILE *file) {
       }
       /*onlyChild = -2;*/
       
-      t->children[i] = initDecoderTree(True);
-      child = t->children[i];
+      child = initDecoderTree(ctx);
+      setChild(&t->children, i, child);
       child->parent = t;
       child->internal = True;
       child->internalFSM = True;
       if (t->left == ROOT) {
 	child->left = child->right = 0;
-	MALLOC(child->text, Uchar *, 1);
-	CALLOC(*child->text, Uchar, 1);
-	(*child->text)[0] = characters[i];
+	child->label = appendLabel(ctx, 0, 0, ctx->characters[i]);
       }
       else {
 	child->left = child->right = t->left + 1;
-	/*if (i == 0) {*/
-	if (onlyChild >= 0) { /* first child */
-	  child->text = t->text;
-	  REALLOC(*child->text, *child->text, Uchar, child->left + 1);
-	}
-	else {
-	  MALLOC(child->text, Uchar *, 1);
-	  CALLOC(*child->text, Uchar, child->left + 1);
-	  memcpy(*child->text, *t->text, child->left);
-	}
-	(*child->text)[child->left] = characters[i];
+	child->label = appendLabel(ctx, t->label, child->left, ctx->characters[i]);
       }
-      childStatus = readDecoderTreeRec(child, file);
+      childStatus = readDecoderTreeRec(ctx, internalNodes, totalNodes, child, file);
       if (childStatus >= 0) { /* this child has outgoing degree = 1 */
-	child->children[childStatus]->left = child->left;
-	t->children[i] = child->children[childStatus];
-	t->children[i]->parent = t;
-	freeDecoderTree(child, child->children[childStatus]->text != child->text);
+	DECCHILDAT(child, 0)->left = child->left;
+	setChild(&t->children, i, DECCHILDAT(child, 0));
+	DECCHILDAT(child, 0)->parent = t;
+#ifdef WIN32
+	freeNode(child); /* in the obstack it is released with the tree */
+#endif
       }
     }
   }
@@ -578,7 +521,7 @@ static int readDecoderTreeRec (decoderTree_t t, FILE *file) {
  * @param[in] tree the node of the tree to print.
  * @param[in] level depth of the node.
  */
-static void printRec(const decoderTree_t tree, int level) {
+static void printRec(context_t ctx, const decoderTree_t tree, int level) {
   int i;
 
   if (level > 0) {
@@ -588,9 +531,9 @@ static void printRec(const decoderTree_t tree, int level) {
 
     printf("%ld - %ld (%p) parent: %p orig: %p\n", tree->left, tree->right, (void*)tree, (void*)tree->parent, (void*)tree->origin); 
     for (i=0; i<tree->right; i++) {
-      printf("%d-", *(*(tree->text) + i));
+      printf("%d-", DECLABEL(tree, i));
     }
-    printf("%d\n", *(*(tree->text) + tree->right));
+    printf("%d\n", DECLABEL(tree, tree->right));
 
     /*printf("  %d %d (%p)\n", tree->left, tree->right, (void*)tree);
       printf(" %d\n", **tree->text);*/
@@ -604,109 +547,205 @@ static void printRec(const decoderTree_t tree, int level) {
   }
   
   level++;
-  for (i=0; i<alphasize; i++) {
-    if (tree->children[i]) {
-      printf ("hijo %d ", i);
-      printRec(tree->children[i], level);
-    }
+  for (i=0; i<tree->children.size; i++) {
+    printf ("hijo %ld ", getChildIndex(&tree->children, i));
+    printRec(ctx, DECCHILDAT(tree, i), level);
   }
 }
 
 #endif
 
-void initDecoderTreeStack() {
-#ifndef WIN32
-  obstack_init (&nodeStack);
-  if (obstack_chunk_size (&nodeStack) < 16384) {
-    obstack_chunk_size (&nodeStack) = 16384;
-  }
-#endif
-}
-
-
 /**
+ * The nodes are allocated in the obstack of the context, so all the memory of the tree of a 
+ * part is released at once by <i>freeDecoderTree</i>.
  * @returns a new decoder tree instance. 
  */
-decoderTree_t initDecoderTree(BOOL useMalloc) {
+decoderTree_t initDecoderTree(context_t ctx) {
   decoderTree_t ret;
 
-  if (useMalloc) {
-    CALLOC(ret, struct decoderTree, 1);
-    CALLOC(ret->children, struct decoderTree *, alphasize);
-    CALLOC(ret->transitions, struct decoderTree *, alphasize);
-    CALLOC(ret->traversed, BOOL, alphasize);
-    MALLOC(ret->count, Uint, alphasize); 
-    MALLOC(ret->symbols, Uchar, alphasize);
-  }
-  else {
 #ifndef WIN32
-    ret = (decoderTree_t)obstack_alloc(&nodeStack, sizeof(struct decoderTree));
-    memset(ret, 0, sizeof(struct decoderTree));
+  ret = (decoderTree_t)obstack_alloc(&ctx->nodeStack, sizeof(struct decoderTree));
+  memset(ret, 0, sizeof(struct decoderTree));
 
-    ret->children = (decoderTree_t *)obstack_alloc(&nodeStack, sizeof(struct decoderTree *) * alphasize);
-    memset(ret->children, 0, sizeof(struct decoderTree *) * alphasize);
+  initChildren(&ret->children, &ctx->nodeStack);
 
-    ret->transitions = (decoderTree_t *)obstack_alloc(&nodeStack, sizeof(struct decoderTree *) * alphasize);
-    memset(ret->transitions, 0, sizeof(struct decoderTree *) * alphasize);
-
-    ret->traversed = (BOOL *)obstack_alloc(&nodeStack, sizeof(BOOL) * alphasize);
-    memset(ret->traversed, 0, sizeof(BOOL) * alphasize);
-
-    ret->count = (Uint *)obstack_alloc(&nodeStack, sizeof(Uint) * alphasize);
-    ret->symbols = (Uchar *)obstack_alloc(&nodeStack, sizeof(Uchar) * alphasize);
+  initChildren(&ret->transitions, &ctx->nodeStack);
 #else
-    CALLOC(ret, struct decoderTree, 1);
-    CALLOC(ret->children, struct decoderTree *, alphasize);
-    CALLOC(ret->transitions, struct decoderTree *, alphasize);
-    CALLOC(ret->traversed, BOOL, alphasize);
-    MALLOC(ret->count, Uint, alphasize); 
-    MALLOC(ret->symbols, Uchar, alphasize);
+  CALLOC(ret, struct decoderTree, 1);
+  initChildren(&ret->children, NULL);
+  initChildren(&ret->transitions, NULL);
 #endif
-  }
 
   /* not always true but makes sense as init */
   ret->left = ROOT;
   ret->right = ROOT;
   ret->origin = ret;
-  ret->used = False;
 
   return ret;
 }
 
 
+#ifdef WIN32
+
 /**
- * @param[in,out] tree the tree to delete. 
- * @param[in] deleteText if the string pointed by this node must be deleted
+ * Deletes a single node and its statistics.
+ * @param[in,out] tree the node to delete. 
  */
-void freeDecoderTree(decoderTree_t tree, BOOL deleteText) {
-  FREE(tree->children);
-  FREE(tree->transitions);
-  FREE(tree->traversed);
-  FREE(tree->count);
-  FREE(tree->symbols);
-  if (deleteText) {
-    FREE(*(tree->text));
-    FREE(tree->text);
+static void freeNode(decoderTree_t tree) {
+  freeChildren(&tree->children);
+  freeChildren(&tree->transitions);
+  if (tree->stats) {
+    FREE(tree->stats->symbols);
+    FREE(tree->stats->blockCount);
+    FREE(tree->stats->position);
+    FREE(tree->stats);
   }
   FREE(tree);
 }
 
+#endif
 
 /**
- * @param[in] tree the tree to process.
+ * The root is the first object allocated in the obstack for a part, so freeing it 
+ * releases every node, statistic and block sum of the part and the obstack can be 
+ * reused by the next one.
+ * @param[in,out] tree root of the tree to delete. 
+ */
+void freeDecoderTree(context_t ctx, decoderTree_t tree) {
+#ifndef WIN32
+  obstack_free(&ctx->nodeStack, tree);
+#else
+  Uint i;
+
+  for (i=0; i<tree->children.size; i++) {
+    freeDecoderTree(ctx, DECCHILDAT(tree, i));
+  }
+  freeNode(tree);
+#endif
+}
+
+
+/**
+ * @returns new statistics without symbols.
+ */
+static decoderStats_t initDecoderStats(context_t ctx) {
+  decoderStats_t ret;
+
+#ifndef WIN32
+  ret = (decoderStats_t)obstack_alloc(&ctx->nodeStack, sizeof(struct decoderStats));
+  memset(ret, 0, sizeof(struct decoderStats));
+  ret->symbols = (symbolCount *)obstack_alloc(&ctx->nodeStack, sizeof(symbolCount) * ctx->alphasize);
+#else
+  CALLOC(ret, struct decoderStats, 1);
+  MALLOC(ret->symbols, symbolCount, ctx->alphasize);
+#endif
+  return ret;
+}
+
+/**
+ * The parent of the statistics is the origin of the parent of the node, so this must be 
+ * called again when a node is inserted above this one. Does nothing if the node is not
+ * the origin of its state.
+ * @param[in,out] tree node of the tree, its parent and origin must be set.
+ */
+void attachDecoderStats(context_t ctx, decoderTree_t tree) {
+  if (tree->origin != tree) {
+    return;
+  }
+  if (!tree->stats) {
+    tree->stats = initDecoderStats(ctx);
+  }
+  tree->stats->parent = (isRootDecoderTree(tree) ? NULL : tree->parent->origin->stats);
+}
+
+/**
+ * The new node gets the symbols of the lower one with a count of one, or zero if their 
+ * count was zero.
+ * @param[in,out] new node inserted as the parent of the other one, its origin must be set.
+ * @param[in,out] child node that got the new parent.
+ */
+void splitDecoderStats(context_t ctx, decoderTree_t new, decoderTree_t child) {
+  decoderStats_t from, to;
+  Uint i;
+
+  attachDecoderStats(ctx, new);
+  attachDecoderStats(ctx, child);
+  if (new->origin != new) {
+    return;
+  }
+
+  from = child->origin->stats;
+  to = new->stats;
+  to->totalSyms = from->totalSyms;
+  to->totalCount = 0;
+  for (i=0; i<to->totalSyms; i++) {
+    to->symbols[i].count = (from->symbols[i].count == 0 ? 0 : 1);
+    to->totalCount += to->symbols[i].count;
+    to->symbols[i].symbol = from->symbols[i].symbol;
+  }
+  to->totalCount *= 2; /* symbols and escapes */
+  if (ORDERED_SYMBOLS(ctx)) {
+    sortSymbols(to->symbols, to->totalSyms);
+  }
+}
+
+/**
+ * Gives statistics to the origin nodes of a tree, the ancestors first so their 
+ * statistics can be linked.
+ * @param[in,out] tree node of the tree.
  */
-void makeDecoderFsm(decoderTree_t tree) {
-  /* decoderTree_t transitions [alphasize]; */
-  decoderTree_t *transitions;
+static void attachAllStats(context_t ctx, decoderTree_t tree) {
   Uint i;
 
-  CALLOC(transitions, decoderTree_t, alphasize);
-  verify(tree, tree, False, False);
-  for (i=0; i<alphasize; i++) {
-    transitions[i] = tree; /* ROOT */
+  attachDecoderStats(ctx, tree);
+  for (i=0; i<tree->children.size; i++) {
+    attachAllStats(ctx, DECCHILDAT(tree, i));
   }
-  propagateTransitions (transitions, tree);
-  FREE(transitions);
+}
+
+/**
+ * @param[in] tree the tree to process.
+ */
+void makeDecoderFsm(context_t ctx, decoderTree_t tree) {
+  verify(ctx, tree, tree, False, False);
+  attachAllStats(ctx, tree);
+  tree->stats->used = True;
+}
+
+
+/**
+ * Reads the number of internal nodes of the tree as written by the encoder.
+ * @param[in] ctx decompression context.
+ * @param[in] file file to read the tree from.
+ * @returns the number of internal nodes.
+ */
+static Uint readNodeCount(context_t ctx, FILE *file) {
+  SYMBOL s;
+  Uint count = 0, group;
+  int shift = 0;
+
+  if (ctx->coder.bits == CODER_BITS) {
+    s.scale = MAXIMUM_SCALE;
+    count = get_current_count(&ctx->coder, &s);
+    s.low_count = count;
+    s.high_count = count + 1;
+    remove_symbol_from_stream(&ctx->coder, file, &s);
+    return count;
+  }
+
+  s.scale = 256;
+  do {
+    group = get_current_count(&ctx->coder, &s);
+    s.low_count = group;
+    s.high_count = group + 1;
+    remove_symbol_from_stream(&ctx->coder, file, &s);
+    if (shift >= (int)(sizeof(Uint) * CHAR_BIT)) {
+      failure(CTX_ERR_FORMAT, "Invalid compressed file");
+    }
+    count |= (group & 0x7F) << shift;
+    shift += 7;
+  } while (group & 0x80);
+  return count;
 }
 
 
@@ -714,29 +753,25 @@ void makeDecoderFsm(decoderTree_t tree) {
  * @param[in] file file to read the tree from.
  * @returns a new decoder tree.
  */
-decoderTree_t readDecoderTree(FILE *file) {
+decoderTree_t readDecoderTree(context_t ctx, FILE *file) {
   decoderTree_t ret;
-  SYMBOL s;
+  Uint internalNodes;
+  Uint totalNodes;
 
-  ret = initDecoderTree(True); /* ROOT */
+  ctx->labelsLen = 0; /* the labels of the trees of previous parts are no longer used */
+  ret = initDecoderTree(ctx); /* ROOT */
   ret->internal = True;
   ret->internalFSM = True;
-  ret->used = True;
-
-  s.scale = 16383;
-  internalNodes = get_current_count(&s);
-  s.low_count = internalNodes;
-  s.high_count = internalNodes + 1;
-  remove_symbol_from_stream(file, &s);
-  /* DEBUGCODE(printf("%d %d %d\n", s.scale, s.low_count, s.high_count)); */
+
+  internalNodes = readNodeCount(ctx, file);
     
-  totalNodes = (internalNodes * alphasize) + 1;
-  printf("Nodes: internal %d total %ld\n", internalNodes, totalNodes);
+  totalNodes = (internalNodes * ctx->alphasize) + 1;
+  VERBOSE(fprintf(ctx->messages, "Nodes: internal %ld total %ld\n", internalNodes, totalNodes));
 
   if (internalNodes > 0) {
     /*FIXME: nunca guardar el nodo root*/
-    readEncoder(file); /* leo el root */
-    readDecoderTreeRec(ret, file);
+    readEncoder(ctx, &internalNodes, &totalNodes, file); /* leo el root */
+    readDecoderTreeRec(ctx, &internalNodes, &totalNodes, ret, file);
   }
   else {
     ret->internalFSM = False;
@@ -755,13 +790,31 @@ BOOL isRootDecoderTree(decoderTree_t tree) {
 }
 
 
+/**
+ * Only the transitions set by <i>verify</i> are stored in each state. The others are those 
+ * of the nearest ancestor that defines them, or the root if there is none.
+ * @param[in] tree current state.
+ * @param[in] sym alphabet index of the symbol.
+ * @returns the next state.
+ */
+decoderTree_t getDecoderTransition(decoderTree_t tree, const Uint sym) {
+  while (!HASCHILD(tree->transitions, sym)) {
+    if (isRootDecoderTree(tree)) {
+      return tree;
+    }
+    tree = tree->parent;
+  }
+  return (decoderTree_t)getChild(&tree->transitions, sym);
+}
+
+
 #ifdef DEBUG
 
 /**
  * @param[in] tree tree to print.
  */
-void printDecoderTree(decoderTree_t tree) {
-  printRec(tree, 0);
+void printDecoderTree(context_t ctx, decoderTree_t tree) {
+  printRec(ctx, tree, 0);
 }
 
 #endif
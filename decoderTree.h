@@ -20,54 +20,102 @@
 #define DECODER_TREE_H
 
 #include "types.h"
+#include "context.h"
+#include "children.h"
+#include "symbols.h"
+
+/** 
+ * Statistics of a state of the decoder. Only the nodes that are the origin of their state
+ * have them, and they are kept apart from the nodes so decoding a symbol only reads 
+ * these records and not the data used to grow the tree.
+ */
+typedef struct decoderStats {
+  Uint32 totalSyms, /** < Total number of symbols occuring at this state. */
+         totalCount; /*suma de counts*/
+  struct decoderStats *parent; /**< Statistics of the origin of the parent of the node, NULL at the root. */
+  symbolCount *symbols; /**< Symbols occurring at this state with their counts. */
+  Uint *blockCount; /**< Sums of the counts of each block of symbols, only allocated for states with many symbols. */
+  Uchar *position; /**< Position of each alphabet symbol in symbols, allocated and kept up to date with the sums of the blocks. */
+  BOOL used, /**< Flag that indicates if this state has been used to decode eny symbols. */
+       blocksValid; /**< Flag that indicates if blockCount holds the sums of the current counts. */
+} *decoderStats_t;
 
 /** Decoder context tree structure. */
 typedef struct decoderTree {
   Uint left, /**< Index of the leftmost character of the label of this node. (left == length) */
-       right, /**< Index of the rightmost character of the label of this node.*/
-       *count, /**< Counts of the number of occurrences of each symbol in this state. */
-       totalSyms, /** < Total number of symbols occuring at this state. */
-       totalCount; /*suma de counts*/
+       right; /**< Index of the rightmost character of the label of this node.*/
    
   struct decoderTree *tail, /**< Pointer to the node whose label is the tail of this one. */
                      *origin, /**< Pointer to the original node this one descends from. */
-                     *parent, /**< Pointer to the parent of this node. */
-                     **children, /**< List of pointers to all the children of this node. */
-                     **transitions; /**< List of FSM transitions from this state. */
+                     *parent; /**< Pointer to the parent of this node. */
 
-  BOOL *traversed, /**< List of flags indicating an attempt was made to traverse each child edge. */
-       used, /**< Flag that indicates if this node has been used to decode eny symbols. */
-       internal, /** < Flag that indicates if this node is an internal node of T(x) */
+  decoderStats_t stats; /**< Statistics of the state if this node is its own origin, NULL otherwise. */
+
+  childSet children, /**< Children of this node and the edges traversed while building the FSM closure. */
+           transitions; /**< FSM transitions defined at this state, the others are those of the parent. */
+
+  BOOL internal, /** < Flag that indicates if this node is an internal node of T(x) */
        internalFSM; /** < Flag that indicates if this node is an internal node of the FSM closure of T(x) */
 
-  Uchar **text; /**< Pointer to the input text. */
-  Uchar *symbols; /* simbolo en cada posicion */
+  Uint label; /**< Position in the label buffer of the context of the first character of the label of this node. */
 } *decoderTree_t;
 
-void initDecoderTreeStack();
+/**
+ * Returns a character of the label of a node. The labels are stored in the label buffer of the 
+ * context, which must be in scope as <i>ctx</i>.
+ * @param[in] T the node.
+ * @param[in] I position of the character in the label, at most the right index of the node.
+ * @returns the character.
+ */
+#define DECLABEL(T,I) (ctx->labels[(T)->label + (I)])
+
+/**
+ * Returns the child of a node at an alphabet index.
+ * @param[in] T the node.
+ * @param[in] P the alphabet index.
+ * @returns the child or NULL if there is none.
+ */
+#define DECCHILD(T,P) ((decoderTree_t)getChild(&(T)->children, (P)))
+
+/**
+ * Returns the child of a node at a position of its list of children.
+ * @param[in] T the node.
+ * @param[in] K the position in the list, lower than the number of children.
+ * @returns the child.
+ */
+#define DECCHILDAT(T,K) ((decoderTree_t)(T)->children.list[K])
 
 /** Creates and initializes a new decoder tree structure instance. */
-decoderTree_t initDecoderTree(BOOL);
+decoderTree_t initDecoderTree(context_t);
 
-/** Deletes a decoder tree structure instance. */
-void freeDecoderTree(decoderTree_t, BOOL);
+/** Deletes a decoder tree with all its nodes and statistics. */
+void freeDecoderTree(context_t, decoderTree_t);
 
-/** Calculates the FSM closure of this tree. */
-void makeDecoderFsm(decoderTree_t);
+/** Calculates the FSM closure of this tree and gives statistics to its origin nodes. */
+void makeDecoderFsm(context_t, decoderTree_t);
 
 /** Creates a new decoder tree reading it from a file. */
-decoderTree_t readDecoderTree(FILE *);
+decoderTree_t readDecoderTree(context_t, FILE *);
 
 /** Indicates if the parameter node is the root of the tree */
 BOOL isRootDecoderTree(decoderTree_t);
 
+/** Returns the next state of the FSM after a symbol. */
+decoderTree_t getDecoderTransition(decoderTree_t, const Uint);
+
+/** Gives statistics to a node that is the origin of its state and links them to those of its parent. */
+void attachDecoderStats(context_t, decoderTree_t);
+
+/** Gives statistics to a node inserted above another one, copying those of the lower node. */
+void splitDecoderStats(context_t, decoderTree_t, decoderTree_t);
+
 /** Verify*, only called by the decoder routine */
-void verifyDecoder(const decoderTree_t root, decoderTree_t node);
+void verifyDecoder(context_t ctx, const decoderTree_t root, decoderTree_t node);
 
 #ifdef DEBUG
 
 /** Prints this tree data to the standard output */
-void printDecoderTree(decoderTree_t);
+void printDecoderTree(context_t, decoderTree_t);
 
 #endif
 
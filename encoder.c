@@ -23,22 +23,46 @@
 #include "encoder.h"
 #include "alpha.h"
 #include "debug.h"
-#include "text.h"
 #include "spacedef.h"
 #include "arithmetic/coder.h"
 #include "arithmetic/bitio.h"
 #include "see.h"
 #include "reset.h"
+#include "bitset.h"
+#include "symbols.h"
 
-static void printStats (fsmTree_t origTree, Uint *maskedChars, Uint i) {
+#ifdef __GNUC__
+
+/**
+ * Asks the processor to load data that will be needed soon.
+ * @param[in] P address of the data.
+ */
+#define PREFETCH(P) __builtin_prefetch(P)
+
+#else
+
+#define PREFETCH(P)
+
+#endif
+
+/**
+ * Selects the statistics of the state used to encode the current symbol.
+ * @param[in] S index of the statistics.
+ */
+#define SETORIGIN(S) (orig = (S), origTree = model->stats + orig,\
+		      symbols = MODELSYMBOLS(model, orig))
+
+static void printStats (context_t ctx, fsmModel_t model, Uint32 orig, symbolMask *masked) {
+  fsmStats *origTree = model->stats + orig;
+  symbolCount *symbols = MODELSYMBOLS(model, orig);
   int j;
 
   printf ("## ");
   for(j=0; j<origTree->totalSyms; j++) {
-    printf("count[%d] = %ld %s", origTree->symbols[j], origTree->count[j], 
-	   (maskedChars[alphaindex[origTree->symbols[j]]] == i+1 ? "(masked) " : ""));
+    printf("count[%d] = %u %s", ctx->characters[symbols[j].symbol], symbols[j].count, 
+	   (ISMASKED(*masked, symbols[j].symbol) ? "(masked) " : ""));
   }
-  printf("Total: %ld %ld (%p)\n", origTree->totalCount, origTree->totalSyms, (void *)origTree);
+  printf("Total: %u %u (%u)\n", origTree->totalCount, origTree->totalSyms, orig);
   /*printf("Total: %d %d\n", origTree->totalCount, origTree->totalSyms);*/
 
   /*if (!isRootFsmTree(origTree)) {
@@ -59,33 +83,37 @@ static void printStats (fsmTree_t origTree, Uint *maskedChars, Uint i) {
  * Remove symbols from the statistics of the ancestors of this node in case that is necessary.
  * Symbols are removed from the ancestors if they only have the same symbols as the child node
  * (including the ones indicated in deletedChars).
- * @param[in] tree node of the tree.
- * @param[in] deletedChars bit vector indicating which characters have been erased from the node statistics.
+ * @param[in] model the model.
+ * @param[in] orig statistics of the node.
+ * @param[in] deletedChars set of the characters that have been erased from the node statistics.
  */
-static void fixParents (fsmTree_t tree, BOOL *deletedChars) {
+static void fixParents (context_t ctx, fsmModel_t model, Uint32 orig, const symbolMask *deletedChars) {
   Uint i; /*, numEscapes;*/
-  fsmTree_t parTree = tree;
+  symbolCount *symbols;
+  fsmStats *parTree;
   BOOL newChars;
 
-  while (!isRootFsmTree(parTree)) {
-    parTree = parTree->parent->origin;
+  while (orig != MODEL_ROOT) {
+    orig = model->stats[orig].parent;
+    parTree = model->stats + orig;
+    symbols = MODELSYMBOLS(model, orig);
     newChars = False;
 
     for (i=0; i<parTree->totalSyms && !newChars; i++) {
-      newChars |= parTree->count[i] > 1;
+      newChars |= symbols[i].count > 1;
     }
 
     if (!newChars) { /* there are no new symbols */
-      DEBUGCODE(printf("fixing %p\n", (void *)parTree));
+      DEBUGCODE(printf("fixing %u\n", orig));
       /*numEscapes = parTree->totalCount;*/
       parTree->totalCount = 0;
       for (i=0; i<parTree->totalSyms; i++) {  
-	/*numEscapes -= parTree->count[i];*/
-	if (deletedChars[alphaindex[parTree->symbols[i]]]) {
-	  parTree->count[i] = 0;
+	/*numEscapes -= symbols[i].count;*/
+	if (ISMASKED(*deletedChars, symbols[i].symbol)) {
+	  symbols[i].count = 0;
 	}
 	else {
-	  parTree->totalCount += parTree->count[i];
+	  parTree->totalCount += symbols[i].count;
 	}
       }
 
@@ -93,38 +121,46 @@ static void fixParents (fsmTree_t tree, BOOL *deletedChars) {
       if (numEscapes == 0) numEscapes = 1;  es necesario esto? 
       parTree->totalCount += numEscapes;*/
       parTree->totalCount *= 2;
+      if (model->ordered) {
+	sortSymbols(symbols, parTree->totalSyms);
+      }
     }
     else break;
   }
 }
     
-static void rescale (fsmTree_t tree) {
-  BOOL *charFlags, needToFix = False;
+static void rescale (context_t ctx, fsmModel_t model, Uint32 orig) {
+  fsmStats *tree = model->stats + orig;
+  symbolCount *symbols = MODELSYMBOLS(model, orig);
+  symbolMask charFlags;
+  BOOL needToFix = False;
   Uint numEscapes, i;
-  DEBUGCODE(printf("rescalo %p\n", (void *)tree));
+  DEBUGCODE(printf("rescalo %u\n", orig));
 
   numEscapes = tree->totalCount; 
   tree->totalCount = 0; 
-  CALLOC(charFlags, BOOL, alphasize);    
+  CLEARMASK(charFlags);
 
   for (i=0; i<tree->totalSyms; i++) {  
-    if (tree->count[i] > 0) {
-      numEscapes -= tree->count[i];
-      tree->count[i] = tree->count[i] >> 1;
-      if (tree->count[i] == 0) {
-	charFlags[alphaindex[tree->symbols[i]]] = True;
+    if (symbols[i].count > 0) {
+      numEscapes -= symbols[i].count;
+      symbols[i].count = symbols[i].count >> 1;
+      if (symbols[i].count == 0) {
+	SETMASKED(charFlags, symbols[i].symbol);
 	needToFix = True;
       }
       else {
-	tree->totalCount += tree->count[i];
+	tree->totalCount += symbols[i].count;
       }
     }
   }
 
+  if (model->ordered) {
+    sortSymbols(symbols, tree->totalSyms);
+  }
   if (needToFix) {
-    fixParents(tree, charFlags);
+    fixParents(ctx, model, orig, &charFlags);
   }
-  FREE(charFlags)
   numEscapes = numEscapes >> 1;
   if (numEscapes == 0) numEscapes = 1; 
   tree->totalCount += numEscapes;
@@ -132,40 +168,47 @@ static void rescale (fsmTree_t tree) {
 
 
 /**
- * @param[in] tree model tree.
+ * @param[in] model model of the text.
  * @param[in] compressedFile file to output the compressed data.
  * @param[in] text text to compress.
  * @param[in] textlen length of the text to compress
  * @param[in] useSee if see will be used
  */
-void encode (fsmTree_t tree, FILE *compressedFile, const Uchar *text, const Uint textlen, const BOOL useSee) {
+void encode (context_t ctx, fsmModel_t model, FILE *compressedFile, const Uchar *text, const Uint textlen, const BOOL useSee) {
   SYMBOL s, escape;
-  Uint i, j, k, numMasked, low, pos, allCount, noMask, *maskedChars, state;
+  Uint i, j, k, numMasked, low, pos, allCount, noMask, state;
   long cost;
   BOOL found;
-  fsmTree_t origTree;
+  Uint32 tree = MODEL_ROOT, next, orig;
+  fsmStats *origTree;
+  symbolCount *symbols;
   Uchar sym;
+  symbolMask masked;
   
-  printf("MAX_COUNT: %ld\n", MAX_COUNT);
-  CALLOC(maskedChars, Uint, alphasize);
-  cost = bit_ftell_output(compressedFile);
+  VERBOSE(fprintf(ctx->messages, "MAX_COUNT: %ld\n", ctx->maxCount));
+  cost = bit_ftell_output(&ctx->coder, compressedFile);
 
   if (useSee) {
-    initSee();
+    initSee(ctx);
   }
 
   for (i=0; i<textlen; i++) { 
     sym = text[i];
-    pos = GETINDEX(i);
+    pos = ctx->alphaindex[sym];
     DEBUGCODE(printf("index: %ld\n", i));
-    origTree = tree->origin;
+    SETORIGIN(model->origin[tree]);
     numMasked = 0;
-    assert(origTree != NULL);
+    CLEARMASK(masked);
 
-    if (origTree->totalCount > MAX_COUNT && origTree->used) {
-      rescale (origTree);
+    /* the next state does not depend on the coding, load its statistics early */
+    next = nextState(model, tree, pos);
+    PREFETCH(model->stats + model->origin[next]);
+    PREFETCH(MODELSYMBOLS(model, model->origin[next]));
+
+    if (origTree->totalCount > ctx->maxCount && origTree->used) {
+      rescale (ctx, model, orig);
     }
-    DEBUGCODE(printStats(origTree, maskedChars, i));
+    DEBUGCODE(printStats(ctx, model, orig, &masked));
     found = False;
     do {
       noMask = -1;
@@ -173,15 +216,15 @@ void encode (fsmTree_t tree, FILE *compressedFile, const Uchar *text, const Uint
 	/*printf("encontre estado con mas simbolos\n");*/
 	low = j = allCount = 0;
 	do {
-	  allCount += origTree->count[j];
-	  if (maskedChars[alphaindex[origTree->symbols[j]]] != i+1) {
-	    found = (origTree->symbols[j] == sym) && (origTree->count[j] > 0);
-	    if (origTree->symbols[j] == sym && origTree->count[j] == 0) {
+	  allCount += symbols[j].count;
+	  if (!ISMASKED(masked, symbols[j].symbol)) {
+	    found = (symbols[j].symbol == pos) && (symbols[j].count > 0);
+	    if (symbols[j].symbol == pos && symbols[j].count == 0) {
 	      noMask = j;
 	    }
 
 	    if (!found) {
-	      low += origTree->count[j];
+	      low += symbols[j].count;
 	    }
 	  }
 	}
@@ -189,41 +232,44 @@ void encode (fsmTree_t tree, FILE *compressedFile, const Uchar *text, const Uint
 
 	if (found) {
 	  s.low_count = low;
-	  s.high_count = low += origTree->count[j];
+	  s.high_count = low += symbols[j].count;
 	  /* compute the new scale */
 	  for (k=j+1; k < origTree->totalSyms; k++) {
-	    allCount += origTree->count[k];
-	    if (maskedChars[alphaindex[origTree->symbols[k]]] != i+1) {
-	      low += origTree->count[k];
+	    allCount += symbols[k].count;
+	    if (!ISMASKED(masked, symbols[k].symbol)) {
+	      low += symbols[k].count;
 	    }
 	  }
 	  s.scale = low + origTree->totalCount - allCount; /* low + escapes */
 
 	  if (low > 0 && useSee) {
-	    state = getSeeStateEncoder(origTree, allCount, i, numMasked, text, alphasize);
+	    state = getSeeStateEncoder(model, orig, allCount, i, numMasked, text, ctx->alphasize);
 	    if (state != -1) {
-	      /*DEBUGCODE(printf("-- state %d %d\n", See[state][0], See[state][1]));*/
-	      escape.scale = escape.high_count = See[state][1];
-	      escape.low_count = See[state][0];
+	      /*DEBUGCODE(printf("-- state %d %d\n", ctx->See[state][0], ctx->See[state][1]));*/
+	      escape.scale = escape.high_count = ctx->See[state][1];
+	      escape.low_count = ctx->See[state][0];
 
 	      DEBUGCODE(printf("--scale: %d diff: %d symbol: %d\n", escape.scale, escape.high_count - escape.low_count, -2));
-	      encode_symbol(compressedFile, &escape);
+	      encode_symbol(&ctx->coder, compressedFile, &escape);
 	      
 	      DEBUGCODE(printf("SEE encontrado: original %f, SEE %f, resultado: %s\n", (s.high_count - s.low_count) / (double)s.scale, 
 			       (escape.high_count - escape.low_count) / (double)escape.scale * (s.high_count - s.low_count) / (double)low,
 			((escape.high_count - escape.low_count) / (double)escape.scale * (s.high_count - s.low_count) / (double)low) > 
 			       ((s.high_count - s.low_count) / (double)s.scale) ? "gana" : "pierde"));
 	      s.scale = low;
-	      updateSee(state, False, alphasize);
+	      updateSee(ctx, state, False, ctx->alphasize);
 	    }
 	  }
 
 	  /*DEBUGCODE(printf("++scale: %d high: %d low: %d symbol: %d\n", s.scale, s.high_count, s.low_count, sym));*/
 	  DEBUGCODE(printf("++scale: %d diff: %d symbol: %d\n", s.scale, s.high_count - s.low_count, sym));
 
-	  encode_symbol(compressedFile, &s);
+	  encode_symbol(&ctx->coder, compressedFile, &s);
 	  origTree->totalCount += 2;
-	  origTree->count[j] += 2; 
+	  symbols[j].count += 2; 
+	  if (model->ordered) {
+	    promoteSymbol(symbols, j);
+	  }
 	  origTree->used = True;
 	}
 	else {
@@ -231,103 +277,99 @@ void encode (fsmTree_t tree, FILE *compressedFile, const Uchar *text, const Uint
 	  s.high_count = s.scale = low + origTree->totalCount - allCount; /* low + escapes */
 
 	  if (origTree->totalCount > 0 && low > 0 && useSee) {
-	    state = getSeeStateEncoder(origTree, allCount, i, numMasked, text, alphasize);
+	    state = getSeeStateEncoder(model, orig, allCount, i, numMasked, text, ctx->alphasize);
 	    /*DEBUGCODE(printf("-- state %d\n", state));*/
 	    if (state != -1) {
-	      /*DEBUGCODE(printf("-- state %d %d\n", See[state][0], See[state][1]));*/
-	      escape.scale = See[state][1];
+	      /*DEBUGCODE(printf("-- state %d %d\n", ctx->See[state][0], ctx->See[state][1]));*/
+	      escape.scale = ctx->See[state][1];
 	      escape.low_count = 0;
-	      escape.high_count = See[state][0];
+	      escape.high_count = ctx->See[state][0];
 
 	      DEBUGCODE(printf("--scale: %d diff: %d symbol: %d\n", escape.scale, escape.high_count - escape.low_count, -1));
-	      assert(See[state][1] > 0);
-	      encode_symbol(compressedFile, &escape);
+	      assert(ctx->See[state][1] > 0);
+	      encode_symbol(&ctx->coder, compressedFile, &escape);
 
 	      DEBUGCODE(printf("SEE escape: original %f, SEE %f, resultado: %s\n", (s.high_count - s.low_count) / (double)s.scale, 
 			       escape.high_count / (double)escape.scale,
 			       (escape.high_count / (double)escape.scale) > ((s.high_count - s.low_count) / (double)s.scale) ? "gana" : "pierde"));
 	      s.scale = 0;
-	      updateSee(state, True, alphasize);
+	      updateSee(ctx, state, True, ctx->alphasize);
 	    }
 	  }
 
 	  /*if (s.scale > 0 && s.low_count > 0) {*/
 	  if (s.scale > 0) {
 	    DEBUGCODE(printf("--scale: %d diff: %d symbol: %d\n", s.scale, s.high_count - s.low_count, -1));
-	    encode_symbol(compressedFile, &s);
+	    encode_symbol(&ctx->coder, compressedFile, &s);
 	  }
 
 	  for (j--; j != -1; j--) {
-	    if (origTree->count[j] > 0 && (maskedChars[alphaindex[origTree->symbols[j]]] != i+1)) {
-	      maskedChars[alphaindex[origTree->symbols[j]]] = i+1;
+	    if (symbols[j].count > 0 && !ISMASKED(masked, symbols[j].symbol)) {
+	      SETMASKED(masked, symbols[j].symbol);
 	      numMasked++;
 	    }
 	  }
 
 	  if (noMask == -1) {
-	    addSymbol(origTree, sym);
+	    addModelSymbol(model, orig, pos);
 	  }
 	  else {
-	    origTree->count[noMask] = 1;
+	    symbols[noMask].count = 1;
+	    if (model->ordered) {
+	      promoteSymbol(symbols, noMask);
+	    }
 	    origTree->totalCount++;
 	  }
 	  origTree->totalCount++; /* escape */
 	}
       } /* if (origTree->totalSyms > numMasked) */
       else {
-	addSymbol(origTree, sym);
+	addModelSymbol(model, orig, pos);
 	origTree->totalCount++; /* escape */
 	DEBUGCODE(printf("--escape\n"));
       }
 
-      if (isRootFsmTree(origTree) && !found) {
+      if (orig == MODEL_ROOT && !found) {
 	found = True; 
-	for (j=0, allCount=0, low=0; j<alphasize; j++) {
-	  if (maskedChars[j] != i+1) {
-	    allCount++;
-	    if (j < pos) { 
-	      low++;
-	    }
-	  }
-	}
+	allCount = ctx->alphasize - countMasked(&masked, ctx->alphasize);
+	low = pos - countMasked(&masked, pos);
 	
 	/* do not reserve probability for symbols already seen */
 	s.scale = allCount;
 	s.low_count = low;
 	s.high_count = low + 1;
-	encode_symbol(compressedFile, &s);
+	encode_symbol(&ctx->coder, compressedFile, &s);
 	
 	/*DEBUGCODE(printf("++scale: %d high: %d low: %d symbol: %d\n", s.scale, s.high_count, s.low_count, sym));*/
 	DEBUGCODE(printf("++scale: %d diff: %d symbol: %d\n", s.scale, s.high_count - s.low_count, sym));
       }
 
       if (!found) {
-	origTree = origTree->parent->origin;
+	SETORIGIN(origTree->parent);
 	  
-	if (origTree->totalCount > MAX_COUNT && origTree->used) {
-	  rescale (origTree);
+	if (origTree->totalCount > ctx->maxCount && origTree->used) {
+	  rescale (ctx, model, orig);
 	}
-	DEBUGCODE(printStats(origTree, maskedChars, i));
+	DEBUGCODE(printStats(ctx, model, orig, &masked));
 
 	/* search for a parent with more information */
-	while (!isRootFsmTree(origTree) && origTree->totalSyms == numMasked) {
-	  addSymbol(origTree, sym);
+	while (orig != MODEL_ROOT && origTree->totalSyms == numMasked) {
+	  addModelSymbol(model, orig, pos);
 	  origTree->totalCount++; /* escape */
 
 	  DEBUGCODE(printf("--escape\n"));
-	  origTree = origTree->parent->origin;  
+	  SETORIGIN(origTree->parent);
 
-	  if (origTree->totalCount > MAX_COUNT && origTree->used) {
-	    rescale (origTree);
+	  if (origTree->totalCount > ctx->maxCount && origTree->used) {
+	    rescale (ctx, model, orig);
 	  }
-	  DEBUGCODE(printStats(origTree, maskedChars, i));
+	  DEBUGCODE(printStats(ctx, model, orig, &masked));
 	  DEBUGCODE(printf("--escape\n"));
 	}
       }
     }
     while (!found);
     DEBUGCODE(printf("\n"));
-    tree = tree->transitions[pos];
+    tree = next;
   }
-  FREE(maskedChars);
 }
@@ -0,0 +1,99 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#include <setjmp.h>
+#ifndef WIN32
+#include <obstack.h>
+#endif
+#include "failure.h"
+#include "spacedef.h"
+#include "libcontext.h"
+
+/** Return point of the innermost library call running in this thread. */
+static THREAD_LOCAL jmp_buf *failureTarget = NULL;
+
+/** Error code of the last failure of this thread. */
+static THREAD_LOCAL int failureError = CTX_OK;
+
+/**
+ * @param[in] error the error code.
+ * @param[in] message description of the error, used only outside library calls.
+ */
+void failure(int error, char *message) {
+  if (failureTarget != NULL) {
+    failureError = error;
+    longjmp(*failureTarget, 1);
+  }
+  fprintf(stderr, "%s\n", message);
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * @param[in] file source file of the failed allocation.
+ * @param[in] line source line of the failed allocation.
+ * @param[in] function name of the allocation function.
+ * @param[in] size requested size in bytes.
+ */
+void allocationFailed(char *file, Uint line, char *function, Uint size) {
+  if (failureTarget != NULL) {
+    failureError = CTX_ERR_MEMORY;
+    longjmp(*failureTarget, 1);
+  }
+  fprintf(stderr,"file %s, line %lu: %s(%lu) failed\n", file, (Showuint) line, 
+	  function, (Showuint) size);
+  exit(EXIT_FAILURE);
+}
+
+#ifndef WIN32
+
+/**
+ * Called by the obstack functions when they can not allocate a new chunk.
+ */
+static void obstackFailed() {
+  failure(CTX_ERR_MEMORY, "obstack allocation failed");
+}
+
+#endif
+
+/**
+ * Tasks can be nested, a failure returns from the innermost one. The memory owned 
+ * by the task is not released, the caller must keep track of it in the task data.
+ * @param[in] task function to run, it returns CTX_OK or an error code.
+ * @param[in] data argument passed to the task.
+ * @returns the value returned by the task or the code of the error that aborted it.
+ */
+int runProtected(int (*task)(void *), void *data) {
+  jmp_buf target, *previous = failureTarget;
+  int status;
+
+#ifndef WIN32
+  /* set only once, so nested calls in other threads just read it */
+  if (obstack_alloc_failed_handler != obstackFailed) {
+    obstack_alloc_failed_handler = obstackFailed;
+  }
+#endif
+  if (setjmp(target) == 0) {
+    failureTarget = &target;
+    status = task(data);
+  }
+  else {
+    status = failureError;
+  }
+  failureTarget = previous;
+  return status;
+}
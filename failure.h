@@ -0,0 +1,33 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#ifndef FAILURE_H
+#define FAILURE_H
+
+#include "types.h"
+
+/** 
+ * Aborts the current library call returning the given error code to its caller. 
+ * If no library call is running the message is printed and the program exits.
+ */
+void failure(int error, char *message);
+
+/** Runs a task so that any failure inside it returns an error code instead of exiting. */
+int runProtected(int (*task)(void *), void *data);
+
+#endif
@@ -0,0 +1,179 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#include "fsmModel.h"
+#include "spacedef.h"
+#include "failure.h"
+#include "libcontext.h"
+
+/**
+ * Numbers the states of a tree in preorder and counts its origins and transitions.
+ * @param[in] tree node of the tree.
+ * @param[in,out] model model with the number of states, origins and transitions so far.
+ * @param[in,out] transitions number of transitions so far.
+ */
+static void countStates(fsmTree_t tree, fsmModel_t model, Uint *transitions) {
+  Uint i;
+
+  tree->index = model->states++;
+  if (tree->origin == tree) {
+    model->origins++;
+  }
+  *transitions += tree->transitions.size;
+  for (i=0; i<tree->children.size; i++) {
+    countStates(FSMCHILDAT(tree, i), model, transitions);
+  }
+}
+
+/**
+ * Copies a tree into the arrays of the model. The origin of a node is always the node 
+ * itself or one of its ancestors, so its statistics have already been numbered.
+ * @param[in] tree node of the tree.
+ * @param[in,out] model the model.
+ * @param[in,out] transitions number of transitions copied so far.
+ */
+static void fillModel(const fsmTree_t tree, fsmModel_t model, Uint *transitions) {
+  Uint i, state = tree->index;
+  Uint32 stats;
+  fsmStats *s;
+
+  model->parent[state] = (Uint32)(isRootFsmTree(tree) ? MODEL_ROOT : tree->parent->index);
+  if (tree->origin == tree) {
+    stats = (Uint32)model->origins++;
+    s = model->stats + stats;
+    s->used = tree->used;
+    s->parent = (isRootFsmTree(tree) ? MODEL_ROOT : model->origin[tree->parent->origin->index]);
+    model->origin[state] = stats;
+  }
+  else {
+    model->origin[state] = model->origin[tree->origin->index];
+  }
+
+  model->firstTransition[state] = (Uint32)*transitions;
+  for (i=0; i<tree->transitions.size; i++, (*transitions)++) {
+    model->symbol[*transitions] = (Uchar)getChildIndex(&tree->transitions, i);
+    model->next[*transitions] = (Uint32)((fsmTree_t)tree->transitions.list[i])->index;
+  }
+
+  for (i=0; i<tree->children.size; i++) {
+    fillModel(FSMCHILDAT(tree, i), model, transitions);
+  }
+}
+
+/**
+ * @returns a new model without states.
+ */
+fsmModel_t initFsmModel(void) {
+  fsmModel_t model;
+
+  CALLOC(model, struct fsmModel, 1);
+  return model;
+}
+
+/**
+ * The statistics of the states start empty, the arrays for their symbols are allocated 
+ * by <i>initModelStatistics</i> so the tree can be released first.
+ * @param[in] tree root of the tree, its FSM closure must have been calculated.
+ * @param[out] model an empty model.
+ */
+void flattenFsm(context_t ctx, const fsmTree_t tree, fsmModel_t model) {
+  Uint transitions = 0;
+
+  model->alphasize = ctx->alphasize;
+  model->ordered = ORDERED_SYMBOLS(ctx);
+  countStates(tree, model, &transitions);
+  if ((Uint32)model->states != model->states || (Uint32)transitions != transitions) {
+    failure(CTX_ERR_LIMIT, "Context tree too large for its model");
+  }
+
+  CALLOC(model->origin, Uint32, model->states);
+  CALLOC(model->parent, Uint32, model->states);
+  CALLOC(model->firstTransition, Uint32, model->states + 1);
+  CALLOC(model->next, Uint32, transitions + 1);
+  CALLOC(model->symbol, Uchar, transitions + 1);
+  CALLOC(model->stats, fsmStats, model->origins);
+
+  model->origins = 0;
+  transitions = 0;
+  fillModel(tree, model, &transitions);
+  model->firstTransition[model->states] = (Uint32)transitions;
+}
+
+/**
+ * @param[in,out] model the model.
+ */
+void initModelStatistics(fsmModel_t model) {
+  CALLOC(model->symbols, symbolCount, model->origins * model->alphasize);
+}
+
+/**
+ * @param[in] model the model to delete.
+ */
+void freeFsmModel(fsmModel_t model) {
+  FREE(model->origin);
+  FREE(model->parent);
+  FREE(model->firstTransition);
+  FREE(model->next);
+  FREE(model->symbol);
+  FREE(model->stats);
+  FREE(model->symbols);
+  FREE(model);
+}
+
+/**
+ * A state only stores the transitions set while building the FSM closure, the others 
+ * are those of the nearest ancestor that defines them, or the root if there is none.
+ * @param[in] model the model.
+ * @param[in] state current state.
+ * @param[in] sym alphabet index of the symbol.
+ * @returns the next state.
+ */
+Uint32 nextState(const fsmModel_t model, Uint32 state, const Uint sym) {
+  Uint32 k;
+
+  for (;;) {
+    for (k=model->firstTransition[state]; k<model->firstTransition[state+1]; k++) {
+      if (model->symbol[k] == sym) {
+	return model->next[k];
+      }
+    }
+    if (state == MODEL_ROOT) {
+      return MODEL_ROOT;
+    }
+    state = model->parent[state];
+  }
+}
+
+/**
+ * @param[in,out] model the model.
+ * @param[in] stats index of the statistics.
+ * @param[in] sym alphabet index of the new symbol.
+ */
+void addModelSymbol(fsmModel_t model, const Uint32 stats, const Uchar sym) {
+  fsmStats *s = model->stats + stats;
+
+  symbolCount *symbols = MODELSYMBOLS(model, stats);
+
+  symbols[s->totalSyms].symbol = sym;
+  symbols[s->totalSyms].count = 1;
+  if (model->ordered) {
+    promoteSymbol(symbols, s->totalSyms);
+  }
+  s->totalSyms++;
+  s->totalCount++;
+}
@@ -0,0 +1,82 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#ifndef FSM_MODEL_H
+#define FSM_MODEL_H
+
+#include "types.h"
+#include "context.h"
+#include "fsmTree.h"
+#include "symbols.h"
+
+/** Index of the root state and of its statistics. */
+#define MODEL_ROOT 0
+
+/**
+ * Returns the symbols of the statistics of a state with their counts.
+ * @param[in] M the model.
+ * @param[in] S the index of the statistics.
+ * @returns the symbols, with room for every symbol of the alphabet.
+ */
+#define MODELSYMBOLS(M,S) ((M)->symbols + (Uint)(S) * (M)->alphasize)
+
+/** Statistics of a state of the model that is the origin of other states. */
+typedef struct fsmStats {
+  Uint32 totalSyms, /**< Total number of symbols occuring at this state. */
+         totalCount, /**< Sum of the counts of the symbols and the escapes. */
+         parent; /**< Statistics of the origin of the parent of this state. */
+  BOOL used; /**< Flag that indicates if this state has been used to encode a symbol. */
+} fsmStats;
+
+/** 
+ * FSM of a context tree laid out in arrays indexed by state. States are numbered in 
+ * preorder from the root and only the origin states of the tree have statistics.
+ */
+typedef struct fsmModel {
+  Uint states, /**< Number of states. */
+       origins, /**< Number of states with statistics. */
+       alphasize; /**< Size of the alphabet. */
+  BOOL ordered; /**< If the symbols of the statistics are kept with the highest counts first. */
+  Uint32 *origin, /**< Statistics used by each state. */
+         *parent, /**< Parent of each state. */
+         *firstTransition, /**< Position of the first transition defined at each state, with an extra entry for the end. */
+         *next; /**< Next state of each transition. */
+  Uchar *symbol; /**< Alphabet index of each transition. */
+  fsmStats *stats; /**< Statistics of the origin states. */
+  symbolCount *symbols; /**< Symbols of the origin states with their counts. */
+} *fsmModel_t;
+
+/** Creates an empty model. */
+fsmModel_t initFsmModel(void);
+
+/** Lays out the FSM of a context tree in a model. */
+void flattenFsm(context_t, const fsmTree_t, fsmModel_t);
+
+/** Allocates the symbol statistics of a model. */
+void initModelStatistics(fsmModel_t);
+
+/** Deletes a model. */
+void freeFsmModel(fsmModel_t);
+
+/** Returns the next state of the model after a symbol. */
+Uint32 nextState(const fsmModel_t, Uint32, const Uint);
+
+/** Adds a new symbol to the statistics of a state. */
+void addModelSymbol(fsmModel_t, const Uint32, const Uchar);
+
+#endif
@@ -19,9 +19,10 @@
 #include <assert.h>
 #include "fsmTree.h"
 #include "alpha.h"
-#include "text.h"
 #include "spacedef.h"
 #include "debug.h"
+#include "failure.h"
+#include "libcontext.h"
 #include "arithmetic/coder.h"
 #include "arithmetic/bitio.h"
 
@@ -31,14 +32,8 @@
 #define obstack_chunk_alloc malloc
 #define obstack_chunk_free free
 
-/** Current position in the buffer. */
-static short pos;
-
-/** Number of internal nodes in the tree. Equals the number of ones in the natural code file. */
-static Ushort internalNodes; 
-
-/** Total number of nodes in the tree. */
-static Uint totalNodes;
+/** Minimum size of the chunks of the obstack that holds the nodes of a tree. */
+#define TREE_CHUNK_SIZE 262144
 
 /** 
  * Calculates the canonical decomposition of a string in a faster way. It is only possible to use this variant in some special cases.
@@ -53,7 +48,7 @@ static Uint totalNodes;
  * @param[out] vLeft index of the leftmost character of the remaining part of the string (after <i>ru</i>).
  * @param[out] vRight index of the rightmost character of the remaining part of the string (after <i>ru</i>).
  */
-static void fastCanonize(fsmTree_t tree, Uint xLeft, Uint xRight, fsmTree_t *r, Uint *uLeft, Uint *uRight, Uint *vLeft, Uint *vRight) {
+static void fastCanonize(context_t ctx, fsmTree_t tree, Uint xLeft, Uint xRight, fsmTree_t *r, Uint *uLeft, Uint *uRight, Uint *vLeft, Uint *vRight) {
   BOOL end;
   fsmTree_t child = NULL;
 
@@ -66,7 +61,7 @@ static void fastCanonize(fsmTree_t tree, Uint xLeft, Uint xRight, fsmTree_t *r,
   end = xLeft > xRight;
   
   while (!end) {
-    child = tree->children[GETINDEX(xLeft)];
+    child = FSMCHILD(tree, GETINDEX(xLeft));
     if ((child->right - child->left) <= (xRight - xLeft)) {
       xLeft += child->right - child->left + 1;
       tree = child;
@@ -103,7 +98,7 @@ static void fastCanonize(fsmTree_t tree, Uint xLeft, Uint xRight, fsmTree_t *r,
  * @param[out] vLeft index of the leftmost character of the remaining part of the string (after <i>ru</i>).
  * @param[out] vRight index of the rightmost character of the remaining part of the string (after <i>ru</i>).
  */
-static void canonize(fsmTree_t tree, Uint xLeft, Uint xRight, fsmTree_t *r, Uint *uLeft, Uint *uRight, Uint *vLeft, Uint *vRight) {
+static void canonize(context_t ctx, fsmTree_t tree, Uint xLeft, Uint xRight, fsmTree_t *r, Uint *uLeft, Uint *uRight, Uint *vLeft, Uint *vRight) {
   BOOL end = False;
   Uint i;
   fsmTree_t child;
@@ -118,9 +113,9 @@ static void canonize(fsmTree_t tree, Uint xLeft, Uint xRight, fsmTree_t *r, Uint
   }
 
   while (!end) {
-    child = tree->children[GETINDEX(xLeft)]; 
+    child = FSMCHILD(tree, GETINDEX(xLeft)); 
     if (child) { /* there is an edge in the direction of xLeft */
-      for (i=child->left; (i<=child->right) && (xLeft<=xRight) && (text[i]==text[xLeft]); i++, xLeft++); 
+      for (i=child->left; (i<=child->right) && (xLeft<=xRight) && (ctx->text[i]==ctx->text[xLeft]); i++, xLeft++); 
       if (i > child->right) { /* all the edge is in x */
 	tree = child;
 	if (xLeft > xRight) {
@@ -157,8 +152,8 @@ static void canonize(fsmTree_t tree, Uint xLeft, Uint xRight, fsmTree_t *r, Uint
  * @param[in] vRight index of the rightmost character of the <i>v</i> string.
  * @returns a pointer to the new added node.
  */
-static fsmTree_t insert (fsmTree_t r, Uint uLeft, Uint uRight, Uint vLeft, Uint vRight) {
-  fsmTree_t new  = initFsmTree(), newLeaf, ret;
+static fsmTree_t insert (context_t ctx, fsmTree_t r, Uint uLeft, Uint uRight, Uint vLeft, Uint vRight) {
+  fsmTree_t new  = initFsmTree(ctx, r), newLeaf, ret, child;
 
   if (uLeft > uRight) {
     /* add */
@@ -168,7 +163,7 @@ static fsmTree_t insert (fsmTree_t r, Uint uLeft, Uint uRight, Uint vLeft, Uint
       new->length = r->length + r->right - r->left + 1;
     }
     new->parent = r; 
-    r->children[GETINDEX(vLeft)] = new;
+    setChild(&r->children, GETINDEX(vLeft), new);
 
     new->origin = r->origin;
     ret = new;
@@ -177,25 +172,28 @@ static fsmTree_t insert (fsmTree_t r, Uint uLeft, Uint uRight, Uint vLeft, Uint
     /* split */
     new->left = uLeft;
     new->right = uRight;
-    new->length = r->children[GETINDEX(uLeft)]->length;
-    new->children[GETINDEX(uRight+1)] = r->children[GETINDEX(uLeft)]; /* TODO: uRight+1 == vLeft?? */
-    new->children[GETINDEX(uRight+1)]->left = uRight+1;
-    new->children[GETINDEX(uRight+1)]->length = new->length + uRight - uLeft + 1;
-    new->children[GETINDEX(uRight+1)]->parent = new; 
+    child = FSMCHILD(r, GETINDEX(uLeft));
+    new->length = child->length;
+    setChild(&new->children, GETINDEX(uRight+1), child); /* TODO: uRight+1 == vLeft?? */
+    child->left = uRight+1;
+    child->length = new->length + uRight - uLeft + 1;
+    child->parent = new; 
     new->parent = r; 
-    r->children[GETINDEX(uLeft)] = new;
+    setChild(&r->children, GETINDEX(uLeft), new);
 
     new->origin = r->origin;
-    new->traversed[GETINDEX(uRight+1)] = r->traversed[GETINDEX(uLeft)];
+    if (TRAVERSED(r->children, GETINDEX(uLeft))) {
+      SETTRAVERSED(new->children, GETINDEX(uRight+1));
+    }
 
     if (vLeft <= vRight) {
-      newLeaf = initFsmTree();
+      newLeaf = initFsmTree(ctx, r);
       /* add */
       newLeaf->left = vLeft;
       newLeaf->right = vRight;
       newLeaf->length = new->length + new->right - new->left + 1;
       newLeaf->parent = new; 
-      new->children[GETINDEX(vLeft)] = newLeaf;
+      setChild(&new->children, GETINDEX(vLeft), newLeaf);
 
       newLeaf->origin = new->origin;
       ret = newLeaf;
@@ -214,7 +212,7 @@ static fsmTree_t insert (fsmTree_t r, Uint uLeft, Uint uRight, Uint vLeft, Uint
  * @param[in] node node to verify.
  * @param[in] fast flag to indicate that it is possible to use <i>fastCanonize</i> in this invocation of <i>verify</i>.
  */
-static void verify(const fsmTree_t root, fsmTree_t node, BOOL fast) {
+static void verify(context_t ctx, const fsmTree_t root, fsmTree_t node, BOOL fast) {
   Uint xLeft, uLeft, uRight, vLeft, vRight, i, cidx;
   fsmTree_t r, x;
  
@@ -224,143 +222,122 @@ static void verify(const fsmTree_t root, fsmTree_t node, BOOL fast) {
 
     if (fast) {
       /*printf("%p - %d - %d\n", (void*)root, xLeft, node->right);*/
-      fastCanonize(root, xLeft, node->right, &r, &uLeft, &uRight, &vLeft, &vRight);
+      fastCanonize(ctx, root, xLeft, node->right, &r, &uLeft, &uRight, &vLeft, &vRight);
     } 
     else {
-      canonize(root, xLeft, node->right, &r, &uLeft, &uRight, &vLeft, &vRight);
+      canonize(ctx, root, xLeft, node->right, &r, &uLeft, &uRight, &vLeft, &vRight);
     }
 
     if ((uLeft <= uRight) || (vLeft <= vRight)) {
-      x = insert(r, uLeft, uRight, vLeft, vRight);
+      x = insert(ctx, r, uLeft, uRight, vLeft, vRight);
       if (uLeft <= uRight) {
-	if (r->traversed[GETINDEX(uLeft)]) {
-	  verify((r->left == ROOT ? r : r->tail), r->children[GETINDEX(uLeft)], True);
-	  /*verify((r->left == ROOT ? r : r->tail), r->children[GETINDEX(uLeft)], False);*/
+	if (TRAVERSED(r->children, GETINDEX(uLeft))) {
+	  verify(ctx, (r->left == ROOT ? r : r->tail), FSMCHILD(r, GETINDEX(uLeft)), True);
+	  /*verify(ctx, (r->left == ROOT ? r : r->tail), FSMCHILD(r, GETINDEX(uLeft)), False);*/
 	}
       }
-      else if (r->traversed[GETINDEX(vLeft)]) {
-	verify((r->left == ROOT ? r : r->tail), r->children[GETINDEX(vLeft)], False);
+      else if (TRAVERSED(r->children, GETINDEX(vLeft))) {
+	verify(ctx, (r->left == ROOT ? r : r->tail), FSMCHILD(r, GETINDEX(vLeft)), False);
       }
     }
     else { /* the node already exists */
       x = r;
     }
     node->tail = x;
-    x->transitions[cidx] = node;
+    setChild(&x->transitions, cidx, node);
   } 
-  for (i=0; i<alphasize; i++) {
-    if (!node->traversed[i]) {
-      node->traversed[i] = True;
-      if (node->children[i]) {
-	verify((node->left == ROOT ? node : node->tail), node->children[i], False);
-      }
-    }
+  /* traverse every edge in order, verify may add children to this node */
+  for (i=traverseNextChild(&node->children, 0, ctx->alphasize); i<ctx->alphasize; 
+       i=traverseNextChild(&node->children, i+1, ctx->alphasize)) {
+    verify(ctx, (node->left == ROOT ? node : node->tail), FSMCHILD(node, i), False);
   }  
 }
 
 
-/**
- * Adds to the FSM a set of transitions originating from tree if they were not defined by <i>verify</i>.
- * @param[in] transitions set of transitions.
- * @param[in] tree origin node of the transitions.
- */
-static void propagateTransitions(fsmTree_t *transitions, fsmTree_t tree) {
-  Uint i;
-
-  for (i=0; i<alphasize; i++) {
-    if (!tree->transitions[i]) {
-      tree->transitions[i] = transitions[i];
-    }
-  }
-
-  for (i=0; i<alphasize; i++) {
-    if (tree->children[i]) {
-      propagateTransitions(tree->transitions, tree->children[i]);
-    }
-  }
-}
-
 /**
  * Auxiliary function to write a tree node to a file using an arithmetic encoder.
+ * @param[in] ctx compression context.
+ * @param[in,out] internalNodes number of internal nodes still to be written.
+ * @param[in,out] totalNodes number of nodes still to be written.
  * @param[in] internal flag indicating if the node to write is internal or a leaf.
  * @param[in] file file where the tree is written.
  * @returns True if there is no need to write any more data to the file.
  */
-static BOOL writeEncoder(BOOL internal, FILE *file) {
+static BOOL writeEncoder(context_t ctx, Uint *internalNodes, Uint *totalNodes, BOOL internal, FILE *file) {
   SYMBOL s;
-  Uint shift = 0, totalN = totalNodes, internalN = internalNodes;
+  Uint shift = 0, totalN = *totalNodes, internalN = *internalNodes;
 
-  while ((totalN & 0xFFFFC000) != 0) { /* some of the most significative 18 bits on */
+  while (totalN > CODER_MAXIMUM_SCALE(&ctx->coder)) {
     totalN >>= 1;
     shift++;
   }
 
   if (shift > 0) {
     internalN >>= shift;
-    totalN = (internalN * alphasize) + 1;
+    totalN = (internalN * ctx->alphasize) + 1;
   }
 
   s.scale = totalN;
   if (internal) {
     s.low_count = 0;
     s.high_count = internalN;
-    internalNodes--;
+    (*internalNodes)--;
   }
   else {
     s.low_count = internalN;
     s.high_count = totalN;
   }
-  totalNodes--;
-  /* DEBUGCODE(printf("low:%d high:%d scale:%d length:%ld\n", s.low_count, s.high_count, s.scale, bit_ftell_output(file))); */
-  encode_symbol(file, &s);
+  (*totalNodes)--;
+  /* DEBUGCODE(printf("low:%d high:%d scale:%d length:%ld\n", s.low_count, s.high_count, s.scale, bit_ftell_output(&ctx->coder, file))); */
+  encode_symbol(&ctx->coder, file, &s);
 
-  return ((totalNodes == internalNodes) || internalNodes == 0);
+  return ((*totalNodes == *internalNodes) || *internalNodes == 0);
 }
 
 
 /**
  * Auxiliary recursive function to write a tree to a file using an arithemtic encoder.
+ * @param[in] ctx compression context.
+ * @param[in,out] internalNodes number of internal nodes still to be written.
+ * @param[in,out] totalNodes number of nodes still to be written.
  * @param[in] tree node to write.
  * @param[in] offset index of the node label string current being processed. 
  * This is needed in order to write a full tree. 
  * @param[in] file file where the tree is written.
  */
-static BOOL writeFsmTreeRec(const fsmTree_t tree, Uint offset, FILE *file) {
-  Uint i;
-  BOOL leaf = True, stop;
+static BOOL writeFsmTreeRec(context_t ctx, Uint *internalNodes, Uint *totalNodes, const fsmTree_t tree, Uint offset, FILE *file) {
+  Uint i, k;
+  BOOL stop;
 
   if (tree->left + offset == tree->right) {
-    for (i=0; i<alphasize && leaf; i++) {
-      leaf = !tree->children[i];
-    }
-    if (leaf) {
-      return writeEncoder(0, file);
+    if (tree->children.size == 0) {
+      return writeEncoder(ctx, internalNodes, totalNodes, 0, file);
     }
     else {
-      stop = writeEncoder(1, file);
+      stop = writeEncoder(ctx, internalNodes, totalNodes, 1, file);
       if (stop) return True;
-      for (i=0; i<alphasize; i++) {
-	if (tree->children[i]) {
-	  stop = writeFsmTreeRec(tree->children[i], 0, file);
+      for (i=0, k=0; i<ctx->alphasize; i++) {
+	if (HASCHILD(tree->children, i)) {
+	  stop = writeFsmTreeRec(ctx, internalNodes, totalNodes, FSMCHILDAT(tree, k++), 0, file);
 	  if (stop) return True;
 	}
 	else {
-	  stop = writeEncoder(0, file);
+	  stop = writeEncoder(ctx, internalNodes, totalNodes, 0, file);
 	  if (stop) return True;
 	}
       }
     }
   }
   else {
-    stop = writeEncoder(1, file);
+    stop = writeEncoder(ctx, internalNodes, totalNodes, 1, file);
     if (stop) return True;
-    for (i=0; i<alphasize; i++) {
+    for (i=0; i<ctx->alphasize; i++) {
       if (GETINDEX(tree->left + offset + 1) == i) {
-	stop = writeFsmTreeRec(tree, offset+1, file);
+	stop = writeFsmTreeRec(ctx, internalNodes, totalNodes, tree, offset+1, file);
 	if (stop) return True;
       }
       else {
-	stop = writeEncoder(0, file);
+	stop = writeEncoder(ctx, internalNodes, totalNodes, 0, file);
 	if (stop) return True;
       }
     }
@@ -376,72 +353,21 @@ static BOOL writeFsmTreeRec(const fsmTree_t tree, Uint offset, FILE *file) {
  * @param[in] offset index of the node label string current being processed. 
  * This is needed in order to simulate a full tree. 
  */
-static Ushort getInternalNodeCount (const fsmTree_t tree, const Uint offset) {
+static Uint getInternalNodeCount (context_t ctx, const fsmTree_t tree, const Uint offset) {
   Uint i, count = 0;
-  BOOL leaf = True;
 
   if (tree->left + offset == tree->right) {
-    for (i=0; i<alphasize; i++) {
-      if (tree->children[i]) {
-	count += getInternalNodeCount(tree->children[i], 0);
-	leaf = False;
-      }
+    for (i=0; i<tree->children.size; i++) {
+      count += getInternalNodeCount(ctx, FSMCHILDAT(tree, i), 0);
     }
-    if (!leaf) count ++;
+    if (tree->children.size > 0) count ++;
   }
   else {
-    count = getInternalNodeCount(tree, offset+1) + 1;
+    count = getInternalNodeCount(ctx, tree, offset+1) + 1;
   }
   return count;
 }
 
-static void copyStatisticsRec (const fsmTree_t orig, const int offsetOrig, fsmTree_t dest, const int offsetDest, const Uchar * text2) {
-  int i, posDest, posOrig;
-  BOOL end;
- 
-  posDest = dest->left + offsetDest;
-  posOrig = orig->left + offsetOrig;
-  end = False;
-  while (posOrig <= orig->right && posDest <= dest->right && !end) {
-    if (text2[posOrig] == text[posDest]) {
-      posOrig++;
-      posDest++;
-    }
-    else {
-      end = True;
-    }
-  }
-
-  if (!end) {
-    if (posDest > dest->right) { /* reached a node in dest */
-      dest->origin->totalSyms = orig->origin->totalSyms;
-      dest->origin->totalCount = orig->origin->totalCount;
-      for (i=0; i<alphasize; i++) {
-	dest->origin->symbols[i] = orig->origin->symbols[i];
-	dest->origin->count[i] = orig->origin->count[i];
-      }
-
-      if (posOrig > orig->right) { /* reached a node in orig also */
-	for (i=0; i<alphasize; i++) {
-	  if (orig->children[i] && dest->children[i]) {
-	    copyStatisticsRec(orig->children[i], 0, dest->children[i], 0, text2);
-	  }
-	}
-      }
-      else {
-	if (dest->children[GETINDEX3(posOrig)]) {
-	  copyStatisticsRec(orig, posOrig, dest->children[GETINDEX3(posOrig)], 0, text2);
-	}
-      }
-	
-    }
-    else { /* reached a node in orig */
-      if (orig->children[GETINDEX(posDest)]) 
-	copyStatisticsRec(orig->children[GETINDEX(posDest)], 0, dest, posDest, text2);
-    }
-  }
-}
-
 #ifdef DEBUG
 
 /**
@@ -449,7 +375,7 @@ static void copyStatisticsRec (const fsmTree_t orig, const int offsetOrig, fsmTr
  * @param[in] tree node of the tree to write.
  * @param[in] level depth of the node.
  */
-static void printRec(const fsmTree_t tree, int level) {
+static void printRec(context_t ctx, const fsmTree_t tree, int level) {
   int i;
 
   if (level > 0) {
@@ -457,18 +383,18 @@ static void printRec(const fsmTree_t tree, int level) {
       printf("-");
     }
 
-    /*printf("  %d - %d \n", text[tree->left], text[tree->right]);*/
-    assert (tree->right < textlen);
-    assert (tree->left < textlen);
+    /*printf("  %d - %d \n", ctx->text[tree->left], ctx->text[tree->right]);*/
+    assert (tree->right < ctx->textlen);
+    assert (tree->left < ctx->textlen);
     printf("%ld - %ld (%p) parent: %p orig: %p\n", tree->left, tree->right, (void*)tree, (void*)tree->parent, (void*)tree->origin); 
     for (i=tree->left; i< tree->right; i++) {
-      printf("%d-", *(text + i));
+      printf("%d-", *(ctx->text + i));
     }
-    if (tree->right == textlen) {
+    if (tree->right == ctx->textlen) {
       printf("$\n");
     }
     else {
-      printf("%d\n", *(text + tree->right));
+      printf("%d\n", *(ctx->text + tree->right));
     }
   }
   else {
@@ -476,49 +402,47 @@ static void printRec(const fsmTree_t tree, int level) {
   }
   
   level++;
-  for (i=0; i<alphasize; i++) {
-    if (tree->children[i]) {
-      printf ("hijo %d ", i);
-      printRec(tree->children[i], level);
-    }
+  for (i=0; i<tree->children.size; i++) {
+    printf ("hijo %ld ", getChildIndex(&tree->children, i));
+    printRec(ctx, FSMCHILDAT(tree, i), level);
   }
 }
 
 #endif
 
 /**
- * @returns a new fsm tree insance. 
+ * All the nodes of a tree and their arrays are allocated from an obstack owned by the 
+ * tree, so the whole tree is released at once by freeFsmTree.
+ * @param[in] tree a node of the tree where the new node will be added, NULL to create a new tree.
+ * @returns a new fsm tree node. 
  */
-fsmTree_t initFsmTree() {
+fsmTree_t initFsmTree(context_t ctx, const fsmTree_t tree) {
   fsmTree_t ret;
-
-  CALLOC(ret, struct fsmTree, 1);
-  memset(ret, 0, sizeof(struct fsmTree));
-
 #ifndef WIN32
-  obstack_init (&(ret->nodeStack));
-  if (obstack_chunk_size (&(ret->nodeStack)) < 16384) {
-    obstack_chunk_size (&(ret->nodeStack)) = 16384;
+  struct obstack *nodeStack;
+
+  if (tree) {
+    nodeStack = tree->nodeStack;
   }
+  else {
+    CALLOC(nodeStack, struct obstack, 1);
+    obstack_init (nodeStack);
+    if (obstack_chunk_size (nodeStack) < TREE_CHUNK_SIZE) {
+      obstack_chunk_size (nodeStack) = TREE_CHUNK_SIZE;
+    }
+  }
+
+  ret = (fsmTree_t)obstack_alloc(nodeStack, sizeof(struct fsmTree));
+  memset(ret, 0, sizeof(struct fsmTree));
+  ret->nodeStack = nodeStack;
   
-  ret->children = (fsmTree_t *)obstack_alloc(&(ret->nodeStack), sizeof(struct fsmTree *) * alphasize);
-  memset(ret->children, 0, sizeof(struct fsmTree *) * alphasize);
-  
-  ret->transitions = (fsmTree_t *)obstack_alloc(&(ret->nodeStack), sizeof(struct fsmTree *) * alphasize);
-  memset(ret->transitions, 0, sizeof(struct fsmTree *) * alphasize);
-  
-  ret->traversed = (BOOL *)obstack_alloc(&(ret->nodeStack), sizeof(BOOL) * alphasize);
-  memset(ret->traversed, 0, sizeof(BOOL) * alphasize);
+  initChildren(&ret->children, nodeStack);
   
-  ret->count = (Uint *)obstack_alloc(&(ret->nodeStack), sizeof(Uint) * alphasize);
-  ret->symbols = (Uchar *)obstack_alloc(&(ret->nodeStack), sizeof(Uchar) * alphasize);
+  initChildren(&ret->transitions, nodeStack);
 #else
   CALLOC(ret, struct fsmTree, 1);
-  CALLOC(ret->children, struct fsmTree *, alphasize);
-  CALLOC(ret->transitions, struct fsmTree *, alphasize);
-  CALLOC(ret->traversed, BOOL, alphasize);
-  MALLOC(ret->count, Uint, alphasize); 
-  MALLOC(ret->symbols, Uchar, alphasize); 
+  initChildren(&ret->children, NULL);
+  initChildren(&ret->transitions, NULL);
 #endif
 
   /* not always true but makes sense as init */
@@ -530,43 +454,64 @@ fsmTree_t initFsmTree() {
 
 
 /**
- * @param[in] tree tree to delete. 
+ * @param[in] tree root of the tree to delete. 
  */
-void freeFsmTree(fsmTree_t tree) {
+void freeFsmTree(context_t ctx, fsmTree_t tree) {
 #ifndef WIN32
-  obstack_free(&(tree->nodeStack), NULL);
+  struct obstack *nodeStack = tree->nodeStack;
+
+  obstack_free(nodeStack, NULL);
+  FREE(nodeStack);
 #else
-  FREE(tree->children);
-  FREE(tree->transitions);
-  FREE(tree->traversed);
-  FREE(tree->count);
-  FREE(tree->symbols);
+  Uint i;
+
+  for (i=0; i<tree->children.size; i++) {
+    freeFsmTree(ctx, FSMCHILDAT(tree, i));
+  }
+  freeChildren(&tree->children);
+  freeChildren(&tree->transitions);
   FREE(tree);
 #endif
 } 
 
-void addSymbol(fsmTree_t tree, const Uchar sym) {
-  tree->symbols[tree->totalSyms] = sym;
-  tree->count[tree->totalSyms] = 1;
-  tree->totalSyms++;
-  tree->totalCount++;
+/**
+ * @param[in] tree tree to process.
+ */
+void makeFsm(context_t ctx, fsmTree_t tree) {
+  tree->used = True;
+  verify(ctx, tree, tree, False);
 }
 
+
 /**
- * @param[in] tree tree to process.
+ * Writes the number of internal nodes of the tree. The 32 bit coder writes it in groups 
+ * of 7 bits, lowest first, each one coded with a flag that tells if more groups follow. 
+ * The 16 bit coder writes it as a single symbol, so it must be smaller than its maximum scale.
+ * @param[in] ctx compression context.
+ * @param[in] count number of internal nodes.
+ * @param[in] file output file to write the data.
  */
-void makeFsm(fsmTree_t tree) {
-  fsmTree_t *transitions;
-  Uint i;
+static void writeNodeCount(context_t ctx, Uint count, FILE *file) {
+  SYMBOL s;
 
-  CALLOC(transitions, fsmTree_t, alphasize);
-  tree->used = True;
-  verify(tree, tree, False);
-  for (i=0; i<alphasize; i++) {
-    transitions[i] = tree; /* ROOT */
+  if (ctx->coder.bits == CODER_BITS) {
+    if (count >= MAXIMUM_SCALE) {
+      failure(CTX_ERR_LIMIT, "Context tree too large for the 16 bit coder");
+    }
+    s.scale = MAXIMUM_SCALE;
+    s.low_count = count;
+    s.high_count = count + 1;
+    encode_symbol(&ctx->coder, file, &s);
+    return;
   }
-  propagateTransitions (transitions, tree);
-  FREE(transitions);
+
+  s.scale = 256;
+  do {
+    s.low_count = (count & 0x7F) | (count > 0x7F ? 0x80 : 0);
+    s.high_count = s.low_count + 1;
+    encode_symbol(&ctx->coder, file, &s);
+    count >>= 7;
+  } while (count > 0);
 }
 
 
@@ -574,30 +519,23 @@ void makeFsm(fsmTree_t tree) {
  * @param[in] tree tree to write.
  * @param[in] file output file to write the data.
  */
-void writeFsmTree(const fsmTree_t tree, FILE *file) {
-  Uint total, internal;
-  SYMBOL s;
+void writeFsmTree(context_t ctx, const fsmTree_t tree, FILE *file) {
+  Uint total, internal, totalNodes;
+  Uint internalNodes;
   long cost;
 
-  pos = 0;
-  
-  internalNodes = internal = getInternalNodeCount(tree, 0);
-  totalNodes = total = (internalNodes * alphasize) + 1;
+  internalNodes = internal = getInternalNodeCount(ctx, tree, 0);
+  totalNodes = total = (internalNodes * ctx->alphasize) + 1;
 
-  cost = bit_ftell_output(file);
+  cost = bit_ftell_output(&ctx->coder, file);
 
-  assert(internalNodes < 16383);
-  s.scale = 16383;
-  s.low_count = internalNodes;
-  s.high_count = internalNodes + 1;
-  encode_symbol(file, &s);
-  /* DEBUGCODE(printf("%d %d %d\n", s.scale, s.low_count, s.high_count)); */
+  writeNodeCount(ctx, internalNodes, file);
   
   if (internalNodes > 0) {
-    writeFsmTreeRec(tree, 0, file);
+    writeFsmTreeRec(ctx, &internalNodes, &totalNodes, tree, 0, file);
   }
-  printf("Representantion cost: %ld (internal: %ld, total: %ld)\n", 
-	 bit_ftell_output(file) - cost, internal, total);
+  VERBOSE(fprintf(ctx->messages, "Representantion cost: %ld (internal: %ld, total: %ld)\n", 
+		 bit_ftell_output(&ctx->coder, file) - cost, internal, total));
 }
 
 
@@ -609,32 +547,48 @@ BOOL isRootFsmTree(const fsmTree_t tree) {
   return tree->left == ROOT;
 }
 
-Uint getHeight (const fsmTree_t tree) {
-  Uint i, max = 0, h;
 
-  for (i=0; i<alphasize; i++) {
-    if (tree->children[i]) {
-      h = getHeight(tree->children[i]);
-      if (h > max) max = h;
+/**
+ * Only the transitions set by <i>verify</i> are stored in each state. The others are those 
+ * of the nearest ancestor that defines them, or the root if there is none.
+ * @param[in] tree current state.
+ * @param[in] sym alphabet index of the symbol.
+ * @returns the next state.
+ */
+fsmTree_t getTransition(fsmTree_t tree, const Uint sym) {
+  while (!HASCHILD(tree->transitions, sym)) {
+    if (isRootFsmTree(tree)) {
+      return tree;
     }
+    tree = tree->parent;
+  }
+  return (fsmTree_t)getChild(&tree->transitions, sym);
+}
+
+Uint getHeight (context_t ctx, const fsmTree_t tree) {
+  Uint i, max = 0, h;
+
+  for (i=0; i<tree->children.size; i++) {
+    h = getHeight(ctx, FSMCHILDAT(tree, i));
+    if (h > max) max = h;
   }
 
   return max + tree->right - tree->left + 1;
 }
 
-void printContext (fsmTree_t tree) {
+void printContext (context_t ctx, fsmTree_t tree) {
   int i;
   
   while (tree->left != ROOT) {
     for (i=tree->left; i< tree->right; i++) {
-      printf("%c", *(text + i));
+      printf("%c", *(ctx->text + i));
       /*printf("%d", i);*/
     }
-    if (tree->right == textlen) {
+    if (tree->right == ctx->textlen) {
       printf("$\n");
     }
     else {
-      printf("%c\n", *(text + tree->right));
+      printf("%c\n", *(ctx->text + tree->right));
       /*printf("%d\n", tree->right);*/
     }
     tree = tree->parent;
@@ -642,7 +596,7 @@ void printContext (fsmTree_t tree) {
   printf("root\n");
 }
 
-static int compareTreesRec (const fsmTree_t treeA, const fsmTree_t treeB, int level) {
+static int compareTreesRec (context_t ctx, const fsmTree_t treeA, const fsmTree_t treeB, int level) {
   int i, minLevel, actLevel;
 
   if ((treeA == NULL && treeB != NULL) || (treeA != NULL && treeB == NULL)) {
@@ -652,9 +606,9 @@ static int compareTreesRec (const fsmTree_t treeA, const fsmTree_t treeB, int le
     return -1;
   }
   else {
-    minLevel = compareTreesRec(treeA->children[0], treeB->children[0], level+1);
-    for (i=1; (i<alphasize) && (minLevel != level+1); i++) {
-      actLevel = compareTreesRec(treeA->children[i], treeB->children[i], level+1);
+    minLevel = compareTreesRec(ctx, FSMCHILD(treeA, 0), FSMCHILD(treeB, 0), level+1);
+    for (i=1; (i<ctx->alphasize) && (minLevel != level+1); i++) {
+      actLevel = compareTreesRec(ctx, FSMCHILD(treeA, i), FSMCHILD(treeB, i), level+1);
       if ((actLevel > 0) && (minLevel > actLevel)) {
 	minLevel = actLevel;
       }
@@ -664,35 +618,18 @@ static int compareTreesRec (const fsmTree_t treeA, const fsmTree_t treeB, int le
   }
 }
 
-void compareTrees (const fsmTree_t treeA, const fsmTree_t treeB) {
-  int level = compareTreesRec(treeA, treeB, 0);
+void compareTrees (context_t ctx, const fsmTree_t treeA, const fsmTree_t treeB) {
+  int level = compareTreesRec(ctx, treeA, treeB, 0);
   printf("First different level = %d\n", level);
 }
 
-void copyStatistics (const fsmTree_t orig, fsmTree_t dest, const Uchar * text2) {
-  int i;
-
-  dest->totalSyms = orig->totalSyms;
-  dest->totalCount = orig->totalCount;
-  for (i=0; i<alphasize; i++) {
-    dest->symbols[i] = orig->symbols[i];
-    dest->count[i] = orig->count[i];
-  }
-  
-  for (i=0; i<alphasize; i++) {
-    if (orig->children[i] && dest->children[i]) {
-      copyStatisticsRec(orig->children[i], 0, dest->children[i], 0, text2);
-    }
-  }
-}
-
 #ifdef DEBUG
 
 /**
  * @param[in] tree tree to print.
  */
-void printFsmTree(const fsmTree_t tree) {
-  printRec(tree, 0);
+void printFsmTree(context_t ctx, const fsmTree_t tree) {
+  printRec(ctx, tree, 0);
 }
 
 #endif
@@ -23,63 +23,74 @@
 #include <obstack.h>
 #endif
 #include "types.h"
+#include "context.h"
+#include "children.h"
 
 /** Encoder context tree structure. */
 typedef struct fsmTree {
   Uint left, /**< Index of the leftmost character of this node label in the input string. */
        right, /**< Index of the rightmost character of this node label in the input string. */
        length, /**< Distance from this node to the root of the tree. */
-       *count, /**< List containing the number of occurrences of each character in this state. */
-       totalSyms, /**< Total number of symbols occuring at this state. */
-       totalCount; /*suma de counts*/
-    /*numEscapes;*/ /*suma de escapes*/
-
-  Uchar *symbols; /* simbolo en cada posicion */
+       index; /**< Number of this node in preorder, used to lay out the FSM in a model. */
 
   struct fsmTree *tail, /**< Pointer to the node whose label is the tail of this one. */
                  *origin, /**< Pointer to the original node this one descends from. */
-                 *parent, /**< Pointer to the parent of this node. */
-                 **children, /**< List of pointers to all the children of this node. */
-                 **transitions; /**< List of FSM transitions from this state. */
+                 *parent; /**< Pointer to the parent of this node. */
+
+  childSet children, /**< Children of this node and the edges traversed while building the FSM closure. */
+           transitions; /**< FSM transitions defined at this state, the others are those of the parent. */
 
-  BOOL *traversed, /**< List of flags indicating an attempt was made to traverse each child edge. */
-       used; /**< Flag that indicates if this node has been used to encode a symbol. */
+  BOOL used; /**< Flag that indicates if this node has been used to encode a symbol. */
   
 #ifndef WIN32
-  struct obstack nodeStack; /**< Obstack used to allocate memory for this tree. */
+  struct obstack *nodeStack; /**< Obstack shared by all the nodes of the tree. */
 #endif
 } *fsmTree_t;
 
-/** Creates and initializes a new fsm tree structure instance. */
-fsmTree_t initFsmTree();
+/**
+ * Returns the child of a node at an alphabet index.
+ * @param[in] T the node.
+ * @param[in] P the alphabet index.
+ * @returns the child or NULL if there is none.
+ */
+#define FSMCHILD(T,P) ((fsmTree_t)getChild(&(T)->children, (P)))
+
+/**
+ * Returns the child of a node at a position of its list of children.
+ * @param[in] T the node.
+ * @param[in] K the position in the list, lower than the number of children.
+ * @returns the child.
+ */
+#define FSMCHILDAT(T,K) ((fsmTree_t)(T)->children.list[K])
 
-/** Deletes a fsm tree structure instance. */
-void freeFsmTree(fsmTree_t);
+/** Creates and initializes a new fsm tree node, either the root of a new tree or a node of an existing one. */
+fsmTree_t initFsmTree(context_t, const fsmTree_t);
 
-/** Adds a new symbol to this tree node */
-void addSymbol(fsmTree_t, const Uchar);
+/** Deletes a fsm tree with all its nodes. */
+void freeFsmTree(context_t, fsmTree_t);
 
 /** Calculates the FSM closure of this tree. */
-void makeFsm(fsmTree_t);
+void makeFsm(context_t, fsmTree_t);
 
 /** Writes this tree into a file. */
-void writeFsmTree(const fsmTree_t, FILE *);
+void writeFsmTree(context_t, const fsmTree_t, FILE *);
 
 /** Indicates if the parameter node is the root of the tree */
 BOOL isRootFsmTree(const fsmTree_t);
 
-Uint getHeight (const fsmTree_t);
+/** Returns the next state of the FSM after a symbol. */
+fsmTree_t getTransition(fsmTree_t, const Uint);
 
-void printContext (fsmTree_t);
+Uint getHeight (context_t, const fsmTree_t);
 
-void compareTrees (const fsmTree_t, const fsmTree_t);
+void printContext (context_t, fsmTree_t);
 
-void copyStatistics (const fsmTree_t orig, fsmTree_t dest, const Uchar * text2);
+void compareTrees (context_t, const fsmTree_t, const fsmTree_t);
 
 #ifdef DEBUG
 
 /** Prints this tree data to the standard output */
-void printFsmTree(const fsmTree_t);
+void printFsmTree(context_t, const fsmTree_t);
 
 #endif 
 
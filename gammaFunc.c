@@ -22,24 +22,16 @@
 #include "reset.h"
 #include <math.h> /* for log */
 
-#ifdef DEBUG
-
-/** Number of gamma function evaluations resolved by table lookup. */
-static int gammaHits=0;
-
-/** Number of gamma function evaluations calculated explicitly. */
-static int gammaMisses=0;
-
-#endif
-
 /** Ln of PI/2 */
 #define LNPI_2 M_LNPI / 2
 
-/** Log2 of the alphabet size. */
-static double alphasizeLog = 0;
+#ifdef DEBUG
+/** Number of gamma function evaluations resolved by table lookup in this thread. */
+static THREAD_LOCAL int gammaHits = 0;
 
-/** Binary entropy of 1/alphasize. */
-static double alphaEntropy = 0;
+/** Number of gamma function evaluations calculated explicitly in this thread. */
+static THREAD_LOCAL int gammaMisses = 0;
+#endif
 
 
 /**
@@ -65,7 +57,7 @@ static double lnFactorial (int n, double offset) {
  * @param[in] n the argument.
  * @returns Ln (gamma(n)).
  */
-static double evalLogGamma(int n)
+static double evalLogGamma(context_t ctx, int n)
 {
   int index = n-2;
 
@@ -89,7 +81,7 @@ static double evalLogGamma(int n)
  * @param[in] n the argument.
  * @returns Ln (gamma(n + 1/2)).
  */
-static double evalLogGamma2(int n)
+static double evalLogGamma2(context_t ctx, int n)
 {
   int index = n-1;
 
@@ -112,24 +104,24 @@ static double evalLogGamma2(int n)
  * @param[in] stats The statistics needed to calculate the probability assignment.
  * @returns KT probability assignment.
  */
-double kt (statistics_t stats) {
-  Uint i, ns = 0, alpha_2 = alphasize / 2; /* integer division */
+double kt (context_t ctx, statistics_t stats) {
+  Uint i, ns = 0, alpha_2 = ctx->alphasize / 2; /* integer division */
   double sum = 0, gamma1, gamma2, gamma3;
   
-  for(i=0; i<alphasize; i++) {
-    sum += evalLogGamma2(stats->count[i]); 
+  for(i=0; i<ctx->alphasize; i++) {
+    sum += evalLogGamma2(ctx, stats->count[i]); 
     ns += stats->count[i];
   }
 
-  if (alphasize % 2 == 0) {
-    gamma1 = evalLogGamma(ns + alpha_2);
+  if (ctx->alphasize % 2 == 0) {
+    gamma1 = evalLogGamma(ctx, ns + alpha_2);
     gamma2 = alpha_2 * M_LNPI;
-    gamma3 = evalLogGamma(alpha_2);
+    gamma3 = evalLogGamma(ctx, alpha_2);
   }
   else {
-    gamma1 = evalLogGamma2(ns + alpha_2);
+    gamma1 = evalLogGamma2(ctx, ns + alpha_2);
     gamma2 = (alpha_2 + 0.5) * M_LNPI;
-    gamma3 = evalLogGamma2(alpha_2);
+    gamma3 = evalLogGamma2(ctx, alpha_2);
   }
 
   return (gamma1 + gamma2 - gamma3 - sum) / M_LN2;
@@ -139,7 +131,7 @@ double kt (statistics_t stats) {
  * @param[in] stats The statistics needed to calculate the probability assignment.
  * @returns KT probability assignment.
  */
-double nodeCost (statistics_t stats) {
+double nodeCost (context_t ctx, statistics_t stats) {
   Uint ns = 0, i;
   double sum = 0;
   double loghalf = -0.6931471805599452862;
@@ -148,31 +140,31 @@ double nodeCost (statistics_t stats) {
   for (i=0; i<stats->symbolCount; i++) {
     ns += stats->count[stats->symbols[i]];
     if (stats->count[stats->symbols[i]] > 0) {
-      sum += evalLogGamma2(stats->count[stats->symbols[i]]-1);
+      sum += evalLogGamma2(ctx, stats->count[stats->symbols[i]]-1);
     }
   }
-  x = (evalLogGamma(ns) - ((stats->symbolCount - 1) * loghalf) - evalLogGamma(stats->symbolCount) - sum + (stats->symbolCount * 0.5 * M_LNPI)) / M_LN2;
+  x = (evalLogGamma(ctx, ns) - ((stats->symbolCount - 1) * loghalf) - evalLogGamma(ctx, stats->symbolCount) - sum + (stats->symbolCount * 0.5 * M_LNPI)) / M_LN2;
   return x;
 }
 
-double deckard (statistics_t stats) {
+double deckard (context_t ctx, statistics_t stats) {
   Uint i;
   double ns = 0;
   double sum = 0;
   double loghalf = -0.6931471805599452862;
   double x, sumTmp;
-  double MAX_COUNT_D = MAX_COUNT;
+  double MAX_COUNT_D = ctx->maxCount;
 
   for (i=0; i<stats->symbolCount; i++) {
     ns += stats->count[stats->symbols[i]];
     if (stats->count[stats->symbols[i]] > 0) {
-      sumTmp = evalLogGamma(MAX_COUNT+2) + (MAX_COUNT_D / 2) + (evalLogGamma(MAX_COUNT+1) / 2);
+      sumTmp = evalLogGamma(ctx, ctx->maxCount+2) + (MAX_COUNT_D / 2) + (evalLogGamma(ctx, ctx->maxCount+1) / 2);
       sum += stats->count[stats->symbols[i]] / (MAX_COUNT_D+1) * sumTmp;
     }
   }
-  x = (-(ns / (MAX_COUNT_D+1)) * (evalLogGamma((2*MAX_COUNT_D) + 1) - ((MAX_COUNT+1) * loghalf) - evalLogGamma(MAX_COUNT)) - evalLogGamma(MAX_COUNT) - ((MAX_COUNT-1) * loghalf) +
-    (ns / 2) * M_LNPI - ns * (evalLogGamma(MAX_COUNT + 1) / 2) + ((stats->symbolCount - 1) / ((MAX_COUNT_D / 2) - 1)) * (evalLogGamma(MAX_COUNT+1) - evalLogGamma(MAX_COUNT_D / 2)) - 
-    evalLogGamma(MAX_COUNT_D / 2) - sum) / M_LN2;
+  x = (-(ns / (MAX_COUNT_D+1)) * (evalLogGamma(ctx, (2*MAX_COUNT_D) + 1) - ((ctx->maxCount+1) * loghalf) - evalLogGamma(ctx, ctx->maxCount)) - evalLogGamma(ctx, ctx->maxCount) - ((ctx->maxCount-1) * loghalf) +
+    (ns / 2) * M_LNPI - ns * (evalLogGamma(ctx, ctx->maxCount + 1) / 2) + ((stats->symbolCount - 1) / ((MAX_COUNT_D / 2) - 1)) * (evalLogGamma(ctx, ctx->maxCount+1) - evalLogGamma(ctx, MAX_COUNT_D / 2)) - 
+    evalLogGamma(ctx, MAX_COUNT_D / 2) - sum) / M_LN2;
   return x;
 }
 
@@ -180,7 +172,7 @@ double deckard (statistics_t stats) {
  * @param[in] stats The statistics needed to calculate the probability assignment.
  * @returns KT probability assignment.
  */
-double escapeCost (statistics_t stats, Uint * distinct) {
+double escapeCost (context_t ctx, statistics_t stats, Uint * distinct) {
   Uint ns = 0, i;
   double sum = 0;
   double loghalf = -0.6931471805599452862;
@@ -188,49 +180,55 @@ double escapeCost (statistics_t stats, Uint * distinct) {
   for (i=0; i<stats->symbolCount; i++) {
     ns += distinct[stats->symbols[i]];
     if (distinct[stats->symbols[i]] > 0) {
-      sum += evalLogGamma2(distinct[stats->symbols[i]]-1);
+      sum += evalLogGamma2(ctx, distinct[stats->symbols[i]]-1);
     }
   }
-  return (evalLogGamma(ns) - ((stats->symbolCount - 1) * loghalf) - evalLogGamma(stats->symbolCount) - sum + (stats->symbolCount * 0.5 * M_LNPI)) / M_LN2;
+  return (evalLogGamma(ctx, ns) - ((stats->symbolCount - 1) * loghalf) - evalLogGamma(ctx, stats->symbolCount) - sum + (stats->symbolCount * 0.5 * M_LNPI)) / M_LN2;
 }
 
 /**
  * @returns log2 of the alphabet size. 
  */
-double log2Alpha () {
-  if (alphasizeLog == 0) {
-    alphasizeLog = gsl_sf_log(alphasize) / M_LN2;
+double log2Alpha (context_t ctx) {
+  if (ctx->alphasizeLog == 0 || ctx->cachedAlphasize != ctx->alphasize) {
+    ctx->cachedAlphasize = ctx->alphasize;
+    ctx->alphaEntropy = 0;
+    ctx->alphasizeLog = gsl_sf_log(ctx->alphasize) / M_LN2;
   }
-  return alphasizeLog;
+  return ctx->alphasizeLog;
 }
 
 
 /** 
- * @returns binary entropy of 1/alphasize. 
+ * @returns binary entropy of 1/ctx->alphasize. 
  */
-double hAlpha () {
-  if (alphaEntropy == 0) {
-    double invAlpha = (double)1 / alphasize;
-    alphaEntropy = (invAlpha * log2Alpha()) - ((1 - invAlpha) * gsl_sf_log(1 - invAlpha) / M_LN2);
-    DEBUGCODE(printf(">>>> %e\n", alphaEntropy));
+double hAlpha (context_t ctx) {
+  if (ctx->alphaEntropy == 0 || ctx->cachedAlphasize != ctx->alphasize) {
+    double invAlpha = (double)1 / ctx->alphasize;
+    ctx->alphaEntropy = invAlpha * log2Alpha(ctx);
+    /* the second term tends to 0 with a single symbol, where the logarithm is not defined */
+    if (invAlpha < 1) {
+      ctx->alphaEntropy -= (1 - invAlpha) * gsl_sf_log(1 - invAlpha) / M_LN2;
+    }
+    DEBUGCODE(printf(">>>> %e\n", ctx->alphaEntropy));
   }
-  return alphaEntropy;
+  return ctx->alphaEntropy;
 }
 
 #ifdef DEBUG
 
 /**
- * @returns number of table lookup evaluations.
+ * @returns number of table lookup evaluations of the calling thread.
  */
-int getHits() {
+int getHits(context_t ctx) {
   return gammaHits;
 }
 
 
 /**
- * @returns number of explicit evaluations. 
+ * @returns number of explicit evaluations of the calling thread. 
  */
-int getMisses() {
+int getMisses(context_t ctx) {
   return gammaMisses;
 }
 
@@ -25,28 +25,31 @@
 #include "statistics.h"
 #include "alpha.h"
 
+/** Maximum allowed height for the tree, the children of deeper nodes are pruned without evaluating their cost. */
+#define MAX_HEIGHT 30
+
 /** Calculates the Krichevsky-Trofimov probability assignment. */
-double kt(statistics_t);
+double kt(context_t, statistics_t);
 
 /** Calculates the cost of a node. */
-double nodeCost(statistics_t);
+double nodeCost(context_t, statistics_t);
 
 /** Calculates the cost of escapes in a node*/
-double escapeCost(statistics_t, Uint *);
+double escapeCost(context_t, statistics_t, Uint *);
 
 /** Returns the log2 of the alphabet size. */
-double log2Alpha (); 
+double log2Alpha (context_t); 
 
 /** Returns the binary entropy of 1/alphasize. */
-double hAlpha (); 
+double hAlpha (context_t); 
 
 #ifdef DEBUG
 
 /** Returns the number of gamma function evaluations resolved by table lookup. */
-int getHits();
+int getHits(context_t);
 
 /** Retruns the number of gamma function evaluations calculated explicitly. */
-int getMisses();
+int getMisses(context_t);
 
 #endif
 
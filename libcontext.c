@@ -0,0 +1,1551 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#ifndef WIN32
+/* fmemopen and open_memstream */
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#endif
+#include <math.h>
+#include "libcontext.h"
+#include "failure.h"
+#include "types.h"
+#include "spacedef.h"
+#include "mapfile.h"
+#include "reverse.h"
+#include "wotd.h"
+#include "fsmTree.h"
+#include "fsmModel.h"
+#include "suffixTree.h"
+#include "suffixArray.h"
+#include "decoderTree.h"
+#include "encoder.h"
+#include "decoder.h"
+#include "debug.h"
+#include "alpha.h"
+#include "context.h"
+#include "reset.h"
+#include "arithmetic/coder.h"
+#include "arithmetic/bitio.h"
+
+#ifdef DEBUG
+#include "gammaFunc.h" 
+#endif
+
+/** Magic number to detect valid ctx files */
+#define MAGIC 0x3276
+
+/** Header flag of ctx files whose parts are coded as independent substreams */
+#define FLAG_INDEXED 0x0001
+
+/** Header flag of ctx files coded with the 32 bit range coder */
+#define FLAG_WIDE 0x0008
+
+/** Header flag of ctx files written as a sequence of independently coded blocks */
+#define FLAG_BLOCKS 0x0080
+
+/** Number of bytes used to store the number of parts in ctx files coded with the 16 bit coder */
+#define LEGACY_PARTS_SIZE 1
+
+/** Number of bytes used to store lengths and offsets in ctx files coded with the 16 bit coder */
+#define LEGACY_LENGTH_SIZE 4
+
+/** Number of bytes used to store the number of parts */
+#define PARTS_SIZE 4
+
+/** Number of bytes used to store lengths and offsets */
+#define LENGTH_SIZE 8
+
+/** Size of the blocks used to read input streams. */
+#define READ_BLOCK_SIZE 65536
+
+/** 
+ * State of a library call. Everything the call allocates is registered here so it 
+ * can be released when the call ends, even if it is aborted by an error.
+ */
+typedef struct job {
+  ctxOptions options; /**< Call parameters. */
+  context_t ctx; /**< Context of the stream being processed. */
+  fsmTree_t stree; /**< Context tree of the part being compressed. */
+  suffixTree_t sfxTree; /**< Suffix tree of the part being compressed with the Ukkonen algorithm. */
+  fsmModel_t model; /**< Model of the part being compressed. */
+  Uchar *text; /**< Text to compress. */
+  Uint textlen; /**< Length of the text to compress. */
+  BOOL mapped; /**< If the text is a mapped file. */
+#ifdef WIN32
+  HANDLE hndl; /**< Handle of the mapped file. */
+#endif
+  Uchar *buffer; /**< Buffer read from an input stream or written to an output buffer. */
+  size_t bufferLen; /**< Length of the buffer. */
+  FILE *input; /**< Input stream. */
+  FILE *output; /**< Output stream. */
+  BOOL closeInput; /**< If the input stream was opened by the library. */
+  BOOL closeOutput; /**< If the output stream was opened by the library. */
+  FILE **streams; /**< Substreams of the blocks being coded. */
+  int parts; /**< Number of parts. */
+  Uint *partTextLen; /**< Length of each part. */
+  Uint *partOffset; /**< Offset of each part. */
+  int coderBits; /**< Register size of the arithmetic coder. */
+  int partsSize; /**< Number of bytes of the part count in the file. */
+  int lengthSize; /**< Number of bytes of the lengths and offsets in the file. */
+  Uchar **partData; /**< Coded or decoded data of each part processed by the workers. */
+  Uint *partDataLen; /**< Length of the data of each part. */
+  Uchar *data; /**< Substreams kept in memory, the parts of the decompression workers or the block being compressed. */
+  size_t dataLen; /**< Length of the substreams. */
+  int nextPart; /**< First part not taken by any worker. */
+#ifndef WIN32
+  pthread_mutex_t lock; /**< Protects the next part taken by the workers. */
+#endif
+} *job_t;
+
+/** 
+ * Worker that codes or decodes parts of a call. Each worker has its own state and 
+ * context, the only data shared with the other workers is the read only text and 
+ * index of the call.
+ */
+typedef struct worker {
+  job_t call; /**< The running call, the workers take their parts from it. */
+  struct job job; /**< State of the part being processed. */
+  void (*processPart)(struct worker *, int); /**< Codes or decodes a part. */
+  int status; /**< CTX_OK or the error that stopped the worker. */
+#ifndef WIN32
+  pthread_t thread; /**< Thread running the worker. */
+#endif
+} *worker_t;
+
+/**
+ * Sets the register size of the arithmetic coder and the size of the fields that depend on it.
+ * Files coded with the 16 bit coder keep the field sizes of previous versions.
+ * @param[in] job the running call.
+ * @param[in] coderBits register size of the arithmetic coder.
+ */
+static void setFormat(job_t job, int coderBits) {
+  job->coderBits = coderBits;
+  job->partsSize = (coderBits == CODER_BITS_WIDE ? PARTS_SIZE : LEGACY_PARTS_SIZE);
+  job->lengthSize = (coderBits == CODER_BITS_WIDE ? LENGTH_SIZE : LEGACY_LENGTH_SIZE);
+}
+
+/**
+ * Returns a byte of a number, the bytes beyond the size of a Uint are zero.
+ * @param[in] number the number.
+ * @param[in] i index of the byte, zero is the least significant one.
+ * @param[in] bytes size of the field where the number is stored.
+ * @returns the byte.
+ */
+static int getNumberByte(Uint number, int i, int bytes) {
+  if (i == 0 && bytes < (int)sizeof(Uint) && (number >> (8 * bytes)) != 0) {
+    failure(CTX_ERR_LIMIT, "Number too large for the file format");
+  }
+  return (i < (int)sizeof(Uint) ? (number >> (8 * i)) & 0xFF : 0);
+}
+
+/**
+ * Appends a byte to a number that is being read.
+ * @param[in] number the bytes readed so far.
+ * @param[in] byte the next byte.
+ * @returns the updated number.
+ */
+static Uint addNumberByte(Uint number, int byte) {
+  if ((number >> (sizeof(Uint) * CHAR_BIT - 8)) != 0) {
+    failure(CTX_ERR_LIMIT, "Number too large for this platform");
+  }
+  return (number << 8) | (Uint)byte;
+}
+
+/**
+ * Writes a number to the output file as a fixed size big endian field.
+ * @param[in] number the number to write.
+ * @param[in] bytes size of the field in bytes.
+ * @param[in] file the output file.
+ */
+static void writeNumber(Uint number, int bytes, FILE *file) {
+  int i;
+
+  for (i=bytes-1; i>=0; i--) {
+    putc(getNumberByte(number, i, bytes), file);
+  }
+}
+
+/**
+ * Reads a fixed size big endian number from the input file.
+ * @param[in] bytes size of the field in bytes.
+ * @param[in] file the input file.
+ * @returns the readed number.
+ */
+static Uint readNumber(int bytes, FILE *file) {
+  int i, c;
+  Uint number = 0;
+
+  for (i=0; i<bytes; i++) {
+    if ((c = getc(file)) == EOF) {
+      failure(CTX_ERR_FORMAT, "Invalid compressed file");
+    }
+    number = addNumberByte(number, c);
+  }
+  return number;
+}
+
+/**
+ * Returns the number of bytes left in a stream that can seek.
+ * @param[in] file the stream.
+ * @returns the number of bytes between the current position and the end of the stream.
+ */
+static Uint remainingBytes(FILE *file) {
+  long position = ftell(file), end = 0;
+
+  if (position == -1 || fseek(file, 0, SEEK_END) != 0 || (end = ftell(file)) == -1 ||
+      fseek(file, position, SEEK_SET) != 0) {
+    failure(CTX_ERR_IO, "Could not read input");
+  }
+  return (Uint)(end - position);
+}
+
+/**
+ * Checks that a coded substream is long enough to hold a text. The coder narrows its 
+ * range at least by a factor (scale - 1) / scale for every symbol, so each symbol takes 
+ * more than 1 / scale bits and a corrupt length fails before its buffer is allocated.
+ * @param[in] textlen length of the text.
+ * @param[in] bytes length of the substream.
+ */
+static void checkTextLen(Uint textlen, Uint bytes) {
+  if (textlen / ((Uint)MAXIMUM_SCALE_WIDE << 3) > bytes + 2) {
+    failure(CTX_ERR_FORMAT, "Invalid compressed file");
+  }
+}
+
+/**
+ * Reads all the data of the input stream of the call into the job buffer.
+ * @param[in] data the running call.
+ * @returns CTX_OK.
+ */
+static int readAllTask(void *data) {
+  job_t job = (job_t)data;
+  size_t alloc = 0, readed;
+
+  do {
+    if (job->bufferLen == alloc) {
+      alloc += READ_BLOCK_SIZE;
+      REALLOC(job->buffer, job->buffer, Uchar, alloc);
+    }
+    readed = fread(job->buffer + job->bufferLen, 1, alloc - job->bufferLen, job->input);
+    job->bufferLen += readed;
+  } while (readed > 0);
+
+  if (ferror(job->input)) {
+    failure(CTX_ERR_IO, "Could not read input");
+  }
+  return CTX_OK;
+}
+
+/**
+ * Opens a stream that reads a memory buffer.
+ * @param[in] buffer the data to read.
+ * @param[in] length length of the data.
+ * @returns the stream or NULL if it could not be opened.
+ */
+static FILE *openBuffer(const Uchar *buffer, Uint length) {
+  FILE *file;
+
+#ifndef WIN32
+  file = length > 0 ? fmemopen((void *)buffer, length, "rb") : fopen("/dev/null", "rb");
+#else
+  file = tmpfile();
+  if (file && (fwrite(buffer, 1, length, file) != length || fseek(file, 0, SEEK_SET) != 0)) {
+    fclose(file);
+    file = NULL;
+  }
+#endif
+  return file;
+}
+
+/**
+ * Opens a stream that reads a memory buffer.
+ * @param[in] job the running call, the stream is stored as its input.
+ * @param[in] buffer the data to read.
+ * @param[in] length length of the data.
+ * @returns CTX_OK or CTX_ERR_IO.
+ */
+static int openInputBuffer(job_t job, const Uchar *buffer, Uint length) {
+  job->input = openBuffer(buffer, length);
+  job->closeInput = True;
+  return job->input ? CTX_OK : CTX_ERR_IO;
+}
+
+/**
+ * Opens a stream that writes to a growing memory buffer.
+ * @param[out] buffer the written data, set when the stream is closed.
+ * @param[out] length length of the written data.
+ * @returns the stream or NULL if it could not be opened.
+ */
+static FILE *openMemoryStream(Uchar **buffer, size_t *length) {
+#ifndef WIN32
+  return open_memstream((char **)buffer, length);
+#else
+  return tmpfile();
+#endif
+}
+
+/**
+ * Closes a stream opened with openMemoryStream and stores the written data.
+ * @param[in] file the stream.
+ * @param[out] buffer the written data.
+ * @param[out] length length of the written data.
+ * @returns CTX_OK, CTX_ERR_IO or CTX_ERR_MEMORY.
+ */
+static int closeMemoryStream(FILE *file, Uchar **buffer, size_t *length) {
+#ifndef WIN32
+  return fclose(file) == 0 ? CTX_OK : CTX_ERR_IO;
+#else
+  *length = ftell(file);
+  *buffer = malloc(*length + 1);
+  if (!*buffer) {
+    fclose(file);
+    return CTX_ERR_MEMORY;
+  }
+  rewind(file);
+  if (fread(*buffer, 1, *length, file) != *length) {
+    fclose(file);
+    return CTX_ERR_IO;
+  }
+  fclose(file);
+  return CTX_OK;
+#endif
+}
+
+/**
+ * Opens a stream that writes to a growing memory buffer.
+ * @param[in] job the running call, the stream is stored as its output.
+ * @returns CTX_OK or CTX_ERR_IO.
+ */
+static int openOutputBuffer(job_t job) {
+  job->output = openMemoryStream(&job->buffer, &job->bufferLen);
+  job->closeOutput = True;
+  return job->output ? CTX_OK : CTX_ERR_IO;
+}
+
+/**
+ * Closes the output stream of a successful call and hands its data to the caller.
+ * @param[in] job the running call.
+ * @param[out] output the written data.
+ * @param[out] outputLen length of the written data.
+ * @returns CTX_OK, CTX_ERR_IO or CTX_ERR_MEMORY.
+ */
+static int closeOutputBuffer(job_t job, Uchar **output, Uint *outputLen) {
+  FILE *file = job->output;
+  int status;
+
+  job->output = NULL;
+  if ((status = closeMemoryStream(file, &job->buffer, &job->bufferLen)) != CTX_OK) {
+    return status;
+  }
+  *output = job->buffer;
+  *outputLen = job->bufferLen;
+  job->buffer = NULL;
+  return CTX_OK;
+}
+
+/**
+ * Writes a byte to the output file using the arithmetic encoder
+ * @param[in] byte the data to write
+ * @param[in] file the output file
+ */
+static void writeByte(context_t ctx, int byte, FILE *file) {
+  SYMBOL s;
+
+  byte = byte & 0x000000FF;
+  s.scale = 256; 
+  s.low_count = byte;
+  s.high_count = byte + 1;
+  encode_symbol(&ctx->coder, file, &s);
+}
+
+/**
+ * Reads a byte using the arithmetic decoder
+ * @param[in] file the input file
+ * @returns the readed byte
+ */
+static int readByte(context_t ctx, FILE *file) {
+  SYMBOL s;
+  int ret;
+
+  s.scale = 256; 
+  ret = get_current_count(&ctx->coder, &s);
+  s.low_count = ret;
+  s.high_count = ret + 1;
+  remove_symbol_from_stream(&ctx->coder, file, &s);
+
+  return ret;
+}
+
+/**
+ * Writes a number as a fixed size big endian field using the arithmetic encoder.
+ * @param[in] number the number to write.
+ * @param[in] bytes size of the field in bytes.
+ * @param[in] file the output file.
+ */
+static void writeCodedNumber(context_t ctx, Uint number, int bytes, FILE *file) {
+  int i;
+
+  for (i=bytes-1; i>=0; i--) {
+    writeByte(ctx, getNumberByte(number, i, bytes), file);
+  }
+}
+
+/**
+ * Reads a fixed size big endian number using the arithmetic decoder.
+ * @param[in] bytes size of the field in bytes.
+ * @param[in] file the input file.
+ * @returns the readed number.
+ */
+static Uint readCodedNumber(context_t ctx, int bytes, FILE *file) {
+  int i;
+  Uint number = 0;
+
+  for (i=0; i<bytes; i++) {
+    number = addNumberByte(number, readByte(ctx, file));
+  }
+  return number;
+}
+
+/**
+ * Writes the alphabet to the output file.
+ * @param[in] file the output file.
+ */
+static void writeAlphabet(context_t ctx, FILE *file) {
+  int i, j, last = UCHAR_MAX + 1;
+  SYMBOL s;
+  long cost;
+
+  /* write alphabet size */
+  writeByte(ctx, ctx->alphasize, file);
+
+  cost = bit_ftell_output(&ctx->coder, file);
+
+  if (ctx->alphasize <= UCHAR_MAX) {
+    if (ctx->alphasize < 128) { /* send alphabet */
+      for (i=ctx->alphasize-1; i>=0; i--) {
+	s.scale = last;
+	s.low_count = ctx->characters[i];
+	s.high_count = ctx->characters[i] + 1;
+	encode_symbol(&ctx->coder, file, &s);
+	last = ctx->characters[i];
+      }
+    }
+    else { /* send complement of alphabet */
+      for (i=UCHAR_MAX, j=ctx->alphasize-1; i>=0; i--) {
+	if (j<0 || ctx->characters[j] != i) {
+	  s.scale = last;
+	  s.low_count = i;
+	  s.high_count = i+1;
+	  encode_symbol(&ctx->coder, file, &s);
+	  last = i;
+	}
+	else {
+	  j--;
+	}
+      }
+    }
+  }
+  VERBOSE(fprintf(ctx->messages, "Alphabet cost: %ld\n", bit_ftell_output(&ctx->coder, file) - cost));
+}
+
+
+/**
+ * Reads the alphabet from the input file.
+ * @param[in] file input file.
+ */
+static void readAlphabet(context_t ctx, FILE *file) {
+  SYMBOL s;
+  int i, j, k, last = UCHAR_MAX + 1, count;
+  
+  /* read alphabet size */
+  ctx->alphasize = readByte(ctx, file);
+
+  if (ctx->alphasize == 0) ctx->alphasize = 256;
+  VERBOSE(fprintf(ctx->messages, "Alphasize: %ld\n", ctx->alphasize));
+
+  if (ctx->alphasize <= UCHAR_MAX) {
+    if (ctx->alphasize < 128) { /* read alphabet */
+      for (i=ctx->alphasize-1; i>=0; i--) {
+	s.scale = last;
+	count = get_current_count(&ctx->coder, &s);
+	ctx->characters[i] = count;
+	ctx->alphaindex[ctx->characters[i]] = i;
+	last = count;
+
+	s.low_count = count;
+	s.high_count = count + 1;
+	remove_symbol_from_stream(&ctx->coder, file, &s);
+      }
+    }
+    else { /* read complement of alphabet */
+      for (i=ctx->alphasize-1, j=UCHAR_MAX, k=UCHAR_MAX - ctx->alphasize; k>=0; k--) {
+	s.scale = last;
+	count = get_current_count(&ctx->coder, &s);
+	last = count;
+
+	if (j>count) {
+	  if (j - count > i + 1) {
+	    failure(CTX_ERR_FORMAT, "Invalid compressed file");
+	  }
+	  for (; j>count; i--, j--) {
+	    ctx->characters[i] = j;
+	    ctx->alphaindex[ctx->characters[i]] = i;
+	  }
+	}
+	j = count-1;
+
+	s.low_count = count;
+	s.high_count = count + 1;
+	remove_symbol_from_stream(&ctx->coder, file, &s);
+      }
+      if (j > i + 1) {
+	failure(CTX_ERR_FORMAT, "Invalid compressed file");
+      }
+      for (; j>0; i--, j--) {
+	ctx->characters[i] = j;
+	ctx->alphaindex[ctx->characters[i]] = i;
+      }
+    }
+  }
+  else {
+    for (i=0; i<ctx->alphasize; i++) {
+      ctx->characters[i] = i;
+      ctx->alphaindex[i] = i;
+    }
+  }
+}
+
+/**
+ * Creates the context of a new stream, with the coder buffer size of the options.
+ * @param[in] job the running call.
+ * @returns the new context.
+ */
+static context_t newContext(job_t job) {
+  job->ctx = initContext();
+  job->ctx->verbose = job->options.verbose;
+  job->ctx->messages = job->options.messages;
+  job->ctx->threads = job->options.threads;
+  if (job->options.coderBufferSize > 0) {
+    MALLOC(job->ctx->coderBuffer, Uchar, job->options.coderBufferSize);
+    set_bitstream_buffer(&job->ctx->coder, job->ctx->coderBuffer, job->options.coderBufferSize);
+  }
+  return job->ctx;
+}
+
+/**
+ * Deletes the context of the current stream and its context tree.
+ * @param[in] job the running call.
+ */
+static void endContext(job_t job) {
+  if (job->sfxTree) {
+    freeSuffixTree(job->sfxTree);
+    job->sfxTree = NULL;
+  }
+  if (job->stree) {
+    freeFsmTree(job->ctx, job->stree);
+    job->stree = NULL;
+  }
+  if (job->model) {
+    freeFsmModel(job->model);
+    job->model = NULL;
+  }
+  if (job->ctx) {
+    freeContext(job->ctx);
+    job->ctx = NULL;
+  }
+}
+
+/**
+ * Releases everything owned by a finished call.
+ * @param[in] job the call state.
+ */
+static void endJob(job_t job) {
+  int part;
+
+  if (job->closeInput && job->input) fclose(job->input);
+  if (job->closeOutput && job->output) fclose(job->output);
+  endContext(job);
+  if (job->streams) {
+    for (part = 0; part < job->parts; part++) {
+      if (job->streams[part]) fclose(job->streams[part]);
+    }
+    FREE(job->streams);
+  }
+  FREE(job->partTextLen);
+  FREE(job->partOffset);
+  if (job->partData) {
+    for (part = 0; part < job->parts; part++) {
+      FREE(job->partData[part]);
+    }
+    FREE(job->partData);
+  }
+  FREE(job->partDataLen);
+  FREE(job->data);
+  if (job->mapped) {
+#ifdef WIN32
+    freetextspace(job->text, job->hndl);
+#else
+    freetextspace(job->text, job->textlen);
+#endif
+  }
+  FREE(job->buffer);
+}
+
+/**
+ * Builds the pruned context tree of the current text.
+ * @param[in] job the running call.
+ * @returns the context tree.
+ */
+static fsmTree_t buildModel(job_t job) {
+  context_t ctx = job->ctx;
+
+  if (job->stree) {
+    freeFsmTree(job->ctx, job->stree);
+    job->stree = NULL;
+  }
+  if (job->options.algorithm == CTX_UKKONEN) {
+    job->sfxTree = initSuffixTree();
+    buildSuffixTree(ctx, job->sfxTree);
+    VERBOSE(fprintf(ctx->messages, "Tree built\n"));
+    pruneSuffixTree(ctx, job->sfxTree);
+    job->stree = fsmSuffixTree(ctx, job->sfxTree);
+    freeSuffixTree(job->sfxTree);
+    job->sfxTree = NULL;
+  }
+  else if (job->options.algorithm == CTX_SUFFIXARRAY) {
+    job->stree = buildSuffixArrayTree(ctx);
+    VERBOSE(fprintf(ctx->messages, "Tree built\n"));
+  }
+  else {
+    job->stree = buildSTree(ctx);
+    VERBOSE(fprintf(ctx->messages, "Tree built\n"));
+  }
+  return job->stree;
+}
+
+/**
+ * Calculates the FSM closure of the context tree, lays it out in a model and encodes the
+ * text with it. The tree is released before encoding.
+ * @param[in] job the running call.
+ * @param[in] text text to encode.
+ * @param[in] textlen length of the text.
+ * @param[in] file output file.
+ */
+static void encodeModel(job_t job, const Uchar *text, Uint textlen, FILE *file) {
+  context_t ctx = job->ctx;
+
+  VERBOSE(fprintf(ctx->messages, "FSM...\n"));
+  makeFsm(ctx, job->stree);
+  DEBUGCODE(printFsmTree(ctx, job->stree));
+  job->model = initFsmModel();
+  flattenFsm(ctx, job->stree, job->model);
+  freeFsmTree(ctx, job->stree);
+  job->stree = NULL;
+  initModelStatistics(job->model);
+
+  VERBOSE(fprintf(ctx->messages, "Encoding...\n"));
+  encode(ctx, job->model, file, text, textlen, job->options.see);
+  freeFsmModel(job->model);
+  job->model = NULL;
+}
+
+/**
+ * Compresses one part of the input text as an independent substream. The substream holds
+ * the alphabet of the part, its context tree and the encoded data, and the arithmetic
+ * coder is flushed at its end.
+ * @param[in] job the running call.
+ * @param[in] partText text of the part.
+ * @param[in] partTextLen length of the part.
+ * @param[in] file output file for the substream.
+ */
+static void zipPart(job_t job, Uchar *partText, Uint partTextLen, FILE *file) {
+  context_t ctx = newContext(job);
+  fsmTree_t stree;
+
+  buildAlpha(ctx, partText, partTextLen);
+  setMaxCount(ctx);
+
+  initialize_output_bitstream(&ctx->coder);
+  initialize_arithmetic_encoder(&ctx->coder, job->coderBits);
+  writeAlphabet(ctx, file);
+
+  ctx->textlen = partTextLen;
+  CALLOC(ctx->text, Uchar, ctx->textlen);
+  reversestring(partText, ctx->textlen, ctx->text);
+
+  stree = buildModel(job);
+  VERBOSE(fprintf(ctx->messages, "height: %ld\n", getHeight(ctx, stree)));
+  VERBOSE(fprintf(ctx->messages, "Textlen: %ld\n", ctx->textlen));
+  writeFsmTree(ctx, stree, file);
+  encodeModel(job, partText, partTextLen, file);
+
+  flush_arithmetic_encoder(&ctx->coder, file);
+  flush_output_bitstream(&ctx->coder, file);
+
+  endContext(job);
+}
+
+/**
+ * Takes the next part not processed by any worker.
+ * @param[in] job the running call.
+ * @returns the part, or the number of parts if there are none left.
+ */
+static int takePart(job_t job) {
+  int part;
+
+#ifndef WIN32
+  pthread_mutex_lock(&job->lock);
+#endif
+  part = job->nextPart < job->parts ? job->nextPart++ : job->parts;
+#ifndef WIN32
+  pthread_mutex_unlock(&job->lock);
+#endif
+  return part;
+}
+
+/**
+ * Processes parts of the call until there are none left.
+ * @param[in] data the worker.
+ * @returns CTX_OK.
+ */
+static int workerTask(void *data) {
+  worker_t worker = (worker_t)data;
+  int part;
+
+  while ((part = takePart(worker->call)) < worker->call->parts) {
+    worker->processPart(worker, part);
+  }
+  return CTX_OK;
+}
+
+/**
+ * Runs a worker. Everything the worker allocated is released when it ends, and if 
+ * it fails the parts not yet taken are withdrawn so the other workers stop early.
+ * @param[in] data the worker.
+ * @returns NULL.
+ */
+static void *workerThread(void *data) {
+  worker_t worker = (worker_t)data;
+
+  worker->status = runProtected(workerTask, worker);
+  endJob(&worker->job);
+  if (worker->status != CTX_OK) {
+#ifndef WIN32
+    pthread_mutex_lock(&worker->call->lock);
+#endif
+    worker->call->nextPart = worker->call->parts;
+#ifndef WIN32
+    pthread_mutex_unlock(&worker->call->lock);
+#endif
+  }
+  return NULL;
+}
+
+/**
+ * Processes the parts of the call with parallel worker threads. The calling thread 
+ * is one of the workers, if a thread can not be started the others take its parts.
+ * @param[in] job the running call.
+ * @param[in] processPart function that codes or decodes a part.
+ */
+static void runWorkers(job_t job, void (*processPart)(worker_t, int)) {
+  worker_t workers;
+  int i, count = job->options.workers < job->parts ? job->options.workers : job->parts, status = CTX_OK;
+#ifndef WIN32
+  int started;
+#else
+  count = 1;
+#endif
+
+  CALLOC(workers, struct worker, count);
+  for (i = 0; i < count; i++) {
+    workers[i].call = job;
+    workers[i].processPart = processPart;
+    workers[i].job.options = job->options;
+    setFormat(&workers[i].job, job->coderBits);
+  }
+  job->nextPart = 0;
+
+#ifndef WIN32
+  pthread_mutex_init(&job->lock, NULL);
+  for (started = 1; started < count && pthread_create(&workers[started].thread, NULL, workerThread, workers + started) == 0; started++);
+#endif
+  workerThread(workers);
+#ifndef WIN32
+  for (i = 1; i < started; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+  pthread_mutex_destroy(&job->lock);
+#endif
+
+  for (i = count - 1; i >= 0; i--) {
+    if (workers[i].status != CTX_OK) {
+      status = workers[i].status;
+    }
+  }
+  FREE(workers);
+  if (status != CTX_OK) {
+    failure(status, "Worker failed");
+  }
+}
+
+/**
+ * Compresses a part of the call in a worker, the substream is kept in memory.
+ * @param[in] worker the worker.
+ * @param[in] part the part to compress.
+ */
+static void zipWorkerPart(worker_t worker, int part) {
+  job_t call = worker->call, job = &worker->job;
+  int status;
+
+  if (job->options.verbose) fprintf(job->options.messages, "---------- part %d ---------------\n", part + 1);
+  if (openOutputBuffer(job) != CTX_OK) {
+    failure(CTX_ERR_IO, "Could not open output buffer");
+  }
+  zipPart(job, call->text + call->partOffset[part], call->partTextLen[part], job->output);
+  if ((status = closeOutputBuffer(job, call->partData + part, call->partDataLen + part)) != CTX_OK) {
+    failure(status, "Could not write output buffer");
+  }
+}
+
+/**
+ * Compresses the input text splitting it in parts that are modeled and encoded 
+ * independently by parallel workers. Each part is written to its own substream and 
+ * the output starts with an index holding the length and offset of each part.
+ * @param[in] job the running call.
+ */
+static void zipParallel(job_t job) {
+  Uint offset;
+  int part, parts = job->options.parts;
+  FILE *compressed_file = job->output;
+
+  job->parts = parts;
+  CALLOC(job->partTextLen, Uint, parts);
+  CALLOC(job->partOffset, Uint, parts);
+  CALLOC(job->partData, Uchar *, parts);
+  CALLOC(job->partDataLen, Uint, parts);
+
+  for (part = 0, offset = 0; part < parts; part++) {
+    if (part != parts - 1) {
+      job->partTextLen[part] = job->textlen / parts;
+    }
+    else {
+      job->partTextLen[part] = job->textlen - (job->textlen / parts) * (parts - 1);
+    }
+    job->partOffset[part] = offset;
+    offset += job->partTextLen[part];
+  }
+  if (parts > 0) {
+    runWorkers(job, zipWorkerPart);
+  }
+
+  /* compressed offset of each part */
+  for (part = 0, offset = 0; part < parts; part++) {
+    job->partOffset[part] = offset;
+    offset += job->partDataLen[part];
+  }
+
+  /* write index */
+  putc(MAGIC >> 8, compressed_file);
+  putc((MAGIC | FLAG_INDEXED | (job->coderBits == CODER_BITS_WIDE ? FLAG_WIDE : 0)) & 0xFF, compressed_file);
+  writeNumber(parts, job->partsSize, compressed_file);
+  for (part = 0; part < parts; part++) {
+    writeNumber(job->partOffset[part], job->lengthSize, compressed_file);
+    writeNumber(job->partTextLen[part], job->lengthSize, compressed_file);
+  }
+
+  /* write the substreams */
+  for (part = 0; part < parts; part++) {
+    if (fwrite(job->partData[part], 1, job->partDataLen[part], compressed_file) != job->partDataLen[part]) {
+      failure(CTX_ERR_IO, "Could not write output");
+    }
+    FREE(job->partData[part]);
+  }
+  if (job->options.verbose) fprintf(job->options.messages, "Compressed size: %ld\n", ftell(compressed_file));
+}
+
+/**
+ * Compresses the text of the call and writes the compressed data to its output stream.
+ * @param[in] data the running call.
+ * @returns CTX_OK.
+ */
+static int zipTask(void *data) {
+  job_t job = (job_t)data;
+  Uchar *origText = job->text;
+  Uint origTextLen = job->textlen, partTextLen, currentTextLen;
+  FILE *compressed_file = job->output;
+  int part, parts;
+  fsmTree_t stree;
+  context_t ctx;
+
+  if ((Uint)job->options.parts > origTextLen) {
+    /* every part needs at least one character, an empty text has no parts */
+    job->options.parts = (int)origTextLen;
+  }
+  parts = job->options.parts;
+
+  if (job->options.workers > 0) {
+    if (job->options.verbose) fprintf(job->options.messages, "Algorithm %d\n", job->options.algorithm);
+    zipParallel(job);
+    return CTX_OK;
+  }
+
+  ctx = newContext(job);
+  buildAlpha(ctx, origText, origTextLen);
+  VERBOSE(fprintf(ctx->messages, "Alphasize: %ld\n", ctx->alphasize));
+  VERBOSE(fprintf(ctx->messages, "Algorithm %d\n", job->options.algorithm));
+
+  setMaxCount(ctx);
+
+  /* write magic number */
+  putc(MAGIC >> 8, compressed_file);
+  putc((MAGIC | (job->coderBits == CODER_BITS_WIDE ? FLAG_WIDE : 0)) & 0xFF, compressed_file);
+  /* write # of parts */
+  writeNumber(parts, job->partsSize, compressed_file);
+
+  initialize_output_bitstream(&ctx->coder);
+  initialize_arithmetic_encoder(&ctx->coder, job->coderBits);
+
+  writeAlphabet(ctx, compressed_file);
+
+  currentTextLen = 0;
+  for (part = 1; part <= parts; part++) {
+    VERBOSE(fprintf(ctx->messages, "---------- part %d ---------------\n", part));
+    if (part != parts) {
+      partTextLen = origTextLen / parts;
+    }
+    else {
+      partTextLen = origTextLen - (origTextLen / parts) * (parts - 1);
+    }
+
+    FREE(ctx->text);
+    ctx->textlen = partTextLen;
+    CALLOC(ctx->text, Uchar, ctx->textlen);
+    reversestring(origText + currentTextLen, ctx->textlen, ctx->text);
+    
+    stree = buildModel(job);
+
+    DEBUGCODE(printf("gamma hits: %d gamma Misses: %d\n", getHits(ctx), getMisses(ctx)));
+    VERBOSE(fprintf(ctx->messages, "height: %ld\n", getHeight(ctx, stree)));
+
+    /* write textlen */
+    writeCodedNumber(ctx, ctx->textlen, job->lengthSize, compressed_file);
+    VERBOSE(fprintf(ctx->messages, "Textlen: %ld\n", ctx->textlen));
+    writeFsmTree(ctx, stree, compressed_file);
+    encodeModel(job, origText + currentTextLen, partTextLen, compressed_file);
+    
+    currentTextLen += partTextLen;
+  }
+
+  flush_arithmetic_encoder(&ctx->coder, compressed_file);
+  flush_output_bitstream(&ctx->coder, compressed_file);
+  endContext(job);
+  return CTX_OK;
+}
+
+
+/**
+ * Reads the number of parts of the input file.
+ * @param[in] job the running call.
+ * @returns the number of parts.
+ */
+static int readParts(job_t job) {
+  Uint parts = readNumber(job->partsSize, job->input);
+
+  if (parts > INT_MAX) {
+    failure(CTX_ERR_FORMAT, "Invalid compressed file");
+  }
+  return (int)parts;
+}
+
+/**
+ * Compresses the input stream of the call in blocks of fixed size. Each block is read,
+ * coded as an independent substream and written to the output before the next one is
+ * read, so the memory used depends on the block size and not on the input length.
+ * Every block is preceded by its length and the length of its substream, and a zero 
+ * length marks the end of the file.
+ * @param[in] data the running call.
+ * @returns CTX_OK.
+ */
+static int zipBlocksTask(void *data) {
+  job_t job = (job_t)data;
+  FILE *compressed_file = job->output;
+  size_t readed;
+  int block = 0, status;
+
+  putc(MAGIC >> 8, compressed_file);
+  putc((MAGIC | FLAG_BLOCKS | (job->coderBits == CODER_BITS_WIDE ? FLAG_WIDE : 0)) & 0xFF, compressed_file);
+
+  CALLOC(job->buffer, Uchar, job->options.blockSize);
+  job->parts = 1;
+  CALLOC(job->streams, FILE *, 1);
+  while ((readed = fread(job->buffer, 1, job->options.blockSize, job->input)) > 0) {
+    if (job->options.verbose) fprintf(job->options.messages, "---------- block %d ---------------\n", ++block);
+    if (!(job->streams[0] = openMemoryStream(&job->data, &job->dataLen))) {
+      failure(CTX_ERR_IO, "Could not open output buffer");
+    }
+    zipPart(job, job->buffer, readed, job->streams[0]);
+    status = closeMemoryStream(job->streams[0], &job->data, &job->dataLen);
+    job->streams[0] = NULL;
+    if (status != CTX_OK) {
+      failure(status, "Could not write output buffer");
+    }
+
+    writeNumber(readed, job->lengthSize, compressed_file);
+    writeNumber(job->dataLen, job->lengthSize, compressed_file);
+    if (fwrite(job->data, 1, job->dataLen, compressed_file) != job->dataLen || fflush(compressed_file) != 0) {
+      failure(CTX_ERR_IO, "Could not write output");
+    }
+    FREE(job->data);
+  }
+  if (ferror(job->input)) {
+    failure(CTX_ERR_IO, "Could not read input");
+  }
+  writeNumber(0, job->lengthSize, compressed_file);
+  return CTX_OK;
+}
+
+/**
+ * Decompresses one part stored as an independent substream.
+ * @param[in] job the running call.
+ * @param[in] compressed_file input file.
+ * @param[in] offset position of the substream in the input file.
+ * @param[in] partTextLen length of the decompressed part.
+ * @param[in] output_file output file.
+ */
+static void unzipPart(job_t job, FILE *compressed_file, long offset, Uint partTextLen, FILE *output_file) {
+  context_t ctx;
+  decoderTree_t tree;
+
+  if (fseek(compressed_file, offset, SEEK_SET) != 0) {
+    failure(CTX_ERR_FORMAT, "Invalid compressed file");
+  }
+
+  ctx = newContext(job);
+  initialize_input_bitstream(&ctx->coder);
+  initialize_arithmetic_decoder(&ctx->coder, compressed_file, job->coderBits);
+
+  readAlphabet(ctx, compressed_file);
+  setMaxCount(ctx);
+
+  tree = readDecoderTree(ctx, compressed_file);
+  VERBOSE(fprintf(ctx->messages, "Tree built\n"));
+  VERBOSE(fprintf(ctx->messages, "Textlen: %ld\n", partTextLen));
+  VERBOSE(fprintf(ctx->messages, "FSM...\n")); 
+  makeDecoderFsm(ctx, tree);
+  VERBOSE(fprintf(ctx->messages, "Decoding...\n"));
+  decode(ctx, tree, partTextLen, compressed_file, output_file, job->options.see);
+  freeDecoderTree(ctx, tree);
+  endContext(job);
+}
+
+/**
+ * Decompresses a part of the call in a worker, reading its substream from the copy 
+ * of the substreams in memory and keeping the decoded text in memory.
+ * @param[in] worker the worker.
+ * @param[in] part the part to decompress.
+ */
+static void unzipWorkerPart(worker_t worker, int part) {
+  job_t call = worker->call, job = &worker->job;
+  int status;
+
+  if (job->options.verbose) fprintf(job->options.messages, "---------- part %d ---------------\n", part + 1);
+  if (openInputBuffer(job, call->data + call->partOffset[part], call->dataLen - call->partOffset[part]) != CTX_OK ||
+      openOutputBuffer(job) != CTX_OK) {
+    failure(CTX_ERR_IO, "Could not open buffers in decompression worker");
+  }
+  unzipPart(job, job->input, 0, call->partTextLen[part], job->output);
+  fclose(job->input);
+  job->input = NULL;
+  if ((status = closeOutputBuffer(job, call->partData + part, call->partDataLen + part)) != CTX_OK) {
+    failure(status, "Could not write output buffer");
+  }
+}
+
+/**
+ * Decompresses a file whose parts are stored as independent substreams.
+ * If workers are requested the substreams are read into memory and the parts are 
+ * decoded in parallel, then written to the output in order.
+ * @param[in] job the running call, the input is positioned after the magic number.
+ */
+static void unzipIndexed(job_t job) {
+  Uint totalTextLen = 0, dataLen;
+  long dataStart;
+  int parts, part;
+  FILE *compressed_file = job->input, *output_file = job->output;
+
+  parts = readParts(job);
+  /* the index holds an offset and a length for every part */
+  if ((Uint)parts > remainingBytes(compressed_file) / (2 * job->lengthSize)) {
+    failure(CTX_ERR_FORMAT, "Invalid compressed file");
+  }
+  job->parts = parts;
+  CALLOC(job->partTextLen, Uint, parts);
+  CALLOC(job->partOffset, Uint, parts);
+  for (part = 0; part < parts; part++) {
+    job->partOffset[part] = readNumber(job->lengthSize, compressed_file);
+    job->partTextLen[part] = readNumber(job->lengthSize, compressed_file);
+    if (job->partTextLen[part] > LONG_MAX - totalTextLen) {
+      failure(CTX_ERR_FORMAT, "Invalid compressed file");
+    }
+    totalTextLen += job->partTextLen[part];
+  }
+  dataStart = ftell(compressed_file);
+  dataLen = remainingBytes(compressed_file);
+  for (part = 0; part < parts; part++) {
+    if (job->partOffset[part] > dataLen) {
+      failure(CTX_ERR_FORMAT, "Invalid compressed file");
+    }
+    checkTextLen(job->partTextLen[part], dataLen - job->partOffset[part]);
+  }
+
+  if (job->options.workers > 0 && parts > 0 && dataLen > 0) {
+    MALLOC(job->data, Uchar, dataLen);
+    if (fread(job->data, 1, dataLen, compressed_file) != dataLen) {
+      failure(CTX_ERR_IO, "Could not read input");
+    }
+    job->dataLen = dataLen;
+    CALLOC(job->partData, Uchar *, parts);
+    CALLOC(job->partDataLen, Uint, parts);
+    runWorkers(job, unzipWorkerPart);
+    for (part = 0; part < parts; part++) {
+      if (fwrite(job->partData[part], 1, job->partDataLen[part], output_file) != job->partDataLen[part]) {
+	failure(CTX_ERR_IO, "Could not write output");
+      }
+      FREE(job->partData[part]);
+    }
+    return;
+  }
+
+  for (part = 0; part < parts; part++) {
+    if (job->options.verbose) fprintf(job->options.messages, "---------- part %d ---------------\n", part + 1);
+    unzipPart(job, compressed_file, dataStart + job->partOffset[part], job->partTextLen[part], output_file);
+  }
+}
+
+
+/**
+ * Reads the substream of a block into the job buffer. The buffer grows as the data 
+ * arrives, so a corrupt length fails at the end of the input instead of allocating 
+ * its whole size first.
+ * @param[in] job the running call.
+ * @param[in] size length of the substream.
+ */
+static void readBlock(job_t job, Uint size) {
+  Uint readed = 0, chunk, alloc;
+
+  while (readed < size) {
+    if (readed == job->bufferLen) {
+      alloc = (job->bufferLen < READ_BLOCK_SIZE ? READ_BLOCK_SIZE : job->bufferLen << 1);
+      if (alloc > size) {
+	alloc = size;
+      }
+      REALLOC(job->buffer, job->buffer, Uchar, alloc);
+      job->bufferLen = alloc;
+    }
+    chunk = (size < job->bufferLen ? size : job->bufferLen) - readed;
+    if (fread(job->buffer + readed, 1, chunk, job->input) != chunk) {
+      failure(CTX_ERR_FORMAT, "Invalid compressed file");
+    }
+    readed += chunk;
+  }
+}
+
+/**
+ * Decompresses a file written as a sequence of independently coded blocks. Each block 
+ * is read into memory before decoding it, so the input does not need to seek and the
+ * memory used depends on the block size.
+ * @param[in] job the running call, the input is positioned after the magic number.
+ */
+static void unzipBlocks(job_t job) {
+  FILE *compressed_file = job->input;
+  Uint textlen, size;
+  int block = 0;
+
+  job->parts = 1;
+  CALLOC(job->streams, FILE *, 1);
+  while ((textlen = readNumber(job->lengthSize, compressed_file)) > 0) {
+    if (job->options.verbose) fprintf(job->options.messages, "---------- block %d ---------------\n", ++block);
+    size = readNumber(job->lengthSize, compressed_file);
+    if (size == 0) {
+      failure(CTX_ERR_FORMAT, "Invalid compressed file");
+    }
+    checkTextLen(textlen, size);
+    readBlock(job, size);
+    if (!(job->streams[0] = openBuffer(job->buffer, size))) {
+      failure(CTX_ERR_IO, "Could not read input");
+    }
+    unzipPart(job, job->streams[0], 0, textlen, job->output);
+    fclose(job->streams[0]);
+    job->streams[0] = NULL;
+  }
+}
+
+/**
+ * Decompresses the input stream of the call and writes the data to its output stream.
+ * @param[in] data the running call.
+ * @returns CTX_OK.
+ */
+static int unzipTask(void *data) {
+  job_t job = (job_t)data;
+  FILE *output_file = job->output, *compressed_file = job->input;
+  int header, parts, part;
+  Uint textlen;
+  decoderTree_t tree;
+  context_t ctx;
+
+  /* check magic */
+  header = getc(compressed_file) << 8;
+  header += getc(compressed_file);
+  if ((header & ~(FLAG_INDEXED | FLAG_WIDE | FLAG_BLOCKS)) != MAGIC || 
+      ((header & FLAG_INDEXED) && (header & FLAG_BLOCKS))) {
+    failure(CTX_ERR_FORMAT, "Invalid compressed file");
+  }
+  setFormat(job, header & FLAG_WIDE ? CODER_BITS_WIDE : CODER_BITS);
+  if (header & FLAG_INDEXED) {
+    if (ftell(compressed_file) == -1) {
+      /* the parts are read out of order, streams that can not seek are read into memory */
+      readAllTask(job);
+      if (job->closeInput) {
+	fclose(job->input);
+      }
+      job->input = openBuffer(job->buffer, job->bufferLen);
+      job->closeInput = True;
+      if (!job->input) {
+	failure(CTX_ERR_IO, "Could not read input");
+      }
+    }
+    unzipIndexed(job);
+    return CTX_OK;
+  }
+  if (header & FLAG_BLOCKS) {
+    unzipBlocks(job);
+    return CTX_OK;
+  }
+
+  /* read parts */
+  parts = readParts(job);
+
+  ctx = newContext(job);
+  initialize_input_bitstream(&ctx->coder);
+  initialize_arithmetic_decoder(&ctx->coder, compressed_file, job->coderBits);
+
+  readAlphabet(ctx, compressed_file);
+
+  setMaxCount(ctx);
+
+  for (part = 1; part <= parts; part++) {  
+    VERBOSE(fprintf(ctx->messages, "---------- part %d ---------------\n", part));
+    /* read textlen */
+    textlen = readCodedNumber(ctx, job->lengthSize, compressed_file);
+    if (ftell(compressed_file) != -1) {
+      /* the coder may have buffered part of the substream already */
+      checkTextLen(textlen, remainingBytes(compressed_file) + 
+		   (Uint)(ctx->coder.buffer_end - ctx->coder.current_byte));
+    }
+
+    tree = readDecoderTree(ctx, compressed_file);
+
+    VERBOSE(fprintf(ctx->messages, "Tree built\n"));
+    VERBOSE(fprintf(ctx->messages, "Textlen: %ld\n", textlen));
+    VERBOSE(fprintf(ctx->messages, "FSM...\n")); 
+    DEBUGCODE(printDecoderTree(ctx, tree));
+    makeDecoderFsm(ctx, tree);
+    DEBUGCODE(printDecoderTree(ctx, tree));
+
+    VERBOSE(fprintf(ctx->messages, "Decoding...\n"));
+    decode(ctx, tree, textlen, compressed_file, output_file, job->options.see);
+    freeDecoderTree(ctx, tree);
+  }
+  endContext(job);
+  return CTX_OK;
+}
+
+/**
+ * Checks the options and initializes the state of a new call.
+ * @param[out] job the call state.
+ * @param[in] options the call options, NULL to use the defaults.
+ * @returns CTX_OK or CTX_ERR_PARAM.
+ */
+static int initJob(job_t job, const ctxOptions *options) {
+  memset(job, 0, sizeof(struct job));
+  if (options) {
+    job->options = *options;
+  }
+  else {
+    ctxDefaultOptions(&job->options);
+  }
+  if ((job->options.algorithm != CTX_KURTZ && job->options.algorithm != CTX_UKKONEN &&
+       job->options.algorithm != CTX_SUFFIXARRAY) ||
+      job->options.parts < 1 || (job->options.legacyCoder && job->options.parts > UCHAR_MAX) || 
+      job->options.workers < 0 || job->options.threads < 0) {
+    return CTX_ERR_PARAM;
+  }
+  if (!job->options.messages) {
+    job->options.messages = stderr;
+  }
+  setFormat(job, job->options.legacyCoder ? CODER_BITS : CODER_BITS_WIDE);
+  return CTX_OK;
+}
+
+/**
+ * Maps the input file of the call in memory. Empty files and files that can not seek, 
+ * like pipes, are not mapped and must be read from the input stream.
+ * @param[in] job the running call, its input stream is open on the file.
+ * @param[in] name name and path of the file.
+ * @returns True if the file was mapped.
+ */
+static BOOL mapInput(job_t job, const char *name) {
+  if (fseek(job->input, 0, SEEK_END) != 0 || ftell(job->input) <= 0) {
+    return False;
+  }
+  rewind(job->input);
+#ifdef WIN32
+  job->text = (Uchar *) file2String((char *)name, &job->textlen, &job->hndl);
+#else
+  job->text = (Uchar *) file2String((char *)name, &job->textlen);
+#endif
+  job->mapped = (job->text != NULL);
+  return job->mapped;
+}
+
+/**
+ * @param[out] options the options to initialize.
+ */
+void ctxDefaultOptions(ctxOptions *options) {
+  options->algorithm = CTX_KURTZ;
+  options->parts = 1;
+  options->workers = 0;
+  options->threads = 0;
+  options->see = True;
+  options->legacyCoder = False;
+  options->verbose = False;
+  options->messages = NULL;
+  options->blockSize = 0;
+  options->coderBufferSize = 0;
+}
+
+/**
+ * The output buffer is allocated with malloc and must be released by the caller 
+ * with free.
+ * @param[in] input the data to compress.
+ * @param[in] inputLen length of the data to compress.
+ * @param[out] output the compressed data.
+ * @param[out] outputLen length of the compressed data.
+ * @param[in] options the call options, NULL to use the defaults.
+ * @returns CTX_OK or an error code.
+ */
+int ctxCompressBuffer(const Uchar *input, const Uint inputLen, Uchar **output, Uint *outputLen, const ctxOptions *options) {
+  struct job job;
+  int status;
+
+  if ((status = initJob(&job, options)) == CTX_OK && (status = openOutputBuffer(&job)) == CTX_OK) {
+    job.text = (Uchar *)input;
+    job.textlen = inputLen;
+    status = runProtected(zipTask, &job);
+    if (status == CTX_OK) {
+      status = closeOutputBuffer(&job, output, outputLen);
+    }
+  }
+  endJob(&job);
+  return status;
+}
+
+/**
+ * The output buffer is allocated with malloc and must be released by the caller 
+ * with free.
+ * @param[in] input the compressed data.
+ * @param[in] inputLen length of the compressed data.
+ * @param[out] output the decompressed data.
+ * @param[out] outputLen length of the decompressed data.
+ * @param[in] options the call options, NULL to use the defaults.
+ * @returns CTX_OK or an error code.
+ */
+int ctxDecompressBuffer(const Uchar *input, const Uint inputLen, Uchar **output, Uint *outputLen, const ctxOptions *options) {
+  struct job job;
+  int status;
+
+  if ((status = initJob(&job, options)) == CTX_OK && (status = openInputBuffer(&job, input, inputLen)) == CTX_OK &&
+      (status = openOutputBuffer(&job)) == CTX_OK) {
+    status = runProtected(unzipTask, &job);
+    if (status == CTX_OK) {
+      status = closeOutputBuffer(&job, output, outputLen);
+    }
+  }
+  endJob(&job);
+  return status;
+}
+
+/**
+ * If the <i>blockSize</i> option is set the input is compressed in blocks as it is read, 
+ * otherwise the whole input is read into memory before compressing it. The streams are 
+ * not closed.
+ * @param[in] input the stream to compress.
+ * @param[in] output the stream where the compressed data is written.
+ * @param[in] options the call options, NULL to use the defaults.
+ * @returns CTX_OK or an error code.
+ */
+int ctxCompressStream(FILE *input, FILE *output, const ctxOptions *options) {
+  struct job job;
+  int status;
+
+  if ((status = initJob(&job, options)) == CTX_OK) {
+    job.input = input;
+    job.output = output;
+    if (job.options.blockSize > 0) {
+      status = runProtected(zipBlocksTask, &job);
+    }
+    else if ((status = runProtected(readAllTask, &job)) == CTX_OK) {
+      job.text = job.buffer;
+      job.textlen = job.bufferLen;
+      status = runProtected(zipTask, &job);
+    }
+    if (status == CTX_OK && (fflush(output) != 0 || ferror(output))) {
+      status = CTX_ERR_IO;
+    }
+  }
+  endJob(&job);
+  return status;
+}
+
+/**
+ * Files with independent substreams are read out of order, if the input stream can 
+ * not seek it is read into memory first. Other files are decoded as they are read, 
+ * so pipes can be used. The streams are not closed.
+ * @param[in] input the stream to decompress.
+ * @param[in] output the stream where the decompressed data is written.
+ * @param[in] options the call options, NULL to use the defaults.
+ * @returns CTX_OK or an error code.
+ */
+int ctxDecompressStream(FILE *input, FILE *output, const ctxOptions *options) {
+  struct job job;
+  int status;
+
+  if ((status = initJob(&job, options)) == CTX_OK) {
+    job.input = input;
+    job.output = output;
+    status = runProtected(unzipTask, &job);
+    if (status == CTX_OK && (fflush(output) != 0 || ferror(output))) {
+      status = CTX_ERR_IO;
+    }
+  }
+  endJob(&job);
+  return status;
+}
+
+/**
+ * If the <i>blockSize</i> option is set the file is read in blocks, otherwise it is
+ * mapped in memory or, if that is not possible, read into memory.
+ * @param[in] input name and path of the file to compress.
+ * @param[in] output name and path of the compressed output file.
+ * @param[in] options the call options, NULL to use the defaults.
+ * @returns CTX_OK or an error code.
+ */
+int ctxCompressFile(const char *input, const char *output, const ctxOptions *options) {
+  struct job job;
+  int status;
+
+  if ((status = initJob(&job, options)) == CTX_OK) {
+    job.input = fopen(input, "rb");
+    job.closeInput = True;
+    job.output = fopen(output, "wb");
+    job.closeOutput = True;
+    if (!job.input || !job.output) {
+      status = CTX_ERR_IO;
+    }
+    else if (job.options.blockSize > 0) {
+      status = runProtected(zipBlocksTask, &job);
+    }
+    else {
+      if (!mapInput(&job, input) && (status = runProtected(readAllTask, &job)) == CTX_OK) {
+	job.text = job.buffer;
+	job.textlen = job.bufferLen;
+      }
+      if (status == CTX_OK) {
+	status = runProtected(zipTask, &job);
+      }
+    }
+    if (status == CTX_OK) {
+      job.closeOutput = False;
+      if (fclose(job.output) != 0) {
+	status = CTX_ERR_IO;
+      }
+    }
+  }
+  endJob(&job);
+  return status;
+}
+
+/**
+ * If workers are requested the parts of files with independent substreams are 
+ * decompressed in parallel.
+ * @param[in] input name and path of the input file.
+ * @param[in] output name and path of the output file.
+ * @param[in] options the call options, NULL to use the defaults.
+ * @returns CTX_OK or an error code.
+ */
+int ctxDecompressFile(const char *input, const char *output, const ctxOptions *options) {
+  struct job job;
+  int status;
+
+  if ((status = initJob(&job, options)) == CTX_OK) {
+    job.input = fopen(input, "rb");
+    job.closeInput = True;
+    job.output = fopen(output, "wb");
+    job.closeOutput = True;
+    if (!job.input || !job.output) {
+      status = CTX_ERR_IO;
+    }
+    else {
+      status = runProtected(unzipTask, &job);
+    }
+    if (status == CTX_OK) {
+      job.closeOutput = False;
+      if (fclose(job.output) != 0) {
+	status = CTX_ERR_IO;
+      }
+    }
+  }
+  endJob(&job);
+  return status;
+}
+
+/**
+ * @param[in] error the error code.
+ * @returns the error description.
+ */
+const char *ctxErrorString(const int error) {
+  switch (error) {
+  case CTX_OK:
+    return "No error";
+  case CTX_ERR_MEMORY:
+    return "Not enough memory";
+  case CTX_ERR_IO:
+    return "Could not read or write file";
+  case CTX_ERR_FORMAT:
+    return "Invalid compressed file";
+  case CTX_ERR_PARAM:
+    return "Invalid parameter";
+  case CTX_ERR_WORKER:
+    return "Worker failed";
+  case CTX_ERR_LIMIT:
+    return "Input too large for the selected file format";
+  default:
+    return "Unknown error";
+  }
+}
@@ -0,0 +1,96 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#ifndef LIBCONTEXT_H
+#define LIBCONTEXT_H
+
+#include <stdio.h>
+#include "types.h"
+
+/** The call succeeded. */
+#define CTX_OK 0
+
+/** There was not enough memory to complete the call. */
+#define CTX_ERR_MEMORY 1
+
+/** An input or output file could not be opened, read or written. */
+#define CTX_ERR_IO 2
+
+/** The compressed data is not valid. */
+#define CTX_ERR_FORMAT 3
+
+/** Some of the call parameters are not valid. */
+#define CTX_ERR_PARAM 4
+
+/** A worker failed. Not returned any more, the workers are threads that report the error that stopped them. */
+#define CTX_ERR_WORKER 5
+
+/** The input exceeds a limit of the selected file format. */
+#define CTX_ERR_LIMIT 6
+
+/** Ukkonen linear suffix tree contruction algorithm. */
+#define CTX_UKKONEN 1
+
+/** Kurtz suffix tree contruction algorithm. */
+#define CTX_KURTZ 2
+
+/** Suffix array and LCP interval context tree construction algorithm. */
+#define CTX_SUFFIXARRAY 3
+
+/** Block size used by the command line tool when compressing the standard input. */
+#define CTX_DEFAULT_BLOCK_SIZE (UintConst(16) << 20)
+
+/** Parameters of the compression and decompression calls. */
+typedef struct ctxOptions {
+  int algorithm; /**< Algorithm used to build the suffix tree (CTX_KURTZ, CTX_UKKONEN or CTX_SUFFIXARRAY). */
+  int parts; /**< Number of parts the input is partitioned in, at least 1 and at most 255 with the 16 bit coder. */
+  int workers; /**< Number of worker threads that code or decode the parts, 0 to process them one after the other in the calling thread. */
+  int threads; /**< Number of threads that build each context tree with the Kurtz algorithm, 0 or 1 to build it in the calling thread. */
+  BOOL see; /**< If secondary escape estimation is used. */
+  BOOL legacyCoder; /**< If the 16 bit arithmetic coder of previous versions is used instead of the 32 bit range coder. */
+  BOOL verbose; /**< If progress messages are printed. */
+  FILE *messages; /**< Stream where the progress messages are printed, NULL for the standard error. */
+  Uint blockSize; /**< Size of the blocks compressed one at a time as the input is read, 0 to compress the whole input at once. The parts and workers are ignored when it is set. */
+  Uint coderBufferSize; /**< Size of the buffer the arithmetic coder reads and writes in blocks, 0 for the small buffer inside the coder. Every part gets its own buffer of this size. */
+} ctxOptions;
+
+/** Sets the default options: Kurtz algorithm, one part, no workers, one thread, SEE, 32 bit coder, no messages, no blocks and the buffer inside the coder. */
+void ctxDefaultOptions(ctxOptions *);
+
+/** Compresses a memory buffer into a new memory buffer. */
+int ctxCompressBuffer(const Uchar *input, const Uint inputLen, Uchar **output, Uint *outputLen, const ctxOptions *);
+
+/** Decompresses a memory buffer into a new memory buffer. */
+int ctxDecompressBuffer(const Uchar *input, const Uint inputLen, Uchar **output, Uint *outputLen, const ctxOptions *);
+
+/** Compresses all the data of an input stream and writes it to an output stream. */
+int ctxCompressStream(FILE *input, FILE *output, const ctxOptions *);
+
+/** Decompresses the data of an input stream and writes it to an output stream. */
+int ctxDecompressStream(FILE *input, FILE *output, const ctxOptions *);
+
+/** Compresses a file. */
+int ctxCompressFile(const char *input, const char *output, const ctxOptions *);
+
+/** Decompresses a file. */
+int ctxDecompressFile(const char *input, const char *output, const ctxOptions *);
+
+/** Returns a description of an error code. */
+const char *ctxErrorString(const int error);
+
+#endif
@@ -16,210 +16,24 @@
    along with Context.  If not, see <http://www.gnu.org/licenses/>.
 */
  
-#include <assert.h>
-#include <math.h>
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 #include "types.h"
 #include "spacedef.h"
-#include "mapfile.h"
-#include "reverse.h"
-#include "wotd.h"
-#include "fsmTree.h"
-#include "suffixTree.h"
-#include "decoderTree.h"
-#include "encoder.h"
-#include "decoder.h"
-#include "debug.h"
-#include "alpha.h"
-#include "text.h"
-#include "reset.h"
-#include "arithmetic/coder.h"
-#include "arithmetic/bitio.h"
-
-#ifdef DEBUG
-#include "gammaFunc.h" 
-#endif
-
-/* This should be calculated sometime
-#define MAXTEXTLEN          UintConst(715827882)
-*/
-
-/** Ukkonen linear suffix tree contruction algorithm. */
-#define UKKONEN 1
-
-/** Kurtz suffix tree contruction algorithm. */
-#define KURTZ 2
-
-/** Magic number to detect valid ctx files */
-#define MAGIC 0x3276
-
-/**
- * Writes a byte to the output file using the arithmetic encoder
- * @param[in] byte the data to write
- * @param[in] file the output file
- */
-static void writeByte(int byte, FILE *file) {
-  SYMBOL s;
-
-  byte = byte & 0x000000FF;
-  s.scale = 256; 
-  s.low_count = byte;
-  s.high_count = byte + 1;
-  encode_symbol(file, &s);
-}
-
-/**
- * Reads a byte using the arithmetic decoder
- * @param[in] file the input file
- * @returns the readed byte
- */
-static int readByte(FILE *file) {
-  SYMBOL s;
-  int ret;
-
-  s.scale = 256; 
-  ret = get_current_count(&s);
-  s.low_count = ret;
-  s.high_count = ret + 1;
-  remove_symbol_from_stream(file, &s);
-
-  return ret;
-}
-
-/**
- * Writes the alphabet to the output file.
- * @param[in] file the output file.
- */
-static void writeAlphabet(FILE *file) {
-  int i, j, last = UCHAR_MAX + 1;
-  SYMBOL s;
-  long cost;
-
-  /* write alphabet size */
-  writeByte(alphasize, file);
-
-  cost = bit_ftell_output(file);
-
-  if (alphasize <= UCHAR_MAX) {
-    if (alphasize < 128) { /* send alphabet */
-      for (i=alphasize-1; i>=0; i--) {
-	s.scale = last;
-	s.low_count = characters[i];
-	s.high_count = characters[i] + 1;
-	encode_symbol(file, &s);
-	last = characters[i];
-      }
-    }
-    else { /* send complement of alphabet */
-      for (i=UCHAR_MAX, j=alphasize-1; i>=0; i--) {
-	if (j<0 || characters[j] != i) {
-	  s.scale = last;
-	  s.low_count = i;
-	  s.high_count = i+1;
-	  encode_symbol(file, &s);
-	  last = i;
-	}
-	else {
-	  j--;
-	}
-      }
-    }
-  }
-  printf("Alphabet cost: %ld\n", bit_ftell_output(file) - cost);
-}
-
+#include "libcontext.h"
 
 /**
- * Reads the alphabet from the input file.
- * @param[in] file input file.
- */
-static void readAlphabet(FILE *file) {
-  SYMBOL s;
-  int i, j, k, last = UCHAR_MAX + 1, count;
-  
-  /* read alphabet size */
-  alphasize = readByte(file);
-
-  if (alphasize == 0) alphasize = 256;
-  printf("Alphasize: %ld\n", alphasize);
-
-  if (alphasize <= UCHAR_MAX) {
-    if (alphasize < 128) { /* read alphabet */
-      for (i=alphasize-1; i>=0; i--) {
-	s.scale = last;
-	count = get_current_count(&s);
-	characters[i] = count;
-	alphaindex[characters[i]] = i;
-	last = count;
-
-	s.low_count = count;
-	s.high_count = count + 1;
-	remove_symbol_from_stream(file, &s);
-      }
-    }
-    else { /* read complement of alphabet */
-      for (i=alphasize-1, j=UCHAR_MAX, k=UCHAR_MAX - alphasize; k>=0; k--) {
-	s.scale = last;
-	count = get_current_count(&s);
-	last = count;
-
-	if (j>count) {
-	  for (; j>count; i--, j--) {
-	    characters[i] = j;
-	    alphaindex[characters[i]] = i;
-	  }
-	}
-	j = count-1;
-
-	s.low_count = count;
-	s.high_count = count + 1;
-	remove_symbol_from_stream(file, &s);
-      }
-      for (; j>0; i--, j--) {
-	characters[i] = j;
-	alphaindex[characters[i]] = i;
-      }
-    }
-  }
-  else {
-    for (i=0; i<alphasize; i++) {
-      characters[i] = i;
-      alphaindex[i] = i;
-    }
-  }
-}
-
-/**
- * Compresses the input text and writes the compressed data to a file.
+ * Compresses a file.
  * @param[in] filename name and path of the file to compress.
- * @param[in] compressed name and path of the compressed output file.
- * @param[in] algorithm the algorithm that will be used to build the suffix tree (Ukkonnen or Kurtz).
- * @param[in] see if see will be used.
+ * @param[in] compressed name and path of the compressed output file, NULL to append .ctx to the input file name.
+ * @param[in] options the compression options.
+ * @returns CTX_OK or an error code.
  */
-static void zip(char *filename, char *compressed, BOOL algorithm, int parts, BOOL see) {
-  Uchar *origText, *prevText = NULL;
-  Uint origTextLen, partTextLen, currentTextLen;
-  FILE *compressed_file;
-  int i, part;
-  fsmTree_t stree = NULL, prevTree = NULL;
+static int zip(char *filename, char *compressed, ctxOptions *options) {
   BOOL alloc = False;
-
-#ifdef WIN32
-  HANDLE hndl;
-  origText = (Uchar *) file2String(filename, &origTextLen, &hndl);
-#else
-  origText = (Uchar *) file2String(filename, &origTextLen);
-#endif
-
-  if(origText == NULL) {
-    fprintf(stderr,"Cannot open file %s\n", filename);
-    exit(EXIT_FAILURE);
-  }
-  /*if(textLen > MAXTEXTLEN)
-    {
-    fprintf(stderr,"Sorry, textlen = %lu is larger than maximal textlen = %lu\n",
-    (Showuint) textLen,(Showuint) MAXTEXTLEN);
-    exit(EXIT_FAILURE);
-    }*/
+  int status;
 
   if (!compressed) {
     CALLOC(compressed, Uchar, strlen(filename) + 5);
@@ -228,183 +42,70 @@ static void zip(char *filename, char *compressed, BOOL algorithm, int parts, BOO
     alloc = True;
   }
 
-  compressed_file = fopen(compressed, "wb");
-  if (!compressed_file) {
-    printf( "Could not open output file");
-    exit(1);
-  }
+  status = ctxCompressFile(filename, compressed, options);
   if (alloc) FREE(compressed);
+  return status;
+}
 
-  buildAlpha(origText, origTextLen);
-  printf ("Alphasize: %ld\n", alphasize);
-  printf("Algorithm %d\n", algorithm);
-
-  setMaxCount();
-
-  /* write magic number */
-  putc(MAGIC >> 8, compressed_file);
-  putc(MAGIC, compressed_file);
-  /* write # of parts */
-  putc(parts, compressed_file);
-
-  initialize_output_bitstream();
-  initialize_arithmetic_encoder();
-
-  writeAlphabet(compressed_file);
-
-  currentTextLen = 0;
-  for (part = 1; part <= parts; part++) {
-    printf("---------- part %d ---------------\n", part);
-    if (part != parts) {
-      partTextLen = floor(origTextLen / parts);
-    }
-    else {
-      partTextLen = origTextLen - (floor(origTextLen / parts) * (parts - 1));
-    }
- 
-    if (part > 1) {
-      prevText = text;
-      prevTree = stree;
-    }
-
-    textlen = partTextLen;
-    CALLOC(text, Uchar, textlen);
-    reversestring(origText + currentTextLen, textlen, text);
-    
-    if (algorithm == UKKONEN) {
-      suffixTree_t tree = initSuffixTree();
-      buildSuffixTree(tree);
-      printf("Tree built\n");
-      pruneSuffixTree(tree);
-      stree = fsmSuffixTree(tree);   
-    }
-    else {
-      stree = buildSTree();
-      printf("Tree built\n");
-    }
-
-    /*if (part > 1) {
-      copyStatistics(prevTree, stree, prevText);
-      FREE(prevText);
-      freeFsmTree(prevTree);
-    }*/
-
-    DEBUGCODE(printf("gamma hits: %d gamma Misses: %d\n", getHits(), getMisses()));
-    printf("height: %ld\n", getHeight(stree));
-
-    /* write textlen */
-    for (i=3; i>=0; i--) {
-      writeByte(textlen >> (8 * i), compressed_file);
-    }
-    printf ("Textlen: %ld\n", textlen);
-    writeFsmTree(stree, compressed_file);
-    printf("FSM...\n");
-    makeFsm(stree);
-    DEBUGCODE(printFsmTree(stree));
-    printf("Encoding...\n");
-
-    encode(stree, compressed_file, origText + currentTextLen, partTextLen, see);
-    
-    currentTextLen += partTextLen;
-  }
-
-  FREE(text);
-  freeFsmTree(stree);
 
-  flush_arithmetic_encoder(compressed_file);
-  flush_output_bitstream(compressed_file);
+/**
+ * Compresses or decompresses a file or the standard input and writes the result to
+ * the standard output. Compression is done in blocks.
+ * @param[in] filename name and path of the input file, NULL to read the standard input.
+ * @param[in] compress True to compress, False to decompress.
+ * @param[in] options the call options.
+ * @returns CTX_OK or an error code.
+ */
+static int toStandardOutput(char *filename, BOOL compress, ctxOptions *options) {
+  FILE *input = stdin;
+  int status;
 
 #ifdef WIN32
-  freetextspace(origText, hndl);
-#else
-  freetextspace(origText, origTextLen);
+  _setmode(_fileno(stdin), _O_BINARY);
+  _setmode(_fileno(stdout), _O_BINARY);
 #endif
-
-  fclose(compressed_file);
+  if (filename && !(input = fopen(filename, "rb"))) {
+    return CTX_ERR_IO;
+  }
+  if (compress) {
+    status = ctxCompressStream(input, stdout, options);
+  }
+  else {
+    status = ctxDecompressStream(input, stdout, options);
+  }
+  if (filename) fclose(input);
+  return status;
 }
 
 
 /**
- * Decompresses the data in an input file and writes it in a new file.
+ * Decompresses a file.
  * @param[in] filename name and path of the input file.
- * @param[in] output name and path of the output file.
- * @param[in] see if see will be used.
+ * @param[in] output name and path of the output file, NULL to remove the extension of the input file name.
+ * @param[in] options the decompression options.
+ * @returns CTX_OK or an error code.
  */
-static void unzip(char *filename, char *output, BOOL see) {
-  FILE *output_file, *compressed_file;
-  int i, header, parts, part;
-  Uint textlen = 0;
-  decoderTree_t tree;
-
-  initDecoderTreeStack();
-
-  compressed_file = fopen(filename, "rb");
-  if (!compressed_file) {
-    perror( "Could not open input file");
-    exit(1);
-  }
+static int unzip(char *filename, char *output, ctxOptions *options) {
+  char *ext;
+  BOOL alloc = False;
+  int status;
 
   if (!output) {
-    output = strrchr(filename, '.');
-    if (output) {
-      *output = '\0';
+    CALLOC(output, char, strlen(filename) + 5);
+    strcpy(output, filename);
+    ext = strrchr(output, '.');
+    if (ext) {
+      *ext = '\0';
     } 
     else {
-      strcat(filename, ".out");
+      strcat(output, ".out");
     }
-    output = filename;
-  }
-
-  output_file = fopen(output, "wb");
-  if (!output_file) {
-    perror( "Could not open output file");
-    exit(1);
-  }
-
-  /* check magic */
-  header = getc(compressed_file) << 8;
-  header += getc(compressed_file);
-  if (header != MAGIC) {
-    fprintf(stderr, "Invalid compressed file\n");
-    exit(1);
+    alloc = True;
   }
 
-  /* read parts */
-  parts = getc(compressed_file);
-
-  initialize_input_bitstream();
-  initialize_arithmetic_decoder(compressed_file);
-
-  readAlphabet(compressed_file);
-
-  setMaxCount();
-
-  for (part = 1; part <= parts; part++) {  
-    printf("---------- part %d ---------------\n", part);
-    /* read textlen */
-    for (textlen=0, i=3; i>=0; i--) {
-      textlen += readByte(compressed_file) << (8 * i);
-    }
-
-    /*if (part == 1) {*/
-      tree = readDecoderTree(compressed_file);
-      /*}*/
-
-    printf("Tree built\n");
-    printf("Textlen: %ld\n", textlen);
-    printf("FSM...\n"); 
-    /*if (part == 1) {*/
-    DEBUGCODE(printDecoderTree(tree));
-    makeDecoderFsm(tree);
-    DEBUGCODE(printDecoderTree(tree));
-      /*}*/
-
-    printf("Decoding...\n");
-    decode(tree, textlen, compressed_file, output_file, see);
-  }
-  /*freeDecoderTree(tree);*/
-  fclose(compressed_file);
-  fclose(output_file);
+  status = ctxDecompressFile(filename, output, options);
+  if (alloc) FREE(output);
+  return status;
 }
 
 
@@ -418,12 +119,19 @@ static void printUsage (char *progname) {
   fprintf(stderr, "\t-z: compress (default)\n"); 
   fprintf(stderr, "\t-d: decompress (default if invoked as hpunzip)\n"); 
   fprintf(stderr, "\t-s: use secondary espace estimation (SEE)\n"); 
+  fprintf(stderr, "\t-t <num>: number of parallel workers\n"); 
+  fprintf(stderr, "\t-c: read the input file or the standard input and write to the standard output\n"); 
   fprintf(stderr, "\t-h: show this message\n"); 
 
   fprintf(stderr, "\nOptions for compression only:\n");
   fprintf(stderr, "\t-k: use Kurtz algorithm (default)\n"); 
   fprintf(stderr, "\t-u: use Ukkonnen algorithm (default with -b)\n"); 
+  fprintf(stderr, "\t-a: use suffix array algorithm\n"); 
+  fprintf(stderr, "\t-B <num>: compress in blocks of <num> KiB as the input is read\n");
   fprintf(stderr, "\t-p <num>: number of parts to partition the file\n");
+  fprintf(stderr, "\t-l: use the 16 bit arithmetic coder of previous versions\n");
+  fprintf(stderr, "\t-T <num>: number of threads that build each context tree\n");
+  fprintf(stderr, "\t(with -t the parts are compressed as independent streams)\n");
 }
 
 
@@ -435,9 +143,14 @@ static void printUsage (char *progname) {
  */
 int main(int argc,char *argv[])
 {
-  int i, algorithm = 0, parts = 1;
-  BOOL compress, see = True;
+  int i, parts = 0, status;
+  BOOL compress, toStdout = False;
   char *error = NULL, *pos;
+  ctxOptions options;
+
+  ctxDefaultOptions(&options);
+  options.verbose = True;
+  options.messages = stdout;
 
 #ifdef WIN32  
   pos = strrchr(argv[0], '\\');
@@ -463,18 +176,47 @@ int main(int argc,char *argv[])
       compress = True;
       break;
     case 'k':
-      algorithm = KURTZ;
+      options.algorithm = CTX_KURTZ;
       break;
     case 'u':
-      algorithm = UKKONEN;
+      options.algorithm = CTX_UKKONEN;
+      break;
+    case 'a':
+      options.algorithm = CTX_SUFFIXARRAY;
       break;
     case 's':
-      see = True;
+      options.see = True;
+      break;
+    case 'l':
+      options.legacyCoder = True;
+      break;
+    case 'c':
+      toStdout = True;
+      break;
+    case 'B':
+      i++;
+      options.blockSize = (Uint)atol(argv[i]) << 10;
+      if (options.blockSize == 0) {
+	error = "Invalid block size";
+      }
       break;
     case 'p':
       i++;
       parts = atoi(argv[i]);
-      assert(parts < 256);
+      break;
+    case 't':
+      i++;
+      options.workers = atoi(argv[i]);
+      if (options.workers < 1) {
+	error = "Invalid number of workers";
+      }
+      break;
+    case 'T':
+      i++;
+      options.threads = atoi(argv[i]);
+      if (options.threads < 1) {
+	error = "Invalid number of threads";
+      }
       break;
     case 'h':
       printUsage(argv[0]);
@@ -486,35 +228,42 @@ int main(int argc,char *argv[])
     i++;
   }
 
-  if (parts < 1) {
+  if (parts == 0) {
+    parts = (options.workers > 0 && (!options.legacyCoder || options.workers <= UCHAR_MAX) ? options.workers : 1); 
+  }
+  else if (parts < 1) {
     error = "Invalid number of parts";
   }
+  options.parts = parts;
 
-  MAX_COUNT = 300;
-  /*MAX_COUNT = ceil(510/log((alphasize <= 91 ? 2 : alphasize - 90)));*/
-
-  if (!error && argc > i) {
-    if (algorithm == 0) {
-      algorithm = KURTZ;
+  if (toStdout) {
+    /* progress messages would be mixed with the output data */
+    options.verbose = False;
+    if (options.blockSize == 0) {
+      options.blockSize = CTX_DEFAULT_BLOCK_SIZE;
     }
+  }
 
+  if (!error && toStdout) {
+    status = toStandardOutput(argc > i ? argv[i] : NULL, compress, &options);
+    if (status != CTX_OK) {
+      fprintf(stderr, "%s\n", ctxErrorString(status));
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+  else if (!error && argc > i) {
     if (compress) {
-      if (argc > i+1) {
-	zip(argv[i], argv[i+1], algorithm, parts, see);
-      }
-      else {
-	zip(argv[i], NULL, algorithm, parts, see);
-      }
+      status = zip(argv[i], argc > i+1 ? argv[i+1] : NULL, &options);
     }
     else {
-      if (argc > i+1) {
-	unzip(argv[i], argv[i+1], see);
-      }
-      else {
-	unzip(argv[i], NULL, see);
-      }
+      status = unzip(argv[i], argc > i+1 ? argv[i+1] : NULL, &options);
     }
 
+    if (status != CTX_OK) {
+      fprintf(stderr, "%s\n", ctxErrorString(status));
+      return EXIT_FAILURE;
+    }
     printf("\n");
     return EXIT_SUCCESS;
   }
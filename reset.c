@@ -19,10 +19,8 @@
 #include "reset.h"
 #include "alpha.h"
 
-Uint MAX_COUNT;
-
-void setMaxCount() {
-  /*MAX_COUNT = 20000;*/
-  /*MAX_COUNT = ceil(510/log((alphasize <= 91 ? 2 : alphasize - 90)));*/
-  MAX_COUNT = (alphasize <= 100 ? 450 : 200);
+void setMaxCount(context_t ctx) {
+  /*ctx->maxCount = 20000;*/
+  /*ctx->maxCount = ceil(510/log((ctx->alphasize <= 91 ? 2 : ctx->alphasize - 90)));*/
+  ctx->maxCount = (ctx->alphasize <= 100 ? 450 : 200);
 }
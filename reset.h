@@ -20,11 +20,9 @@
 #define RESET_H
 
 #include "types.h"
-
-/** Reset threshold. */
-extern Uint MAX_COUNT;
+#include "context.h"
 
 /** Sets the reset threshold */
-void setMaxCount();
+void setMaxCount(context_t);
 
 #endif
@@ -55,7 +55,8 @@ void reversestring(Uchar *s, Uint len, Uchar *sreverse) {
  */
 void reverseString2Binary(Uchar *s, Uint len, Uchar *sreverse, Uint revLength) {
   char ch;
-  int pos, i;
+  Uint pos;
+  int i;
 
   for(pos = 0, sreverse += revLength-1; pos != len; s++, pos++){
     ch = *s;
@@ -33,7 +33,12 @@ static int get3ByteRepresentation (const Uint num, const Uint alphasize) {
 }
 
 /**
- * @param[in] tree current node of the tree
+ * The symbols of a state are always a subset of those of its parent, so the number of
+ * symbols only grows towards the root and the first ancestor with a different number has
+ * more symbols. The state only tells if it has 0, 1, 2 or more symbols, so the ancestors
+ * are not visited when the current state already has 3.
+ * @param[in] model model of the text
+ * @param[in] orig statistics of the current state
  * @param[in] allCount total number of symbols observed in this state 
  * @param[in] pos position of the current character in the input text
  * @param[in] numMasked number of masked characters in the current state
@@ -41,7 +46,8 @@ static int get3ByteRepresentation (const Uint num, const Uint alphasize) {
  * @param[in] alphasize text alphabet size
  * @returns 
  */
-int getSeeStateEncoder (fsmTree_t tree, Uint allCount, Uint pos, Uint numMasked, const Uchar * text, Uint alphasize) {
+int getSeeStateEncoder (fsmModel_t model, Uint32 orig, Uint allCount, Uint pos, Uint numMasked, const Uchar * text, Uint alphasize) {
+  fsmStats *tree = model->stats + orig;
   Uint state, syms; 
 
   if (allCount >= (alphasize >= 150 ? 128 : 30)) {
@@ -62,8 +68,10 @@ int getSeeStateEncoder (fsmTree_t tree, Uint allCount, Uint pos, Uint numMasked,
   syms = tree->totalSyms;
   /************/
   if (alphasize < 150) {
-    while (!isRootFsmTree(tree) && tree->totalSyms == syms) {
-      tree = tree->parent->origin;
+    /* the ancestors have all the symbols of a state, so the walk only matters for less than 3 */
+    while (syms < 3 && orig != MODEL_ROOT && tree->totalSyms == syms) {
+      orig = tree->parent;
+      tree = model->stats + orig;
     }
     state <<=2;
     if (tree->totalSyms > 3) {
@@ -83,7 +91,11 @@ int getSeeStateEncoder (fsmTree_t tree, Uint allCount, Uint pos, Uint numMasked,
   return state;
 }
 
-int getSeeStateDecoder (decoderTree_t tree, Uint allCount, Uint pos, Uint numMasked, const Uchar * text, Uint alphasize) {
+/**
+ * Returns the SEE state of a decoder state, as getSeeStateEncoder does for the encoder.
+ * @param[in] history decoded text in reverse order, starting at the current character.
+ */
+int getSeeStateDecoder (decoderStats_t tree, Uint allCount, Uint pos, Uint numMasked, const Uchar * history, Uint alphasize) {
   Uint state, syms;
 
   if (allCount >= (alphasize >= 150 ? 128 : 30)) {
@@ -101,8 +113,8 @@ int getSeeStateDecoder (decoderTree_t tree, Uint allCount, Uint pos, Uint numMas
   syms = tree->totalSyms;
   /************/
   if (alphasize < 150) {
-    while (!isRootDecoderTree(tree) && tree->totalSyms == syms) {
-      tree = tree->parent->origin;
+    while (syms < 3 && tree->parent && tree->totalSyms == syms) {
+      tree = tree->parent;
     }
     state <<=2;
     if (tree->totalSyms > 3) {
@@ -115,38 +127,38 @@ int getSeeStateDecoder (decoderTree_t tree, Uint allCount, Uint pos, Uint numMas
   /************/
 
   state <<=3;
-  if ((pos > 0) && (text[pos-1] > 0)) {
-    state |= (int)(log(text[pos-1])+0.5);
+  if ((pos > 0) && (history[1] > 0)) {
+    state |= (int)(log(history[1])+0.5);
   }
 
   return state;
 }
   
-void updateSee (Uint state, BOOL escape, Uint alphasize) {
+void updateSee (context_t ctx, Uint state, BOOL escape, Uint alphasize) {
   if (escape) {
-    See[state][0] += 17;
-    See[state][1] += 18;
+    ctx->See[state][0] += 17;
+    ctx->See[state][1] += 18;
   }
   else {
-    if (See[state][0] >= (alphasize >= 100 ? 500 : 4000)) {
-      See[state][0] = (See[state][0] >> 1) + 1;
-      See[state][1] = (See[state][1] >> 1) + 1;
+    if (ctx->See[state][0] >= (alphasize >= 100 ? 500 : 4000)) {
+      ctx->See[state][0] = (ctx->See[state][0] >> 1) + 1;
+      ctx->See[state][1] = (ctx->See[state][1] >> 1) + 1;
     }
-    See[state][1] += (alphasize >= 100 ? 16 : 17);
+    ctx->See[state][1] += (alphasize >= 100 ? 16 : 17);
   }
 
-  if (See[state][1] >= (alphasize >= 100 ? 800 : 8000)) {
-    See[state][0] = (See[state][0] >> 1) + 1;
-    See[state][1] = (See[state][1] >> 1) + 1;
+  if (ctx->See[state][1] >= (alphasize >= 100 ? 800 : 8000)) {
+    ctx->See[state][0] = (ctx->See[state][0] >> 1) + 1;
+    ctx->See[state][1] = (ctx->See[state][1] >> 1) + 1;
   }
 }
 
-void initSee () {
+void initSee (context_t ctx) {
   int i=0;
 
-  for (i=0; i< 1<<14; i++) {
-    See[i][0]=20;
-    See[i][1]=50;
+  for (i=0; i< SEE_SIZE; i++) {
+    ctx->See[i][0]=20;
+    ctx->See[i][1]=50;
   }
 }
 
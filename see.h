@@ -20,22 +20,20 @@
 #define SEE_H
 
 #include "types.h"
-#include "fsmTree.h"
+#include "context.h"
+#include "fsmModel.h"
 #include "decoderTree.h"
 
-/** SEE table structure */
-Uint See[1<<14][2];
-
 /** Returns the contents of the SEE table for the encoder */
-int getSeeStateEncoder (fsmTree_t tree, Uint allCount, Uint pos, Uint numMasked, const Uchar * text, Uint alphasize);
+int getSeeStateEncoder (fsmModel_t model, Uint32 orig, Uint allCount, Uint pos, Uint numMasked, const Uchar * text, Uint alphasize);
 
 /** Returns the contents of the SEE table for the encoder */
-int getSeeStateDecoder (decoderTree_t tree, Uint allCount, Uint pos, Uint numMasked, const Uchar * text, Uint alphasize);
+int getSeeStateDecoder (decoderStats_t tree, Uint allCount, Uint pos, Uint numMasked, const Uchar * history, Uint alphasize);
 
 /** Updates the SEE table */
-void updateSee (Uint state, BOOL escape, Uint alphasize);
+void updateSee (context_t ctx, Uint state, BOOL escape, Uint alphasize);
 
 /** Initalizes the SEE table */
-void initSee ();
+void initSee (context_t);
 
 #endif
@@ -21,6 +21,11 @@
 #include <string.h>
 #include "types.h"
 
+/** 
+ * Reports a failed allocation. Returns an out of memory error from the running library 
+ * call, outside library calls prints the error and exits.
+ */
+void allocationFailed(char *file, Uint line, char *function, Uint size);
 
 /** 
  * Resizes a block of memory.
@@ -44,10 +49,8 @@
         V = REALLOCSPACE(S,T,N);\
         if((V) == NULL)\
         {\
-          fprintf(stderr,"file %s, line %lu: realloc(%lu) failed\n",\
-                  __FILE__,(Showuint) __LINE__,\
-                  (Showuint) (sizeof(T) * (size_t) (N)));\
-          exit(EXIT_FAILURE);\
+          allocationFailed(__FILE__, __LINE__, "realloc",\
+                           (Uint) (sizeof(T) * (size_t) (N)));\
         }
 
 
@@ -72,19 +75,15 @@
 #define CALLOC(S,T,N)\
         S = calloc(sizeof(T), N);\
         if ((S) == NULL) {\
-          fprintf(stderr,"file %s, line %lu: calloc(%lu) failed\n",\
-                  __FILE__,(Showuint) __LINE__,\
-                  (Showuint) (sizeof(T) * (size_t) (N)));\
-          exit(EXIT_FAILURE);\
+          allocationFailed(__FILE__, __LINE__, "calloc",\
+                           (Uint) (sizeof(T) * (size_t) (N)));\
         }
         
 #define MALLOC(S,T,N)\
         S = malloc(sizeof(T) * N);\
         if ((S) == NULL) {\
-          fprintf(stderr,"file %s, line %lu: calloc(%lu) failed\n",\
-                  __FILE__,(Showuint) __LINE__,\
-                  (Showuint) (sizeof(T) * (size_t) (N)));\
-          exit(EXIT_FAILURE);\
+          allocationFailed(__FILE__, __LINE__, "malloc",\
+                           (Uint) (sizeof(T) * (size_t) (N)));\
         }
 
 #endif
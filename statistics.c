@@ -19,19 +19,16 @@
 #include "statistics.h"
 #include "alpha.h"
 #include "spacedef.h"
-#include "stack.h"
-
-static Uint stacktop=0, stackalloc=0, *stack = NULL;
 
 /**
  * @returns a new statistics instance.
  */
-statistics_t allocStatistics() {
+statistics_t allocStatistics(context_t ctx) {
   statistics_t st;
 
   CALLOC(st, struct statistics, 1);
-  CALLOC(st->count, Uint, alphasize);
-  CALLOC(st->symbols, Uchar, alphasize);
+  CALLOC(st->count, Uint, ctx->alphasize);
+  CALLOC(st->symbols, Uchar, ctx->alphasize);
   return st;
 }
 
@@ -46,38 +43,41 @@ void freeStatistics(statistics_t st) {
 }
 
 /**
+ * @param[in] buffer buffer of the tree builder.
  * @returns a statistics instace
  */
-statistics_t getStatistics() {
-  Uint statsPtr;
-
-  if (NOTSTACKEMPTY) {
-    POPNODE(statsPtr);
-    return (statistics_t)statsPtr;
+statistics_t getStatistics(context_t ctx, statsBuffer_t buffer) {
+  if (buffer->top > 0) {
+    return (statistics_t)buffer->stats[--buffer->top];
   }
   else {
-    return allocStatistics();
+    return allocStatistics(ctx);
   }
 }
 
 /**
+ * @param[in] buffer buffer of the tree builder.
  * @param[in] st the statistics to return to the buffer
  */
-void returnStatistics(statistics_t st) {
-  memset(st->count, 0, alphasize * sizeof(Uint));
-  memset(st->symbols, 0, alphasize * sizeof(Uchar));
+void returnStatistics(context_t ctx, statsBuffer_t buffer, statistics_t st) {
+  memset(st->count, 0, ctx->alphasize * sizeof(Uint));
+  memset(st->symbols, 0, ctx->alphasize * sizeof(Uchar));
   st->symbolCount = 0;
   st->cost = 0;
-  PUSHNODE((Uint)st);
+  if (buffer->top >= buffer->alloc) {
+    buffer->alloc += 100;
+    REALLOC(buffer->stats, buffer->stats, Uint, buffer->alloc);
+  }
+  buffer->stats[buffer->top++] = (Uint)st;
 }
 
-void freeBuffer() {
-  Uint statsPtr;
-
-  while (NOTSTACKEMPTY) {
-    POPNODE(statsPtr);
-    freeStatistics((statistics_t)statsPtr);
+/**
+ * @param[in] buffer the buffer to empty.
+ */
+void freeBuffer(statsBuffer_t buffer) {
+  while (buffer->top > 0) {
+    freeStatistics((statistics_t)buffer->stats[--buffer->top]);
   }
-  FREE(stack);
-  stacktop = stackalloc = 0;
+  FREE(buffer->stats);
+  buffer->alloc = 0;
 }
@@ -20,6 +20,7 @@
 #define STATISTICS_H
 
 #include "types.h"
+#include "context.h"
 
 /** Structure that saves statistics for each tree node in the encoder. */
 typedef struct statistics {
@@ -30,19 +31,19 @@ typedef struct statistics {
 } *statistics_t;
 
 /** Creates and initializes a new statistics structure instance. */
-statistics_t allocStatistics();
+statistics_t allocStatistics(context_t);
 
 /** Deletes a statistics structure instance. */
 void freeStatistics(statistics_t);
 
 /** Returns a new statistics structure, can be created or obtained from the buffer */
-statistics_t getStatistics();
+statistics_t getStatistics(context_t, statsBuffer_t);
 
 /** Puts a statistics structure that is no longer used into the buffer */
-void returnStatistics(statistics_t);
+void returnStatistics(context_t, statsBuffer_t, statistics_t);
 
 /** Deletes all statistics stored in the buffer */
-void freeBuffer();
+void freeBuffer(statsBuffer_t);
 
 #endif
 
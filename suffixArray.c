@@ -0,0 +1,774 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#include <string.h>
+#include <assert.h>
+#include "types.h"
+#include "spacedef.h"
+#include "fsmTree.h"
+#include "children.h"
+#include "alpha.h"
+#include "gammaFunc.h"
+#include "statistics.h"
+#include "failure.h"
+#include "libcontext.h"
+#include "suffixArray.h"
+
+/** Index of the suffix and LCP arrays. 32 bits are enough for a part and halve their space. */
+typedef int saIndex;
+
+/** Maximal length of the text, its positions and the sentinel must fit in a positive saIndex. */
+#define MAXSATEXTLEN ((UintConst(1) << 31) - 2)
+
+/** Masks of the bits of a byte of the type array. */
+static const Uchar typeMask[] = {0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
+
+/**
+ * Tells if a suffix is of type S, that is smaller than the next suffix. Needs the type array in a
+ * variable called t.
+ * @param[in] I the position of the suffix.
+ */
+#define TGET(I) ((t[(I) >> 3] & typeMask[(I) & 7]) ? 1 : 0)
+
+/**
+ * Sets the type of a suffix. Needs the type array in a variable called t.
+ * @param[in] I the position of the suffix.
+ * @param[in] B 1 for type S, 0 for type L.
+ */
+#define TSET(I,B) t[(I) >> 3] = (B) ? (t[(I) >> 3] | typeMask[(I) & 7]) : (t[(I) >> 3] & ~typeMask[(I) & 7])
+
+/**
+ * Returns a symbol of the string being sorted. At the top level it is the text shifted by one, 
+ * followed by a 0 sentinel, at the reduced levels it is an array of names.
+ * @param[in] I the position of the symbol.
+ */
+#define CHR(I) (text ? ((I) == n - 1 ? 0 : (saIndex)text[I] + 1) : s[I])
+
+/**
+ * Tells if a suffix is leftmost S-type, that is of type S and preceded by an L-type suffix.
+ * @param[in] I the position of the suffix.
+ */
+#define ISLMS(I) ((I) > 0 && TGET(I) && !TGET((I) - 1))
+
+/** Node of the context tree while it is built from the suffix array. */
+typedef struct saNode {
+  Uint start, /**< Smallest position where the suffixes below this node start, the suffix of a leaf. */
+       depth, /**< Length of the label of this node from the root. */
+       parentDepth, /**< Length of the label of the parent node. */
+       lb, /**< Leftmost index of the suffixes of a node that is not evaluated in the suffix array. */
+       rb; /**< Rightmost index of the suffixes of a node that is not evaluated in the suffix array. */
+  BOOL leaf, /**< If this node is a leaf. */
+       pruned; /**< If the children of this node have been pruned. */
+  statistics_t stats; /**< Symbols that precede this context and cost of its subtree, NULL for leaves and nodes not evaluated yet. */
+  struct saNode *child, /**< First child of this node. */
+                *sibling; /**< Next sibling of this node. */
+} *saNode_t;
+
+/** Interval of the LCP array that is still open while the suffix array is traversed. */
+typedef struct saInterval {
+  Uint depth, /**< Longest common prefix of the suffixes of the interval. */
+       lb, /**< Leftmost index of the interval in the suffix array. */
+       start; /**< Smallest position where the suffixes of the interval seen so far start. */
+  saNode_t children; /**< Children found so far, in reverse order. */
+  BOOL deep; /**< If the interval below it is at least MAX_HEIGHT deep, so the node is never evaluated and its children are not kept. */
+} saInterval;
+
+/** State of the builder. */
+typedef struct sarray {
+  context_t ctx; /**< Context that holds the text and its alphabet. */
+  saIndex *sa, /**< Suffix array of the text, preceded by the sentinel suffix. */
+          *suffixes, /**< Suffix array of the text without the sentinel. */
+          *plcp; /**< Longest common prefix of each suffix and the previous one in the suffix array. */
+  saInterval *stack; /**< Open intervals, the root first. */
+  Uint stacktop, /**< Number of open intervals. */
+       stackalloc, /**< Allocated size of the stack. */
+       *distinct, /**< Number of children of a node where each symbol occurs. */
+       *minpos; /**< Smallest position where each symbol occurs in a node that is not evaluated. */
+  saNode_t *children, /**< Children of the node being evaluated. */
+           freeNodes; /**< Nodes that can be reused. */
+} *sarray_t;
+
+
+/**
+ * Computes the start or end of each bucket of the string being sorted.
+ * @param[in] text the text at the top level, NULL at the reduced levels.
+ * @param[in] s the string of names at the reduced levels.
+ * @param[in] n length of the string, including the sentinel.
+ * @param[out] bkt the buckets.
+ * @param[in] K largest symbol of the string.
+ * @param[in] end True to compute the end of the buckets, False to compute their start.
+ */
+static void getBuckets(const Uchar *text, const saIndex *s, saIndex n, saIndex *bkt, saIndex K, BOOL end) {
+  saIndex i, sum = 0;
+
+  for (i = 0; i <= K; i++) {
+    bkt[i] = 0;
+  }
+  for (i = 0; i < n; i++) {
+    bkt[CHR(i)]++;
+  }
+  for (i = 0; i <= K; i++) {
+    sum += bkt[i];
+    bkt[i] = end ? sum : sum - bkt[i];
+  }
+}
+
+/**
+ * Induces the order of the L-type suffixes from the sorted leftmost S-type ones.
+ * @param[in] t the type array.
+ * @param[in,out] SA the suffix array being built.
+ * @param[in] text the text at the top level, NULL at the reduced levels.
+ * @param[in] s the string of names at the reduced levels.
+ * @param[in] n length of the string, including the sentinel.
+ * @param[out] bkt the buckets.
+ * @param[in] K largest symbol of the string.
+ */
+static void induceL(const Uchar *t, saIndex *SA, const Uchar *text, const saIndex *s, saIndex n, saIndex *bkt, saIndex K) {
+  saIndex i, j;
+
+  getBuckets(text, s, n, bkt, K, False);
+  for (i = 0; i < n; i++) {
+    j = SA[i] - 1;
+    if (j >= 0 && !TGET(j)) {
+      SA[bkt[CHR(j)]++] = j;
+    }
+  }
+}
+
+/**
+ * Induces the order of the S-type suffixes from the sorted L-type ones.
+ * @param[in] t the type array.
+ * @param[in,out] SA the suffix array being built.
+ * @param[in] text the text at the top level, NULL at the reduced levels.
+ * @param[in] s the string of names at the reduced levels.
+ * @param[in] n length of the string, including the sentinel.
+ * @param[out] bkt the buckets.
+ * @param[in] K largest symbol of the string.
+ */
+static void induceS(const Uchar *t, saIndex *SA, const Uchar *text, const saIndex *s, saIndex n, saIndex *bkt, saIndex K) {
+  saIndex i, j;
+
+  getBuckets(text, s, n, bkt, K, True);
+  for (i = n - 1; i >= 0; i--) {
+    j = SA[i] - 1;
+    if (j >= 0 && TGET(j)) {
+      SA[--bkt[CHR(j)]] = j;
+    }
+  }
+}
+
+/**
+ * Sorts the suffixes of a string with the SA-IS algorithm of Nong, Zhang and Chan. The leftmost 
+ * S-type substrings are sorted by induction and named, the string of their names is sorted
+ * recursively if the names are not unique and the order of all suffixes is induced from it.
+ * @param[in] text the text at the top level, NULL at the reduced levels.
+ * @param[in] s the string of names at the reduced levels, it must end with a unique 0.
+ * @param[out] SA the suffix array, with space for n indexes.
+ * @param[in] n length of the string, including the sentinel, at least 2.
+ * @param[in] K largest symbol of the string.
+ */
+static void sais(const Uchar *text, const saIndex *s, saIndex *SA, saIndex n, saIndex K) {
+  Uchar *t;
+  saIndex *bkt, *s1, i, j, n1, name, prev, pos, d;
+  BOOL diff;
+
+  /* classify the suffixes, the sentinel is S-type and the one before it L-type */
+  CALLOC(t, Uchar, n / 8 + 1);
+  TSET(n - 1, 1);
+  for (i = n - 3; i >= 0; i--) {
+    TSET(i, (CHR(i) < CHR(i + 1) || (CHR(i) == CHR(i + 1) && TGET(i + 1))) ? 1 : 0);
+  }
+
+  /* sort the leftmost S-type substrings */
+  CALLOC(bkt, saIndex, K + 1);
+  getBuckets(text, s, n, bkt, K, True);
+  for (i = 0; i < n; i++) {
+    SA[i] = -1;
+  }
+  for (i = 1; i < n; i++) {
+    if (ISLMS(i)) {
+      SA[--bkt[CHR(i)]] = i;
+    }
+  }
+  induceL(t, SA, text, s, n, bkt, K);
+  induceS(t, SA, text, s, n, bkt, K);
+  FREE(bkt);
+
+  /* compact them in the first n1 entries, n1 is at most n / 2 */
+  n1 = 0;
+  for (i = 0; i < n; i++) {
+    if (ISLMS(SA[i])) {
+      SA[n1++] = SA[i];
+    }
+  }
+
+  /* name them, equal substrings get the same name */
+  for (i = n1; i < n; i++) {
+    SA[i] = -1;
+  }
+  name = 0;
+  prev = -1;
+  for (i = 0; i < n1; i++) {
+    pos = SA[i];
+    diff = False;
+    for (d = 0; d < n; d++) {
+      if (prev == -1 || CHR(pos + d) != CHR(prev + d) || TGET(pos + d) != TGET(prev + d)) {
+	diff = True;
+	break;
+      }
+      else if (d > 0 && (ISLMS(pos + d) || ISLMS(prev + d))) {
+	break;
+      }
+    }
+    if (diff) {
+      name++;
+      prev = pos;
+    }
+    SA[n1 + pos / 2] = name - 1;
+  }
+  for (i = n - 1, j = n - 1; i >= n1; i--) {
+    if (SA[i] >= 0) {
+      SA[j--] = SA[i];
+    }
+  }
+
+  /* sort the reduced string, directly if the names are unique */
+  s1 = SA + n - n1;
+  if (name < n1) {
+    sais(NULL, s1, SA, n1, name - 1);
+  }
+  else {
+    for (i = 0; i < n1; i++) {
+      SA[s1[i]] = i;
+    }
+  }
+
+  /* induce the order of all the suffixes from the sorted leftmost S-type ones */
+  CALLOC(bkt, saIndex, K + 1);
+  getBuckets(text, s, n, bkt, K, True);
+  for (i = 1, j = 0; i < n; i++) {
+    if (ISLMS(i)) {
+      s1[j++] = i;
+    }
+  }
+  for (i = 0; i < n1; i++) {
+    SA[i] = s1[SA[i]];
+  }
+  for (i = n1; i < n; i++) {
+    SA[i] = -1;
+  }
+  for (i = n1 - 1; i >= 0; i--) {
+    j = SA[i];
+    SA[i] = -1;
+    SA[--bkt[CHR(j)]] = j;
+  }
+  induceL(t, SA, text, s, n, bkt, K);
+  induceS(t, SA, text, s, n, bkt, K);
+  FREE(bkt);
+  FREE(t);
+}
+
+/**
+ * Builds the suffix array of the text and the longest common prefix of each suffix with the 
+ * previous one in the array. The prefixes are computed in text order with the algorithm of 
+ * Karkkainen, Manzini and Puglisi, so only one more array is needed.
+ * @param[in] s the builder.
+ */
+static void buildArrays(sarray_t s) {
+  const Uchar *text = s->ctx->text;
+  saIndex n = (saIndex)s->ctx->textlen, i, j, p, h;
+
+  CALLOC(s->sa, saIndex, n + 1);
+  sais(text, NULL, s->sa, n + 1, UCHAR_MAX + 1);
+  assert(s->sa[0] == n);
+  s->suffixes = s->sa + 1;
+
+  CALLOC(s->plcp, saIndex, n);
+  s->plcp[s->suffixes[0]] = -1;
+  for (i = 1; i < n; i++) {
+    s->plcp[s->suffixes[i]] = s->suffixes[i-1];
+  }
+  for (p = 0, h = 0; p < n; p++) {
+    j = s->plcp[p];
+    if (j < 0) {
+      s->plcp[p] = h = 0;
+    }
+    else {
+      while (p + h < n && j + h < n && text[p + h] == text[j + h]) {
+	h++;
+      }
+      s->plcp[p] = h;
+      if (h > 0) {
+	h--;
+      }
+    }
+  }
+}
+
+/**
+ * Returns a cleared node, reusing a released one if possible.
+ * @param[in] s the builder.
+ * @returns the node.
+ */
+static saNode_t newNode(sarray_t s) {
+  saNode_t node = s->freeNodes;
+
+  if (node) {
+    s->freeNodes = node->sibling;
+    memset(node, 0, sizeof(struct saNode));
+  }
+  else {
+    CALLOC(node, struct saNode, 1);
+  }
+  return node;
+}
+
+/**
+ * Releases a node and its subtree, their statistics are returned to the buffer.
+ * @param[in] s the builder.
+ * @param[in] node the node.
+ */
+static void releaseNode(sarray_t s, saNode_t node) {
+  saNode_t child, next;
+
+  for (child = node->child; child; child = next) {
+    next = child->sibling;
+    releaseNode(s, child);
+  }
+  if (node->stats) {
+    returnStatistics(s->ctx, &s->ctx->stats, node->stats);
+  }
+  node->sibling = s->freeNodes;
+  s->freeNodes = node;
+}
+
+/**
+ * Opens a new interval on top of the stack.
+ * @param[in] s the builder.
+ * @param[in] depth longest common prefix of the suffixes of the interval.
+ * @param[in] lb leftmost index of the interval in the suffix array.
+ */
+static void pushInterval(sarray_t s, Uint depth, Uint lb) {
+  saInterval *interval;
+
+  if (s->stacktop >= s->stackalloc) {
+    s->stackalloc += 100;
+    REALLOC(s->stack, s->stack, saInterval, s->stackalloc);
+  }
+  interval = s->stack + s->stacktop;
+  interval->depth = depth;
+  interval->lb = lb;
+  interval->start = s->ctx->textlen;
+  interval->children = NULL;
+  interval->deep = s->stacktop > 0 && s->stack[s->stacktop-1].depth >= MAX_HEIGHT;
+  s->stacktop++;
+}
+
+/**
+ * Adds a child to an open interval. Children of intervals that are never evaluated are released.
+ * @param[in] s the builder.
+ * @param[in] interval the interval.
+ * @param[in] node the child.
+ */
+static void addChild(sarray_t s, saInterval *interval, saNode_t node) {
+  if (node->start < interval->start) {
+    interval->start = node->start;
+  }
+  if (interval->deep) {
+    releaseNode(s, node);
+  }
+  else {
+    node->sibling = interval->children;
+    interval->children = node;
+  }
+}
+
+/**
+ * Adds a leaf to an open interval. No node is created if the interval is never evaluated.
+ * @param[in] s the builder.
+ * @param[in] interval the interval.
+ * @param[in] suffix position where the suffix of the leaf starts.
+ */
+static void addLeaf(sarray_t s, saInterval *interval, Uint suffix) {
+  saNode_t leaf;
+
+  if (interval->deep) {
+    if (suffix < interval->start) {
+      interval->start = suffix;
+    }
+  }
+  else {
+    leaf = newNode(s);
+    leaf->start = suffix;
+    leaf->leaf = True;
+    addChild(s, interval, leaf);
+  }
+}
+
+/**
+ * Prunes a node that is not evaluated because its parent is too deep. The symbols that precede 
+ * its suffixes are counted in the order of their positions in the text, as the WOTD builder 
+ * does.
+ * @param[in] s the builder.
+ * @param[in] node the node.
+ */
+static void prune2(sarray_t s, saNode_t node) {
+  context_t ctx = s->ctx;
+  statistics_t stats = getStatistics(ctx, &ctx->stats);
+  Uint i, j, idx, pos;
+  Uchar sym;
+
+  for (i = node->lb; i <= node->rb; i++) {
+    pos = (Uint)s->suffixes[i];
+    if (pos > 0) {
+      idx = ctx->alphaindex[ctx->text[pos - 1]];
+      if (stats->count[idx] == 0) {
+	stats->symbols[stats->symbolCount++] = idx;
+	s->minpos[idx] = pos;
+      }
+      else if (pos < s->minpos[idx]) {
+	s->minpos[idx] = pos;
+      }
+      stats->count[idx]++;
+    }
+  }
+  for (i = 1; i < stats->symbolCount; i++) {
+    sym = stats->symbols[i];
+    for (j = i; j > 0 && s->minpos[stats->symbols[j-1]] > s->minpos[sym]; j--) {
+      stats->symbols[j] = stats->symbols[j-1];
+    }
+    stats->symbols[j] = sym;
+  }
+  stats->cost = 0xFFFFFFFF;
+  node->stats = stats;
+  node->pruned = True;
+}
+
+/**
+ * Adds the symbols of the children of a node to its statistics, in the order of the children.
+ * @param[in] s the builder.
+ * @param[in,out] stats statistics of the node.
+ * @param[in] count number of children in the <i>children</i> buffer.
+ */
+static void mergeChildren(sarray_t s, statistics_t stats, Uint count) {
+  context_t ctx = s->ctx;
+  statistics_t childStats;
+  saNode_t child;
+  Uint i, k, idx;
+
+  for (k = 0; k < count; k++) {
+    child = s->children[k];
+    if (child->leaf) {
+      if (child->start > 0) { /* if false the previous character is outside the string */
+	idx = ctx->alphaindex[ctx->text[child->start - 1]];
+	if (stats->count[idx] == 0) {
+	  stats->symbols[stats->symbolCount++] = idx;
+	}
+	stats->count[idx]++;
+	s->distinct[idx]++;
+      }
+    }
+    else {
+      childStats = child->stats;
+      for (i=0; i<childStats->symbolCount; i++) {
+	if (stats->count[childStats->symbols[i]] == 0) {
+	  stats->symbols[stats->symbolCount++] = childStats->symbols[i];
+	} 
+	stats->count[childStats->symbols[i]] += childStats->count[childStats->symbols[i]];
+	s->distinct[childStats->symbols[i]]++;
+      }
+      stats->cost += childStats->cost;
+      returnStatistics(ctx, &ctx->stats, childStats);
+      child->stats = NULL;
+    }
+  }
+}
+
+/**
+ * Evaluates the cost of a closed interval and prunes its children if it is not larger than 
+ * the cost of the subtree. The children are taken in the order of the WOTD builder, where
+ * the suffixes of every node stay sorted by position, so they are sorted by their first suffix.
+ * @param[in] s the builder.
+ * @param[in] interval the interval.
+ * @param[in] rb rightmost index of the interval in the suffix array.
+ * @param[in] parentDepth length of the label of the parent node.
+ * @returns the new node.
+ */
+static saNode_t evaluate(sarray_t s, saInterval *interval, Uint rb, Uint parentDepth) {
+  context_t ctx = s->ctx;
+  saNode_t node = newNode(s), child;
+  statistics_t stats;
+  Uint i, j, count = 0;
+  double est, auxx;
+
+  node->start = interval->start;
+  node->depth = interval->depth;
+  node->parentDepth = parentDepth;
+  node->lb = interval->lb;
+  node->rb = rb;
+
+  for (child = interval->children; child; child = child->sibling) {
+    for (j = count++; j > 0 && s->children[j-1]->start > child->start; j--) {
+      s->children[j] = s->children[j-1];
+    }
+    s->children[j] = child;
+    child->parentDepth = node->depth;
+    if (!child->leaf && !child->stats) {
+      prune2(s, child);
+    }
+  }
+
+  stats = getStatistics(ctx, &ctx->stats);
+  mergeChildren(s, stats, count);
+
+  stats->cost += hAlpha(ctx) * ctx->alphasize * (node->depth - parentDepth);
+  
+  auxx = escapeCost(ctx, stats, s->distinct);
+  stats->cost += auxx;
+  assert(auxx >= 0);
+  for (i=0; i<stats->symbolCount; i++) {
+    s->distinct[stats->symbols[i]] = 0;
+  }
+
+  est = nodeCost(ctx, stats);
+  assert(est >= 0);
+
+  if (est <= stats->cost) { /* pruning needed */
+    stats->cost = est;
+    node->pruned = True;
+    for (i = 0; i < count; i++) {
+      releaseNode(s, s->children[i]);
+    }
+  }
+  else {
+    node->child = s->children[0];
+    for (i = 1; i < count; i++) {
+      s->children[i-1]->sibling = s->children[i];
+    }
+    s->children[count-1]->sibling = NULL;
+  }
+  node->stats = stats;
+  return node;
+}
+
+/**
+ * Closes the interval on top of the stack. It is evaluated if its parent is not too deep,
+ * otherwise only its range is kept.
+ * @param[in] s the builder.
+ * @param[in] rb rightmost index of the interval in the suffix array.
+ * @param[in] parentDepth length of the label of the parent node.
+ * @returns the node of the interval.
+ */
+static saNode_t closeInterval(sarray_t s, Uint rb, Uint parentDepth) {
+  saInterval *interval = s->stack + --s->stacktop;
+  saNode_t node, child, next;
+
+  if (parentDepth < MAX_HEIGHT) {
+    return evaluate(s, interval, rb, parentDepth);
+  }
+  for (child = interval->children; child; child = next) {
+    next = child->sibling;
+    releaseNode(s, child);
+  }
+  node = newNode(s);
+  node->start = interval->start;
+  node->depth = interval->depth;
+  node->lb = interval->lb;
+  node->rb = rb;
+  return node;
+}
+
+/**
+ * Traverses the LCP intervals of the suffix array bottom up, evaluating and pruning each
+ * node once all its children are known. Only the open intervals and the children of those 
+ * that can still be evaluated are kept.
+ * @param[in] s the builder.
+ * @returns the root interval with its children.
+ */
+static saInterval *traverse(sarray_t s) {
+  Uint n = s->ctx->textlen, i, h, lb, parentDepth;
+  saNode_t node;
+
+  pushInterval(s, 0, 0);
+  for (i = 1; i <= n; i++) {
+    h = i < n ? (Uint)s->plcp[s->suffixes[i]] : 0;
+    if (h > s->stack[s->stacktop-1].depth) {
+      pushInterval(s, h, i - 1);
+      addLeaf(s, s->stack + s->stacktop - 1, (Uint)s->suffixes[i-1]);
+      continue;
+    }
+    addLeaf(s, s->stack + s->stacktop - 1, (Uint)s->suffixes[i-1]);
+    while (h < s->stack[s->stacktop-1].depth) {
+      lb = s->stack[s->stacktop-1].lb;
+      parentDepth = s->stack[s->stacktop-2].depth;
+      if (h > parentDepth) {
+	parentDepth = h;
+      }
+      node = closeInterval(s, i - 1, parentDepth);
+      if (h > s->stack[s->stacktop-1].depth) {
+	pushInterval(s, h, lb);
+      }
+      addChild(s, s->stack + s->stacktop - 1, node);
+    }
+  }
+  return s->stack;
+}
+
+/**
+ * Tests if it is necessary to prune the tree at the root and does it if necessary. The children
+ * of the root are taken in alphabetical order, followed by the empty suffix.
+ * @param[in] s the builder.
+ * @param[in] root the root interval.
+ * @returns True if the whole tree is pruned.
+ */
+static BOOL pruneRoot(sarray_t s, saInterval *root) {
+  context_t ctx = s->ctx;
+  saNode_t child;
+  statistics_t stats;
+  Uint idx, count = 0;
+  double est, auxx;
+  BOOL pruned;
+
+  for (child = root->children; child; child = child->sibling) {
+    count++;
+  }
+  for (child = root->children, idx = count; child; child = child->sibling) {
+    s->children[--idx] = child;
+    child->parentDepth = 0;
+  }
+
+  stats = getStatistics(ctx, &ctx->stats);
+  mergeChildren(s, stats, count);
+  if (ctx->textlen > 0) { /* leaf of the empty suffix */
+    idx = ctx->alphaindex[ctx->text[ctx->textlen - 1]];
+    if (stats->count[idx] == 0) {
+      stats->symbols[stats->symbolCount++] = idx;
+    }
+    stats->count[idx]++;
+    s->distinct[idx]++;
+  }
+
+  stats->cost += hAlpha(ctx) * ctx->alphasize;
+
+  auxx = escapeCost(ctx, stats, s->distinct);
+  stats->cost += auxx;
+  assert(auxx >= 0);
+
+  est = nodeCost(ctx, stats);
+  pruned = est <= stats->cost;
+  returnStatistics(ctx, &ctx->stats, stats);
+
+  root->children = NULL;
+  if (count > 0) {
+    root->children = s->children[0];
+    for (idx = 1; idx < count; idx++) {
+      s->children[idx-1]->sibling = s->children[idx];
+    }
+    s->children[count-1]->sibling = NULL;
+  }
+  return pruned;
+}
+
+/**
+ * Adds the fsm nodes of a list of siblings and their subtrees, in preorder as the WOTD builder 
+ * does. Leaves and pruned nodes are shortened to one character.
+ * @param[in] s the builder.
+ * @param[in] ret the root of the fsm tree.
+ * @param[in] parent the fsm node of the parent of the siblings.
+ * @param[in] node the first sibling.
+ */
+static void buildFsmNodes(sarray_t s, fsmTree_t ret, fsmTree_t parent, saNode_t node) {
+  context_t ctx = s->ctx;
+  fsmTree_t fsmNode;
+  Uint lp;
+
+  for (; node; node = node->sibling) {
+    lp = node->start + node->parentDepth;
+    if (lp != ctx->textlen) { /* ignore $ leaves */
+      fsmNode = initFsmTree(ctx, ret);
+      setChild(&parent->children, GETINDEX(lp), fsmNode);
+      fsmNode->parent = parent;
+      fsmNode->left = lp;
+      if (parent->left != -1) { /* != ROOT */
+	fsmNode->length = parent->length + parent->right - parent->left + 1;
+      }
+      if (node->leaf || node->pruned) {
+	fsmNode->right = lp;
+      }
+      else {
+	fsmNode->right = node->child->start + node->depth - 1;
+	buildFsmNodes(s, ret, fsmNode, node->child);
+      }
+    }
+  }
+}
+
+/**
+ * The suffix array is built with SA-IS and the LCP intervals are pruned in one pass with the
+ * cost functions of the WOTD builder, so the tree is the same one <i>buildSTree</i> returns.
+ * Time is linear in the length of the text and the arrays use 8 bytes per character.
+ * @param[in] ctx context with the text to model.
+ * @returns a new fsm tree.
+ */
+fsmTree_t buildSuffixArrayTree (context_t ctx)
+{
+  sarray_t s;
+  saInterval *root;
+  saNode_t node, next;
+  fsmTree_t ret;
+  BOOL pruned;
+
+  if (ctx->textlen > MAXSATEXTLEN) {
+    failure(CTX_ERR_LIMIT, "Text too long to build its suffix array");
+  }
+  CALLOC(s, struct sarray, 1);
+  s->ctx = ctx;
+  CALLOC(s->distinct, Uint, ctx->alphasize);
+  CALLOC(s->minpos, Uint, ctx->alphasize);
+  CALLOC(s->children, saNode_t, ctx->alphasize + 1);
+
+  if (ctx->textlen > 0) {
+    buildArrays(s);
+  }
+  root = traverse(s);
+  FREE(s->sa);
+  FREE(s->plcp);
+
+  pruned = pruneRoot(s, root);
+  freeBuffer(&ctx->stats);
+
+  ret = initFsmTree(ctx, NULL);
+  if (!pruned) {
+    buildFsmNodes(s, ret, ret, root->children);
+  }
+
+  for (node = root->children; node; node = next) {
+    next = node->sibling;
+    releaseNode(s, node);
+  }
+  for (node = s->freeNodes; node; node = next) {
+    next = node->sibling;
+    FREE(node);
+  }
+  FREE(s->stack);
+  FREE(s->children);
+  FREE(s->minpos);
+  FREE(s->distinct);
+  FREE(s);
+  return ret;
+}
@@ -16,13 +16,12 @@
    along with Context.  If not, see <http://www.gnu.org/licenses/>.
 */
  
-#ifndef TEXT_H
-#define TEXT_H
+#ifndef SUFFIX_ARRAY_H
+#define SUFFIX_ARRAY_H
 
-/** Length of the input text in the encoder. */
-Uint textlen;
+#include "fsmTree.h"
 
-/** Input text to the encoder. */
-Uchar *text; 
+/** Builds a pruned fsm tree from the suffix array of the input text. */
+fsmTree_t buildSuffixArrayTree (context_t);
 
 #endif
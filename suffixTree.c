@@ -20,7 +20,6 @@
 #include "suffixTree.h"
 #include "stack.h"
 #include "alpha.h"
-#include "text.h"
 #include "gammaFunc.h"
 #include "spacedef.h"
 #include "debug.h"
@@ -57,7 +56,7 @@
  * @param[out] retS new explicit state that is the closest ancestor of the state to canonize.
  * @param[out] retK index of the leftmost character of the string from <i>retS</i> to the state to canonize.
 */
-static void canonize (suffixTree_t s, Uint k, Uint p, suffixTree_t *retS, Uint *retK) {
+static void canonize (context_t ctx, suffixTree_t s, Uint k, Uint p, suffixTree_t *retS, Uint *retK) {
   Uint kPrime, pPrime;
   suffixTree_t sPrime;
 
@@ -71,7 +70,7 @@ static void canonize (suffixTree_t s, Uint k, Uint p, suffixTree_t *retS, Uint *
       sPrime = s->child; /* ROOT is the t-transition of BOTTOM for every t */
     }
     else {
-      for (sPrime=sPrime->child; sPrime && text[sPrime->left]!=text[k]; sPrime=sPrime->sibling);
+      for (sPrime=sPrime->child; sPrime && ctx->text[sPrime->left]!=ctx->text[k]; sPrime=sPrime->sibling);
     }
     kPrime = sPrime->left;
     GET_RIGHT(pPrime, sPrime);
@@ -79,7 +78,7 @@ static void canonize (suffixTree_t s, Uint k, Uint p, suffixTree_t *retS, Uint *
       k = k + pPrime - kPrime +1;
       s = sPrime;
       if (k <= p) {
-	for (sPrime=sPrime->child; sPrime && text[sPrime->left]!=text[k]; sPrime=sPrime->sibling);
+	for (sPrime=sPrime->child; sPrime && ctx->text[sPrime->left]!=ctx->text[k]; sPrime=sPrime->sibling);
 	kPrime = sPrime->left;
 	GET_RIGHT(pPrime, sPrime);
       }
@@ -99,15 +98,15 @@ static void canonize (suffixTree_t s, Uint k, Uint p, suffixTree_t *retS, Uint *
  * @param[out] r new explicit state created or <i>s</i> if a new node was not needed.
  * @returns True if the input state is the end point.
  */
-static BOOL testAndSplit(suffixTree_t s, Uint k, Uint p, suffixTree_t *r) {
+static BOOL testAndSplit(context_t ctx, suffixTree_t s, Uint k, Uint p, suffixTree_t *r) {
   suffixTree_t sPrime = s, new;
   Uint kPrime, pPrime;
 
   if (p != -1 && k <= p) {
-    for (sPrime=sPrime->child; sPrime && text[sPrime->left]!=text[k]; sPrime=sPrime->sibling);
+    for (sPrime=sPrime->child; sPrime && ctx->text[sPrime->left]!=ctx->text[k]; sPrime=sPrime->sibling);
     kPrime = sPrime->left;
     GET_RIGHT(pPrime, sPrime);
-    if ((p+1 < textlen) && (text[kPrime+p-k+1] == text[p+1])) {
+    if ((p+1 < ctx->textlen) && (ctx->text[kPrime+p-k+1] == ctx->text[p+1])) {
       *r = s;
       return True;
     }
@@ -141,8 +140,8 @@ static BOOL testAndSplit(suffixTree_t s, Uint k, Uint p, suffixTree_t *r) {
     if (s->left == BOTTOM) {
       return True;
     }
-    if (p+1 < textlen) {
-      for (sPrime=sPrime->child; sPrime && text[sPrime->left]!=text[p+1]; sPrime=sPrime->sibling);
+    if (p+1 < ctx->textlen) {
+      for (sPrime=sPrime->child; sPrime && ctx->text[sPrime->left]!=ctx->text[p+1]; sPrime=sPrime->sibling);
     }
     else {
       sPrime=NULL;
@@ -182,10 +181,10 @@ static void addChild (suffixTree_t s, Uint i) {
  * @param retS explicit node on the tree that is an ancestor of the end point.
  * @param retK index of the leftmost character of the string from <i>retS</i> to the end point.
  */
-static void update (suffixTree_t s, Uint k, Uint i, suffixTree_t *retS, Uint *retK) {
+static void update (context_t ctx, suffixTree_t s, Uint k, Uint i, suffixTree_t *retS, Uint *retK) {
   suffixTree_t oldr=NULL, r;
 
-  while (!testAndSplit(s, k, i-1, &r)) {
+  while (!testAndSplit(ctx, s, k, i-1, &r)) {
     /* add new leaf */
     addChild(r, i);
     if (oldr) {
@@ -193,7 +192,7 @@ static void update (suffixTree_t s, Uint k, Uint i, suffixTree_t *retS, Uint *re
       oldr->suffix = r;
     }
     oldr = r;
-    canonize(s->suffix, k, i-1, &s, &k);
+    canonize(ctx, s->suffix, k, i-1, &s, &k);
   }
 
   if (oldr && oldr->left!=ROOT) { 
@@ -221,7 +220,7 @@ static void pruneSubTree(suffixTree_t tree) {
     if (tree->child) {
       PUSHNODE((Uint)tree->child);
     }
-    freeSuffixTree(tree);
+    FREE(tree);
   }
   FREE(stack);
 }
@@ -232,7 +231,7 @@ static void pruneSubTree(suffixTree_t tree) {
  * Auxiliary function to print a node of the tree to the standard output.
  * @param[in] tree tree node to print.
  */
-static void printNode(suffixTree_t tree) {
+static void printNode(context_t ctx, suffixTree_t tree) {
   Uint right;
 
   if (tree->left == BOTTOM) {
@@ -243,14 +242,14 @@ static void printNode(suffixTree_t tree) {
   }
   else {
     GET_RIGHT(right, tree);
-    if (right == INFINITY) right = textlen;
+    if (right == INFINITY) right = ctx->textlen;
     printf("%ld - %ld - %p", tree->left, right, tree);
     /*for (i=tree->left; i<= tree->right; i++) {
-      if (i == textlen) {
+      if (i == ctx->textlen) {
 	printf("$");
       }
       else { 
-	printf("%c", text[i]);
+	printf("%c", ctx->text[i]);
       }
     }*/
   }
@@ -262,17 +261,17 @@ static void printNode(suffixTree_t tree) {
  * @param[in] tree the tree to print
  * @param[in] level depth of this node in the whole tree.
  */
-static void printRec(suffixTree_t tree, Uint level) {
+static void printRec(context_t ctx, suffixTree_t tree, Uint level) {
   int i;
 
   if (level > 0) {
     for (i=1; i<level; i++) {
       printf("-");
     }
-    printNode (tree);
+    printNode (ctx, tree);
     /*if (tree->suffix) {
       printf("  (");
-      printNode (tree->suffix, text, textlen);
+      printNode (ctx, tree->suffix, ctx->text, ctx->textlen);
        printf(")");
     }*/
     printf("\n");
@@ -281,7 +280,7 @@ static void printRec(suffixTree_t tree, Uint level) {
   level++;
   if (tree->child) {
     for (tree=tree->child; tree; tree=tree->sibling) {
-      printRec(tree, level);
+      printRec(ctx, tree, level);
     }
   }
 }
@@ -326,9 +325,12 @@ suffixTree_t initSuffixTree() {
 
 
 /**
- * @param[in,out] tree the tree to delete.
+ * @param[in,out] tree the tree to delete, with all its nodes.
  */
 void freeSuffixTree(suffixTree_t tree) {
+  if (tree->child) {
+    pruneSubTree(tree->child);
+  }
   FREE(tree);
 }
 
@@ -336,17 +338,17 @@ void freeSuffixTree(suffixTree_t tree) {
 /**
  * @param[in,out] tree an empty and initialized suffix tree. 
  */
-void buildSuffixTree(suffixTree_t tree) {
+void buildSuffixTree(context_t ctx, suffixTree_t tree) {
   Uint k=0, i=0;
   suffixTree_t s = tree->child; /* ROOT */
 
-  while (i <= textlen) {
-    update(s, k, i, &s, &k);
-    canonize(s, k, i, &s, &k);
+  while (i <= ctx->textlen) {
+    update(ctx, s, k, i, &s, &k);
+    canonize(ctx, s, k, i, &s, &k);
     i++;
-    if (i%1000 == 0)  printf("%ld/%ld\r", i, textlen);
+    if (i%1000 == 0)  VERBOSE(fprintf(ctx->messages, "%ld/%ld\r", i, ctx->textlen));
   }
-  printf("%ld/%ld\n", textlen, textlen);
+  VERBOSE(fprintf(ctx->messages, "%ld/%ld\n", ctx->textlen, ctx->textlen));
   DEBUGCODE(printf("Original tree size: %d\n", treeSize(tree)));
 }
 
@@ -354,7 +356,7 @@ void buildSuffixTree(suffixTree_t tree) {
 /**
  * @param[in,out] tree the tree to prune.
  */
-void pruneSuffixTree(suffixTree_t tree) {
+void pruneSuffixTree(context_t ctx, suffixTree_t tree) {
   Uint stacktop=0, stackalloc=0, *stack = NULL, treePtr, length, i, right;
   suffixTree_t child;
   double est, auxx;
@@ -368,13 +370,13 @@ void pruneSuffixTree(suffixTree_t tree) {
     POPNODE(treePtr);
     tree = (suffixTree_t)treePtr;
     if (!tree->child) { /* is a leaf */
-      tree->stats = allocStatistics();
+      tree->stats = allocStatistics(ctx);
       if (tree->left > length) { /* this is not the full string prefix */
 	i = GETINDEX(tree->left-length-1);
 	tree->stats->count[i] = 1;
 	tree->stats->symbols[tree->stats->symbolCount++] = i;
       }
-      /*tree->stats->cost = log2Alpha();*/
+      /*tree->stats->cost = log2Alpha(ctx);*/
     }
     else { /* is a branching node */
       for (child=tree->child; child && child->stats; child=child->sibling);
@@ -391,8 +393,8 @@ void pruneSuffixTree(suffixTree_t tree) {
 	}
       } 
       else { /* all children are already evaluated */
-	tree->stats = allocStatistics();
-	CALLOC(distinct, Uint, alphasize);
+	tree->stats = allocStatistics(ctx);
+	CALLOC(distinct, Uint, ctx->alphasize);
 
 	for (child=tree->child; child; child=child->sibling) {
 	  for (i=0; i<child->stats->symbolCount; i++) {
@@ -407,15 +409,15 @@ void pruneSuffixTree(suffixTree_t tree) {
 	}
 
 	GET_RIGHT(right, tree);
-	tree->stats->cost += hAlpha() * alphasize * (right - tree->left + 1); 
+	tree->stats->cost += hAlpha(ctx) * ctx->alphasize * (right - tree->left + 1); 
 
-	auxx = escapeCost(tree->stats, distinct);
+	auxx = escapeCost(ctx, tree->stats, distinct);
 	tree->stats->cost += auxx;
 
 	free(distinct);
 
-	/*est = kt(tree->stats);*/
-	est = nodeCost(tree->stats);
+	/*est = kt(ctx, tree->stats);*/
+	est = nodeCost(ctx, tree->stats);
 
 	if (est <= tree->stats->cost) { /* we have to prune */
 	  tree->stats->cost = est;
@@ -431,12 +433,13 @@ void pruneSuffixTree(suffixTree_t tree) {
 
 
 /**
- * @param[in] tree the tree to transform.
+ * @param[in] tree the tree to transform, it is left unchanged so it can be deleted also 
+ * when the transformation fails.
  * @returns a new fsm tree equivalent tho the input one.
  */
-fsmTree_t fsmSuffixTree(suffixTree_t tree) {
+fsmTree_t fsmSuffixTree(context_t ctx, suffixTree_t tree) {
   Uint stacktop=0, stackalloc=0, *stack = NULL, sfxPtr, fsmPtr, pos, right;
-  fsmTree_t ret = initFsmTree(), fsmNode;
+  fsmTree_t ret = initFsmTree(ctx, NULL), fsmNode, child;
 
   if (tree->child->child) { /* if root has children */
     PUSHNODE((Uint)tree->child->child); 
@@ -446,26 +449,27 @@ fsmTree_t fsmSuffixTree(suffixTree_t tree) {
       POPNODE(sfxPtr);
       fsmNode = (fsmTree_t)fsmPtr;
       tree = (suffixTree_t)sfxPtr;
-      /*if (tree->left == textlen) {
-	pos = alphasize;
+      /*if (tree->left == ctx->textlen) {
+	pos = ctx->alphasize;
       }
       else {
 	pos = GETINDEX(tree->left);   
       }*/
-      if (tree->left != textlen) { /* ignore $ leaves */
+      if (tree->left != ctx->textlen) { /* ignore $ leaves */
 	pos = GETINDEX(tree->left);   
-	fsmNode->children[pos] = initFsmTree();
-	fsmNode->children[pos]->parent = fsmNode; 
-	fsmNode->children[pos]->left = tree->left; 
+	child = initFsmTree(ctx, fsmNode);
+	setChild(&fsmNode->children, pos, child);
+	child->parent = fsmNode; 
+	child->left = tree->left; 
 	GET_RIGHT(right, tree);
 	if (right == INFINITY) {
-	  fsmNode->children[pos]->right = tree->left; /* shorten leaf */
+	  child->right = tree->left; /* shorten leaf */
 	}
 	else {
-	  fsmNode->children[pos]->right = right; 
+	  child->right = right; 
 	}
 	if (fsmNode->left != ROOT) {
-	  fsmNode->children[pos]->length = fsmNode->length + fsmNode->right - fsmNode->left + 1;
+	  child->length = fsmNode->length + fsmNode->right - fsmNode->left + 1;
 	}
 
 	if (tree->sibling) {
@@ -474,10 +478,9 @@ fsmTree_t fsmSuffixTree(suffixTree_t tree) {
 	}
 	if (tree->child) {
 	  PUSHNODE((Uint)tree->child);
-	  PUSHNODE((Uint)fsmNode->children[pos]);
+	  PUSHNODE((Uint)child);
 	}
       }
-      FREE(tree);
     }
     FREE(stack);
   }
@@ -489,8 +492,8 @@ fsmTree_t fsmSuffixTree(suffixTree_t tree) {
 /**
  * @param[in] tree the tree to print.
  */
-void printSuffixTree(const suffixTree_t tree) {
-  printRec(tree, 0);
+void printSuffixTree(context_t ctx, const suffixTree_t tree) {
+  printRec(ctx, tree, 0);
 }
 
 #endif
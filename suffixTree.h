@@ -37,23 +37,23 @@ typedef struct suffixTree {
 /** Creates and initializes a new suffix tree structure instance. */
 suffixTree_t initSuffixTree();
 
-/** Deletes a suffix tree structure instance. */
+/** Deletes a suffix tree and all its nodes. */
 void freeSuffixTree(suffixTree_t);
 
 /** Builds a suffix tree based on the input string. */
-void buildSuffixTree(suffixTree_t);
+void buildSuffixTree(context_t, suffixTree_t);
 
 /** Prunes this suffix tree according to some cost function. */
-void pruneSuffixTree(suffixTree_t);
+void pruneSuffixTree(context_t, suffixTree_t);
 
 /** Transforms this tree in an equivalent fsm tree structure. */
-fsmTree_t fsmSuffixTree(suffixTree_t);
+fsmTree_t fsmSuffixTree(context_t, suffixTree_t);
 
 
 #ifdef DEBUG
 
 /** Prints a suffix tree to the standard output. */
-void printSuffixTree(const suffixTree_t);
+void printSuffixTree(context_t, const suffixTree_t);
 
 #endif
 
@@ -0,0 +1,74 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#include "symbols.h"
+
+/**
+ * @param[in] symbols statistics of the state.
+ * @param[in] totalSyms number of symbols of the state.
+ * @param[in] sym alphabet index of the symbol to search.
+ * @returns the position of the symbol or totalSyms if the state does not have it.
+ */
+Uint findSymbol(const symbolCount *symbols, const Uint totalSyms, const Uchar sym) {
+  Uint j;
+
+  for (j=0; j<totalSyms && symbols[j].symbol != sym; j++);
+  return j;
+}
+
+/**
+ * The symbols are ordered by decreasing count and the ones with the same count by their
+ * alphabet index, so the order only depends on the counts and is the same in the encoder
+ * and the decoder even if their states get the counts in a different way.
+ * @param[in] A statistics of the first symbol.
+ * @param[in] B statistics of the second symbol.
+ * @returns True if the first symbol goes before the second one.
+ */
+#define PRECEDES(A,B) ((A).count > (B).count || ((A).count == (B).count && (A).symbol < (B).symbol))
+
+/**
+ * The symbol is exchanged with the ones before it until it reaches its place, so the
+ * most frequent symbols of a state are found first. Counts only grow by one symbol at a
+ * time, so the rest of the state is still in order.
+ * @param[in,out] symbols statistics of the state.
+ * @param[in] j position of the symbol whose count has grown.
+ * @returns the new position of the symbol.
+ */
+Uint promoteSymbol(symbolCount *symbols, Uint j) {
+  symbolCount moved = symbols[j];
+
+  for (; j > 0 && PRECEDES(moved, symbols[j-1]); j--) {
+    symbols[j] = symbols[j-1];
+  }
+  symbols[j] = moved;
+  return j;
+}
+
+/**
+ * Used when the counts of a state are rescaled or copied to a new state. The symbols are
+ * almost in order then, so they are sorted by insertion.
+ * @param[in,out] symbols statistics of the state.
+ * @param[in] totalSyms number of symbols of the state.
+ */
+void sortSymbols(symbolCount *symbols, const Uint totalSyms) {
+  Uint j;
+
+  for (j=1; j<totalSyms; j++) {
+    promoteSymbol(symbols, j);
+  }
+}
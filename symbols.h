@@ -0,0 +1,54 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+ 
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include "types.h"
+#include "context.h"
+#include "arithmetic/coder.h"
+
+/** 
+ * Count of a symbol in the statistics of a state, stored next to the symbol so the
+ * statistics of a state are read from one array. Counts are kept below the reset 
+ * threshold by rescaling, so 16 bits are enough.
+ */
+typedef struct symbolCount {
+  Ushort count; /**< Number of occurrences of the symbol. */
+  Uchar symbol; /**< Alphabet index of the symbol. */
+} symbolCount;
+
+/**
+ * Indicates if the symbols of every state are kept with the highest counts first. The
+ * order of the symbols changes the coding of the text, so it is only done with the 32 bit
+ * coder and files written with the 16 bit coder keep the order of their first occurrence.
+ * @param[in] C the context.
+ * @returns True if the symbols are ordered by count.
+ */
+#define ORDERED_SYMBOLS(C) ((C)->coder.bits == CODER_BITS_WIDE)
+
+/** Returns the position of a symbol in the statistics of a state. */
+Uint findSymbol(const symbolCount *, const Uint, const Uchar);
+
+/** Moves a symbol whose count has grown to its place in the order of the state. */
+Uint promoteSymbol(symbolCount *, Uint);
+
+/** Restores the order of the symbols of a state after their counts have been changed. */
+void sortSymbols(symbolCount *, const Uint);
+
+#endif
@@ -0,0 +1,125 @@
+/* Copyright 2013 Jorge Merlino
+
+   This file is part of Context.
+
+   Context is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Context is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Context.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file
+ * Compresses and decompresses a buffer in memory with several workers and checks
+ * that the text is recovered and that the file is the one written by a single worker.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../libcontext.h"
+
+/** Length of the test text. */
+#define TEXT_LENGTH 200000
+
+/** Number of parts of the test text. */
+#define PARTS 7
+
+/** Words the test text is made of. */
+static const char *words[] = {"context ", "tree ", "model ", "symbol ", "part ", "worker ", "coder ", "\n"};
+
+/**
+ * Fills a buffer with words chosen by a linear congruential generator, so the text
+ * is the same on every run and has enough structure to build deep trees.
+ * @param[out] text the buffer.
+ * @param[in] length length of the buffer.
+ */
+static void makeText(Uchar *text, Uint length) {
+  unsigned long seed = 12345;
+  Uint i = 0;
+  const char *word;
+
+  while (i < length) {
+    seed = (seed * 1103515245 + 12345) & 0x7FFFFFFF;
+    for (word = words[(seed >> 16) % (sizeof(words) / sizeof(words[0]))]; *word && i < length; word++) {
+      text[i++] = *word;
+    }
+  }
+}
+
+/**
+ * Round trips the text with the given algorithm and number of workers.
+ * @param[in] text the text.
+ * @param[in] length length of the text.
+ * @param[in] algorithm the tree building algorithm.
+ * @param[in] workers number of workers.
+ * @returns True if the test passed.
+ */
+static BOOL roundTrip(const Uchar *text, Uint length, int algorithm, int workers) {
+  ctxOptions options;
+  Uchar *zipped = NULL, *unzipped = NULL, *sequential = NULL;
+  Uint zippedLen, unzippedLen, sequentialLen;
+  int status;
+  BOOL passed = False;
+
+  ctxDefaultOptions(&options);
+  options.algorithm = algorithm;
+  options.parts = PARTS;
+  options.workers = workers;
+  if ((status = ctxCompressBuffer(text, length, &zipped, &zippedLen, &options)) != CTX_OK) {
+    fprintf(stderr, "compression failed: %s\n", ctxErrorString(status));
+  }
+  else if ((status = ctxDecompressBuffer(zipped, zippedLen, &unzipped, &unzippedLen, &options)) != CTX_OK) {
+    fprintf(stderr, "decompression failed: %s\n", ctxErrorString(status));
+  }
+  else if (unzippedLen != length || memcmp(unzipped, text, length) != 0) {
+    fprintf(stderr, "decompressed text differs\n");
+  }
+  else {
+    options.workers = 1;
+    if ((status = ctxCompressBuffer(text, length, &sequential, &sequentialLen, &options)) != CTX_OK) {
+      fprintf(stderr, "compression with one worker failed: %s\n", ctxErrorString(status));
+    }
+    else if (sequentialLen != zippedLen || memcmp(sequential, zipped, zippedLen) != 0) {
+      fprintf(stderr, "compressed file differs from the one written by one worker\n");
+    }
+    else {
+      passed = True;
+    }
+  }
+  free(zipped);
+  free(unzipped);
+  free(sequential);
+  return passed;
+}
+
+int main(void) {
+  int algorithms[] = {CTX_KURTZ, CTX_UKKONEN, CTX_SUFFIXARRAY}, workers[] = {2, 3, PARTS + 1};
+  int i, j, failed = 0;
+  Uchar *text = malloc(TEXT_LENGTH);
+
+  if (!text) {
+    fprintf(stderr, "Not enough memory\n");
+    return EXIT_FAILURE;
+  }
+  makeText(text, TEXT_LENGTH);
+  for (i = 0; i < (int)(sizeof(algorithms) / sizeof(algorithms[0])); i++) {
+    for (j = 0; j < (int)(sizeof(workers) / sizeof(workers[0])); j++) {
+      if (!roundTrip(text, TEXT_LENGTH, algorithms[i], workers[j])) {
+	fprintf(stderr, "FAIL algorithm %d, %d workers\n", algorithms[i], workers[j]);
+	failed++;
+      }
+    }
+  }
+  free(text);
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -28,6 +28,13 @@
 #include <windows.h> /* BOOL */
 #endif
 
+#ifdef WIN32
+#define THREAD_LOCAL __declspec(thread)
+#else
+/** Storage class of the variables that are private to each thread. */
+#define THREAD_LOCAL __thread
+#endif
+
 /*
   Some rules about types:
   - do not use Ulong, these are not portable.
@@ -56,6 +63,9 @@ typedef unsigned long  Uint;
 /** Signed int type. */          
 typedef signed   long  Sint;          
 
+/** Unsigned int type of 32 bits, used for compact indexes. */
+typedef unsigned int   Uint32;
+
 /*
   The following is the central case distinction to accomodate
   code for 32 bit integers and 64 bit integers.
@@ -25,6 +25,9 @@
 #include <gsl/gsl_sf_gamma.h>
 #include <gsl/gsl_math.h>
 #include <sys/types.h>
+#ifndef WIN32
+#include <pthread.h>
+#endif
 #include "types.h"
 #include "debug.h"
 #include "spacedef.h"
@@ -33,7 +36,8 @@
 #include "alpha.h"
 #include "gammaFunc.h"
 #include "statistics.h"
-#include "text.h"
+#include "failure.h"
+#include "libcontext.h"
 
 /** Number of bits in Uint */
 #define INTWORDSIZE (UintConst(1) << LOGWORDSIZE)    
@@ -47,15 +51,12 @@
 /** Number of array buckets per node. If more information is needed per node this value should be adjusted accordingly.*/
 #define BRANCHWIDTH UintConst(3) 
 
-/** Maximum allowed height for the tree */
-#define MAX_HEIGHT 30
-
 /**
  * Given a pointer to the tree array returns the index in the array of that pointer.
  * @param[in] N pointer to the tree array.
  * @returns index of the pointer in the array.
  */
-#define NODEINDEX(N) ((Uint) ((N) - streetab))
+#define NODEINDEX(N) ((Uint) ((N) - w->streetab))
 
 /** Bit used to indicate that a node is a leaf. */
 #define LEAFBIT FIRSTBIT 
@@ -139,8 +140,11 @@
  */
 #define SETSTATS(P,C)       *((P)+2) = C
 
-/** Undefined reference. */
-#define UNDEFREFERENCE      (UINT_MAX)   
+/** 
+ * Undefined reference. It has the flag bits clear so it is not mistaken for a leaf or 
+ * an unevaluated node.
+ */
+#define UNDEFREFERENCE      (SECONDBIT - 1)   
 
 /**
  * Given a pointer to the input text returns the index in the array of such pointer.
@@ -148,7 +152,7 @@
  * @param[in] L pointer to the input text
  * @returns the index of the pointed char in the array.
  */
-#define SUFFIXNUMBER(L)     ((Uint) (*(L) - text))  
+#define SUFFIXNUMBER(L)     ((Uint) (*(L) - w->ctx->text))  
 
 /**
  * Store the boundaries of the portion of the text that needs to be read when evaluating this node.
@@ -157,15 +161,15 @@
  * @param[in] L the left boundary.
  * @param[in] R the right boundary.
  */
-#define STOREBOUNDARIES(P,L,R) *(P) = (Uint) ((L) - suffixbase);\
-                               *((P)+1) = ((R) - suffixbase) | UNEVALUATEDBIT
+#define STOREBOUNDARIES(P,L,R) *(P) = (Uint) ((L) - w->suffixbase);\
+                               *((P)+1) = ((R) - w->suffixbase) | UNEVALUATEDBIT
 
 /**
  * Given a pointer to an unevaluated node returns the stored left boundary. 
  * @param[in] P pointer to the first index of a node in the tree array.
  * @returns the left boundary.
  */
-#define GETLEFTBOUNDARY(P)  (suffixbase + *(P))
+#define GETLEFTBOUNDARY(P)  (w->suffixbase + *(P))
 
 /**
  * Given a pointer to an unevaluated node returns the stored right boundary.  
@@ -173,30 +177,39 @@
  * @param[in] P pointer to the first index of a node in the tree array.
  * @returns the right boundary.
  */
-#define GETRIGHTBOUNDARY(P) (suffixbase + ((*((P)+1)) & ~UNEVALUATEDBIT))
+#define GETRIGHTBOUNDARY(P) (w->suffixbase + ((*((P)+1)) & ~UNEVALUATEDBIT))
 
 /** Undefined successor */
-#define UNDEFINEDSUCC  (UINT_MAX)    
-
-Uchar *sentinel,               /**< Points to text[textlen] which is undefined. */
-      **suffixes,              /**< Array of pointers to suffixes of t. */
-      **suffixbase,            /**< Pointers into suffixes are considered w.r.t.\ this pointer. */
-      **sbuffer,               /**< Buffer to sort suffixes in sortByChar. */
-      **sbufferspace = NULL,   /**< Space to be used by sbuffer. */
-      **bound[UCHAR_MAX+1];    /**< Pointers into sbuffer while sorting. */
+#define UNDEFINEDSUCC  (SECONDBIT - 1)    
 
-Uint  occurrence[UCHAR_MAX+1], /**< Number of occurrences of each character. */
-      *streetab = NULL,        /**< Array that holds the suffix tree representation. */
-      streetabsize,            /**< Number of integers in the allocated streetab memory. */
-      *nextfreeentry,          /**< Pointer to next unused element in streetab. */
-      sbufferwidth,            /**< Number of elements in sbufferspace. */
-      maxsbufferwidth,         /**< Maximal number of elements in sbufferspace. */
-      suffixessize,            /**< Number of unprocessed suffixes. */
-      maxunusedsuffixes,       /**< When reached, then move and halve space for suffixes. */
-      rootchildtab[UCHAR_MAX+1]; /**< Constant time access to successors of root. */
-
-/** Flag indicating that the root has been evaluated. */
-BOOL  rootevaluated;   
+/** 
+ * Maximum length of the text. Text positions and tree array indexes must fit below the 
+ * flag bits and every position adds at most one leaf and one internal node to the array.
+ */
+#define MAXTEXTLEN ((SECONDBIT - 1) / (BRANCHWIDTH + 1) - 1)
+
+/** State of the construction of one tree. */
+typedef struct wotd {
+  context_t ctx;                /**< Context that holds the text and its alphabet. */
+  statsBuffer_t stats;          /**< Statistics released by this construction. */
+  Uchar *sentinel,              /**< Points to text[textlen] which is undefined. */
+        **suffixes,             /**< Array of pointers to suffixes of t. */
+        **suffixbase,           /**< Pointers into suffixes are considered w.r.t.\ this pointer. */
+        **sbuffer,              /**< Buffer to sort suffixes in sortByChar. */
+        **sbufferspace,         /**< Space to be used by sbuffer. */
+        **bound[UCHAR_MAX+1];   /**< Pointers into sbuffer while sorting. */
+  Uint  occurrence[UCHAR_MAX+1], /**< Number of occurrences of each character. */
+        *streetab,              /**< Array that holds the suffix tree representation. */
+        streetabsize,           /**< Number of integers in the allocated streetab memory. */
+        *nextfreeentry,         /**< Pointer to next unused element in streetab. */
+        sbufferwidth,           /**< Number of elements in sbufferspace. */
+        maxsbufferwidth,        /**< Maximal number of elements in sbufferspace. */
+        suffixessize,           /**< Number of unprocessed suffixes. */
+        maxunusedsuffixes,      /**< When reached, then move and halve space for suffixes. */
+        rootchildtab[UCHAR_MAX+1]; /**< Constant time access to successors of root. */
+  BOOL  rootevaluated,          /**< Flag indicating that the root has been evaluated. */
+        shared;                 /**< The suffixes are shared with other threads, so their unused space is not reused. */
+} *wotd_t;
 
 
 /**
@@ -206,19 +219,19 @@ BOOL  rootevaluated;
  * @param[in] right right boundary of the portion of the suffixes that will be processed.
  * @returns a pointer to the selected memory area.
  */
-static Uchar **getsbufferspaceeager(Uchar **left,Uchar **right)
+static Uchar **getsbufferspaceeager(wotd_t w, Uchar **left,Uchar **right)
 {
   Uint width = (Uint) (right-left+1);
 
-  if(width > (Uint) (left-suffixes))
+  if(w->shared || width > (Uint) (left-w->suffixes))
   {
-    if(width > sbufferwidth)
+    if(width > w->sbufferwidth)
     {
-      sbufferwidth = width;
+      w->sbufferwidth = width;
       /* DEBUGCODE(printf("sbufferwidth: %i\n", sbufferwidth)); */
-      REALLOC(sbufferspace,sbufferspace,Uchar *,sbufferwidth);
+      REALLOC(w->sbufferspace,w->sbufferspace,Uchar *,w->sbufferwidth);
     }
-    return sbufferspace;
+    return w->sbufferspace;
   }
   return left - width;
 }
@@ -228,20 +241,25 @@ static Uchar **getsbufferspaceeager(Uchar **left,Uchar **right)
  * Maximum number of extra array nodes needed for the children of a node. 
  * The extra 1 is for the <i>$</i> edge that always leads to a leaf.
 */
-#define MAXSUCCSPACE (BRANCHWIDTH * alphasize + 1)
+#define MAXSUCCSPACE (BRANCHWIDTH * w->ctx->alphasize + 1)
 
 
 /**
  * Enlarges the tree array structure if the current free space is not enough for the evaluation of a new node. 
+ * The array grows by a fraction of its size so large texts are not copied over and over.
  */
-static void allocstreetab()
+static void allocstreetab(wotd_t w)
 {
-  Uint tmpindex = NODEINDEX(nextfreeentry); 
-  if (tmpindex + MAXSUCCSPACE >= streetabsize) {
-    REALLOC(streetab,streetab,Uint,streetabsize + MAXSUCCSPACE);
-    streetabsize += MAXSUCCSPACE;
+  Uint tmpindex = NODEINDEX(w->nextfreeentry), increment; 
+  if (tmpindex + MAXSUCCSPACE >= w->streetabsize) {
+    increment = w->streetabsize >> 2;
+    if (increment < MAXSUCCSPACE) {
+      increment = MAXSUCCSPACE;
+    }
+    REALLOC(w->streetab,w->streetab,Uint,w->streetabsize + increment);
+    w->streetabsize += increment;
     /* update necessary, since streetab may have been moved. */
-    nextfreeentry = streetab + tmpindex;
+    w->nextfreeentry = w->streetab + tmpindex;
   }
 }
 
@@ -253,12 +271,12 @@ static void allocstreetab()
  * @param[in] prefixlen all pointers to the prefixes are advanced this number of chars because it is known that 
  * are all equal for all suffixes.
  */
-static void sortByChar(Uchar **left, Uchar **right, Uint prefixlen)
+static void sortByChar(wotd_t w, Uchar **left, Uchar **right, Uint prefixlen)
 {
-  Uchar **i, **j, **nextFree = sbuffer;
+  Uchar **i, **j, **nextFree = w->sbuffer;
   Uint a;
 
-  if(*right + prefixlen == sentinel)  /* shortest suffix is sentinel: skip */
+  if(*right + prefixlen == w->sentinel)  /* shortest suffix is sentinel: skip */
   {
     *right += prefixlen;
     right--;
@@ -266,23 +284,23 @@ static void sortByChar(Uchar **left, Uchar **right, Uint prefixlen)
   for(i=left; i<=right; i++) /* determine size for each group */
   {
     *i += prefixlen;         /* drop the common prefix */
-    occurrence[(Uint) **i]++;
+    w->occurrence[(Uint) **i]++;
   }
   for(i=left; i<=right; i++) /* determine right bound for each group */
   {
     a = (Uint) **i;
-    if(occurrence[a] > 0)
+    if(w->occurrence[a] > 0)
     {
-      bound[a] = nextFree+occurrence[a]-1;
-      nextFree = bound[a]+1;
-      occurrence[a] = 0;
+      w->bound[a] = nextFree+w->occurrence[a]-1;
+      nextFree = w->bound[a]+1;
+      w->occurrence[a] = 0;
     }
   }
   for(i=right; i>=left; i--) /* insert suffixes into buffer */
   {
-    *(bound[(Uint) **i]--) = *i;
+    *(w->bound[(Uint) **i]--) = *i;
   }
-  for(i=left,j=sbuffer; i<=right; i++,j++) /* copy grouped suffixes back */
+  for(i=left,j=w->sbuffer; i<=right; i++,j++) /* copy grouped suffixes back */
   {
     *i = *j;
   }
@@ -293,27 +311,27 @@ static void sortByChar(Uchar **left, Uchar **right, Uint prefixlen)
  * Sorts lexicographically a portion of the <i>suffixes</i> array. It is used the first time
  * to sort the whole array because it can use the <i>suffixes</i> array instead of <i>sbuffer</i>.
  */
-static void sortByChar0()
+static void sortByChar0(wotd_t w)
 {
-  Uchar *cptr, **nextFree = suffixes;
+  Uchar *cptr, **nextFree = w->suffixes;
   Uint a;
 
-  for(cptr=text; cptr < text+textlen; cptr++) /* determine size for each group */
+  for(cptr=w->ctx->text; cptr < w->ctx->text+w->ctx->textlen; cptr++) /* determine size for each group */
   {
-    occurrence[(Uint) *cptr]++;
+    w->occurrence[(Uint) *cptr]++;
   }
-  for(cptr=characters; cptr < characters+alphasize; cptr++)
+  for(cptr=w->ctx->characters; cptr < w->ctx->characters+w->ctx->alphasize; cptr++)
   {
     a = (Uint) *cptr;
-    bound[a] = nextFree+occurrence[a]-1;
-    nextFree = bound[a]+1;
-    occurrence[a] = 0;
+    w->bound[a] = nextFree+w->occurrence[a]-1;
+    nextFree = w->bound[a]+1;
+    w->occurrence[a] = 0;
   }
-  for(cptr=text+textlen-1; cptr>=text; cptr--) /* insert suffixes into array */
+  for(cptr=w->ctx->text+w->ctx->textlen-1; cptr>=w->ctx->text; cptr--) /* insert suffixes into array */
   {
-   *(bound[(Uint) *cptr]--) = cptr;
+   *(w->bound[(Uint) *cptr]--) = cptr;
   }
-  suffixes[textlen] = sentinel;  /* suffix $ is the largest suffix */
+  w->suffixes[w->ctx->textlen] = w->sentinel;  /* suffix $ is the largest suffix */
 }
 
 
@@ -323,14 +341,14 @@ static void sortByChar0()
  * @param[in] right right boundary of the portion of the suffixes that will be examined.
  * @returns the LCP length.
  */
-static Uint grouplcp(Uchar **left,Uchar **right)
+static Uint grouplcp(wotd_t w, Uchar **left,Uchar **right)
 {
   Uchar cmpchar, **i;
   Uint j;
 
   for(j=UintConst(1); /* nothing */; j++)
   {
-    if(*right+j == sentinel)
+    if(*right+j == w->sentinel)
     {
       return j;
     }
@@ -352,14 +370,14 @@ static Uint grouplcp(Uchar **left,Uchar **right)
  * @param[in] right the right boundary of the portion of the text that needs to be read for evaluation.
  * @returns the index in the tree array of the first branching child of the now evaluated node.
  */
-static Uint evalsuccedges(Uchar **left,Uchar **right)
+static Uint evalsuccedges(wotd_t w, Uchar **left,Uchar **right)
 {
   Uchar firstchar, **r, **l;
   Uint leafnum, firstbranch = UNDEFREFERENCE, *previousnode = NULL;
   BOOL sentineledge = False;
 
-  allocstreetab();
-  if(*right == sentinel)
+  allocstreetab(w);
+  if(*right == w->sentinel)
   {
     right--;  /* skip the smallest suffix */
     sentineledge = True;
@@ -370,28 +388,28 @@ static Uint evalsuccedges(Uchar **left,Uchar **right)
     {
       /* nothing */ ;
     }
-    previousnode = nextfreeentry;
+    previousnode = w->nextfreeentry;
     if(r > l) /* create branching node */
     {
       if(firstbranch == UNDEFREFERENCE)
       {
-        firstbranch = NODEINDEX(nextfreeentry);
+        firstbranch = NODEINDEX(w->nextfreeentry);
       }
-      STOREBOUNDARIES(nextfreeentry,l,r);
+      STOREBOUNDARIES(w->nextfreeentry,l,r);
       /* store l and r. resume later with this unevaluated node */
-      nextfreeentry += BRANCHWIDTH;
+      w->nextfreeentry += BRANCHWIDTH;
     } else /* create leaf */
     {
       leafnum = SUFFIXNUMBER(l);
-      SETLEAF(nextfreeentry,leafnum);
-      nextfreeentry++;
+      SETLEAF(w->nextfreeentry,leafnum);
+      w->nextfreeentry++;
     }
   }
   if(sentineledge)
   {
     leafnum = SUFFIXNUMBER(right+1);
-    SETLEAF(nextfreeentry,leafnum);
-    previousnode = nextfreeentry++;
+    SETLEAF(w->nextfreeentry,leafnum);
+    previousnode = w->nextfreeentry++;
   }
   assert(previousnode != NULL);
   *previousnode |= RIGHTMOSTCHILDBIT;
@@ -405,12 +423,12 @@ static Uint evalsuccedges(Uchar **left,Uchar **right)
  * @returns the index in the tree array of the first branching child of the now evaluated node.
  * @see evaluatesuccedges
  */
-static Uint evalrootsuccedges(Uchar **left,Uchar **right)
+static Uint evalrootsuccedges(wotd_t w, Uchar **left,Uchar **right)
 {
   Uchar firstchar, **r, **l;
   Uint *rptr, leafnum, firstbranch = UNDEFREFERENCE;
 
-  for(rptr = rootchildtab; rptr <= rootchildtab + UCHAR_MAX; rptr++)
+  for(rptr = w->rootchildtab; rptr <= w->rootchildtab + UCHAR_MAX; rptr++)
   {
     *rptr = UNDEFINEDSUCC;
   }
@@ -424,22 +442,22 @@ static Uint evalrootsuccedges(Uchar **left,Uchar **right)
     {
       if(firstbranch == UNDEFREFERENCE)
       {
-        firstbranch = NODEINDEX(nextfreeentry);
+        firstbranch = NODEINDEX(w->nextfreeentry);
       }
-      STOREBOUNDARIES(nextfreeentry,l,r);
+      STOREBOUNDARIES(w->nextfreeentry,l,r);
       /* store l and r. resume later with this unevaluated branch node */
-      rootchildtab[firstchar] = NODEINDEX(nextfreeentry);
-      nextfreeentry += BRANCHWIDTH;
+      w->rootchildtab[firstchar] = NODEINDEX(w->nextfreeentry);
+      w->nextfreeentry += BRANCHWIDTH;
     } else /* create leaf */
     {
       leafnum = SUFFIXNUMBER(l);
-      SETLEAF(nextfreeentry,leafnum);
-      rootchildtab[firstchar] = leafnum | LEAFBIT;
-      nextfreeentry++;
+      SETLEAF(w->nextfreeentry,leafnum);
+      w->rootchildtab[firstchar] = leafnum | LEAFBIT;
+      w->nextfreeentry++;
     }
   }
-  SETLEAF(nextfreeentry,textlen | RIGHTMOSTCHILDBIT);
-  nextfreeentry++;
+  SETLEAF(w->nextfreeentry,w->ctx->textlen | RIGHTMOSTCHILDBIT);
+  w->nextfreeentry++;
   return firstbranch;
 }
 
@@ -450,39 +468,39 @@ static Uint evalrootsuccedges(Uchar **left,Uchar **right)
  * @param[out] length length of the label of this node.
  * @returns the index in the tree array of the first branching child of the now evaluated node.
  */
-static Uint evaluatenodeeager(Uint node, Uint *length)
+static Uint evaluatenodeeager(wotd_t w, Uint node, Uint *length)
 {
   Uint prefixlen, *nodeptr, unusedsuffixes;
   Uchar **left, **right;
 
-  nodeptr = streetab + node;
+  nodeptr = w->streetab + node;
   left = GETLEFTBOUNDARY(nodeptr);
   right = GETRIGHTBOUNDARY(nodeptr);
   SETLP(nodeptr,SUFFIXNUMBER(left));
-  SETFIRSTCHILD(nodeptr,NODEINDEX(nextfreeentry));
+  SETFIRSTCHILD(nodeptr,NODEINDEX(w->nextfreeentry));
 
-  unusedsuffixes = (Uint) (left - suffixes);
-  if(suffixessize > UintConst(10000) && unusedsuffixes > maxunusedsuffixes)
+  unusedsuffixes = (Uint) (left - w->suffixes);
+  if(!w->shared && w->suffixessize > UintConst(10000) && unusedsuffixes > w->maxunusedsuffixes)
   {
     Uint tmpdiff, width = (Uint) (right - left + 1);
     Uchar **i, **j;
-    for(i=left, j=suffixes; i<suffixes+suffixessize; i++, j++)
+    for(i=left, j=w->suffixes; i<w->suffixes+w->suffixessize; i++, j++)
     {
       *j = *i;  /* move remaining suffixes to the left */
     }
-    suffixessize -= unusedsuffixes;
-    maxunusedsuffixes = suffixessize >> 1;
-    tmpdiff = (Uint) (suffixes - suffixbase);
-    REALLOC(suffixes,suffixes,Uchar *,suffixessize);
-    suffixbase = suffixes - (tmpdiff + unusedsuffixes);
-    left = suffixes;
-    right = suffixes + width - 1;
-  }
-  sbuffer = getsbufferspaceeager(left,right);
-  prefixlen = grouplcp(left,right);
+    w->suffixessize -= unusedsuffixes;
+    w->maxunusedsuffixes = w->suffixessize >> 1;
+    tmpdiff = (Uint) (w->suffixes - w->suffixbase);
+    REALLOC(w->suffixes,w->suffixes,Uchar *,w->suffixessize);
+    w->suffixbase = w->suffixes - (tmpdiff + unusedsuffixes);
+    left = w->suffixes;
+    right = w->suffixes + width - 1;
+  }
+  w->sbuffer = getsbufferspaceeager(w, left,right);
+  prefixlen = grouplcp(w, left,right);
   *length = prefixlen;
-  sortByChar(left,right,prefixlen);
-  return evalsuccedges(left,right);
+  sortByChar(w, left,right,prefixlen);
+  return evalsuccedges(w, left,right);
 }
 
 
@@ -491,9 +509,9 @@ static Uint evaluatenodeeager(Uint node, Uint *length)
  * @param[in] previousbranch index of the original node in the tree array representation.
  * @returns the index of the next branching brother of the node in the tree array representation.
  */
-static Uint getnextbranch(Uint previousbranch)
+static Uint getnextbranch(wotd_t w, Uint previousbranch)
 {
-  Uint *nodeptr = streetab + previousbranch;
+  Uint *nodeptr = w->streetab + previousbranch;
 
   if(ISRIGHTMOSTCHILD(nodeptr))
   {
@@ -517,80 +535,10 @@ static Uint getnextbranch(Uint previousbranch)
 }
 
 
-#ifdef DEBUG
-
-
-/**
- * Prints the root of the tree to the standard output. 
- */
-static void showrootchildtab()
-{
-  Uint i;
-
-  for(i=0; i<=UCHAR_MAX; i++)
-  {
-    if(rootchildtab[i] != UNDEFINEDSUCC)
-    {
-      if(rootchildtab[i] & LEAFBIT)
-      {
-        printf("#%c-successor of root is leaf %lu\n",
-               (char) i,
-               (Showuint) (rootchildtab[i] & ~LEAFBIT));
-      } else
-      {
-        printf("#%c-successor of root is branch %ld\n",
-                (char) i,
-                (Showsint) rootchildtab[i]);
-      }
-    }
-  }
-  printf("#~-successor of root is leaf %lu\n",(Showuint) textlen);
-}
-
-
-/**
- * Prints the tree array representation to the standard output.
- */
-static void showstreetab()
-{
-  Uint leftpointer, *nodeptr = streetab;
-
-  showrootchildtab();
-  while(nodeptr < nextfreeentry)
-  {
-    if(ISLEAF(nodeptr))
-    {
-      printf("#%lu: ",(Showuint) NODEINDEX(nodeptr));
-      leftpointer = GETLP(nodeptr);
-      printf(" Leaf %lu",(Showuint) leftpointer);
-      if(ISRIGHTMOSTCHILD(nodeptr))
-      {
-        printf(" (last)");
-      }
-      nodeptr++;
-    } else
-    {
-      printf("#%lu: ",(Showuint) NODEINDEX(nodeptr));
-      leftpointer = GETLP(nodeptr);
-      printf(" Branch(%lu,%lu)",(Showuint) leftpointer,
-                                (Showuint) GETFIRSTCHILD(nodeptr));
-      if(ISRIGHTMOSTCHILD(nodeptr))
-      {
-        printf(" (last)");
-      }
-      nodeptr += BRANCHWIDTH;
-    }
-    (void) putchar('\n');
-  }
-}
-
-#endif
-
-
 /**
  * Specifically tests if it is necessary to prune the tree at the root and does it if necessary .
  */
-static void pruneRoot() {
+static void pruneRoot(wotd_t w) {
   Uint *nodeptr;
   Uint pos, i, idx;
   Uint end;
@@ -598,18 +546,18 @@ static void pruneRoot() {
   double est, auxx;
 
   Uint * distinct;
-  CALLOC(distinct, Uint, alphasize);
+  CALLOC(distinct, Uint, w->ctx->alphasize);
 
-  nodeptr = streetab;
+  nodeptr = w->streetab;
 
   /* counters */
-  stats = getStatistics();
+  stats = getStatistics(w->ctx, w->stats);
 
   do {
     if (ISLEAF(nodeptr)) {
       if (GETLP(nodeptr) > 0) { /* if false the previous character is outside of string */
 	pos = GETLP(nodeptr) - 1; /* position where leaf starts minus previous length */
-	idx = alphaindex[*(text+pos)];
+	idx = w->ctx->alphaindex[*(w->ctx->text+pos)];
 	if (stats->count[idx] == 0) {
 	  stats->symbols[stats->symbolCount++] = idx;
 	}
@@ -631,7 +579,7 @@ static void pruneRoot() {
 	distinct[childStats->symbols[i]]++;
       }
       stats->cost += childStats->cost;
-      returnStatistics(childStats);
+      returnStatistics(w->ctx, w->stats, childStats);
     }
 
     end = ISRIGHTMOSTCHILD(nodeptr);
@@ -645,9 +593,9 @@ static void pruneRoot() {
     }
   } while (!end);
 
-  stats->cost += hAlpha() * alphasize;
+  stats->cost += hAlpha(w->ctx) * w->ctx->alphasize;
 
-  auxx = escapeCost(stats, distinct);
+  auxx = escapeCost(w->ctx, stats, distinct);
   stats->cost += auxx;
   /*printf("==> %f\n", auxx);*/
   assert(auxx >= 0);
@@ -656,11 +604,11 @@ static void pruneRoot() {
 
   /*est = kt(stats);*/ 
   /*est = moffat(stats);*/
-  est = nodeCost(stats);
+  est = nodeCost(w->ctx, stats);
   /*est = deckard(stats);*/
 
   if (est <= stats->cost) { /* pruning needed */
-    nextfreeentry = 0; /* indicates an empty tree */
+    w->nextfreeentry = 0; /* indicates an empty tree */
   }
   freeStatistics(stats);
 }
@@ -672,7 +620,7 @@ static void pruneRoot() {
  * @param[in] length length of the label of this node (from the root of the tree).
  * @param[in] branchLength length of the label of this node alone.
  */
-static void prune(Uint node, Uint length, Uint branchLength) {
+static void prune(wotd_t w, Uint node, Uint length, Uint branchLength) {
   Uint *nodeptr, *nodeptrPar;
   Uint pos, i, idx;
   statistics_t stats=NULL, childStats; 
@@ -680,19 +628,19 @@ static void prune(Uint node, Uint length, Uint branchLength) {
   double est, auxx;
 
   Uint * distinct;
-  CALLOC(distinct, Uint, alphasize);
+  CALLOC(distinct, Uint, w->ctx->alphasize);
 
-  nodeptrPar = streetab + node;
-  nodeptr = streetab + GETFIRSTCHILD(nodeptrPar);
+  nodeptrPar = w->streetab + node;
+  nodeptr = w->streetab + GETFIRSTCHILD(nodeptrPar);
 
   do {
     if (ISLEAF(nodeptr)) {
       if (stats == NULL) {
-	stats = getStatistics();
+	stats = getStatistics(w->ctx, w->stats);
       }
       if (GETLP(nodeptr) > length) { /* if false the previous character is outside the string */
 	pos = GETLP(nodeptr) - length - 1; /* position where the leaf begins minus previous length */
-	idx = alphaindex[*(text+pos)];
+	idx = w->ctx->alphaindex[*(w->ctx->text+pos)];
 	if (stats->count[idx] == 0) {
 	  stats->symbols[stats->symbolCount++] = idx;
 	}
@@ -719,7 +667,7 @@ static void prune(Uint node, Uint length, Uint branchLength) {
 	  distinct[childStats->symbols[i]]++;
 	}
 	stats->cost += childStats->cost;
-	returnStatistics(childStats);
+	returnStatistics(w->ctx, w->stats, childStats);
       }
     }
 
@@ -734,9 +682,9 @@ static void prune(Uint node, Uint length, Uint branchLength) {
     }
   } while (!end);
 
-  stats->cost += hAlpha() * alphasize * branchLength;
+  stats->cost += hAlpha(w->ctx) * w->ctx->alphasize * branchLength;
   
-  auxx = escapeCost(stats, distinct);
+  auxx = escapeCost(w->ctx, stats, distinct);
   stats->cost += auxx;
   /*printf("==> %f\n", auxx);*/
   assert(auxx >= 0);
@@ -745,19 +693,19 @@ static void prune(Uint node, Uint length, Uint branchLength) {
   if ((length-branchLength) < MAX_HEIGHT) {
     /*est = kt(stats); */
     /*est = moffat(stats);*/
-    est = nodeCost(stats);
+    est = nodeCost(w->ctx, stats);
     /*est = deckard(stats);*/
     assert(est >= 0);
 
     if (est <= stats->cost) { /* pruning needed */
-      nextfreeentry = streetab + GETFIRSTCHILD(nodeptrPar);
+      w->nextfreeentry = w->streetab + GETFIRSTCHILD(nodeptrPar);
       SETFIRSTCHILD(nodeptrPar, UNDEFREFERENCE);
       stats->cost = est;
     }
   }
   else {   
     stats->cost = 0xFFFFFFFF;
-    nextfreeentry = streetab + GETFIRSTCHILD(nodeptrPar);
+    w->nextfreeentry = w->streetab + GETFIRSTCHILD(nodeptrPar);
     SETFIRSTCHILD(nodeptrPar, UNDEFREFERENCE);
   }
 
@@ -769,20 +717,20 @@ static void prune(Uint node, Uint length, Uint branchLength) {
  * @param [in] node index of the node in the array tree
  * @param [in] length length of the label of this node (from the root of the tree).
  */
-static void prune2 (Uint node, Uint length) {
+static void prune2 (wotd_t w, Uint node, Uint length) {
   Uint *nodeptr, idx;
   Uchar **left, **right, **i;
   statistics_t stats;
 
-  stats = getStatistics();
+  stats = getStatistics(w->ctx, w->stats);
 
-  nodeptr = streetab + node;
+  nodeptr = w->streetab + node;
   left = GETLEFTBOUNDARY(nodeptr);
   right = GETRIGHTBOUNDARY(nodeptr);
 
   for (i = left; i <= right; i++) {
     if (SUFFIXNUMBER(i) > length) {
-      idx = alphaindex[text[SUFFIXNUMBER(i) - length - 1]];
+      idx = w->ctx->alphaindex[w->ctx->text[SUFFIXNUMBER(i) - length - 1]];
       if (stats->count[idx] == 0) {
 	stats->symbols[stats->symbolCount++] = idx;
       }
@@ -795,68 +743,333 @@ static void prune2 (Uint node, Uint length) {
 }
 
 /**
- * Main method to build and prune the tree.
+ * Builds and prunes the subtree of a child of the root. The other children are not 
+ * visited, so the subtrees of different children can be built by different threads.
+ * @param[in] root index of the branching child of the root in the tree array.
  */
-static void evaluateeager() {
-  Uint firstbranch, nextbranch, node, newNode, length, branchLength, stacktop=0, stackalloc=0, *stack = NULL;
-
-  sortByChar0();
-  firstbranch = evalrootsuccedges(suffixes,suffixes+textlen-1);
+static void evaluatesubtree(wotd_t w, Uint root) {
+  Uint nextbranch, node, newNode, length, branchLength, stacktop=0, stackalloc=0, *stack = NULL;
 
-  /* DEBUGCODE(showstreetab()); */
-  /* DEBUGCODE(putchar('\n')); */
-  if(firstbranch != UNDEFREFERENCE)
+  PUSHNODE(root);
+  PUSHNODE(0);
+  PUSHNODE(0);
+  while(NOTSTACKEMPTY)
   {
-    PUSHNODE(firstbranch);
-    PUSHNODE(0);
-    PUSHNODE(0);
-    while(NOTSTACKEMPTY)
+    POPNODE(branchLength);
+    POPNODE(length);
+    POPNODE(node);
+    while(node != UNDEFREFERENCE)
     {
-      POPNODE(branchLength);
-      POPNODE(length);
-      POPNODE(node);
-      while(node != UNDEFREFERENCE)
-      {
-	if (!ISUNEVALUATED(streetab+node)) { /* the node has already been evaluated */
-	  prune(node, length, branchLength);
-	  node = UNDEFREFERENCE; /* to continue the while */
-	  /* DEBUGCODE(showstreetab()); */
-	  /* DEBUGCODE(putchar('\n')); */
+      if (!ISUNEVALUATED(w->streetab+node)) { /* the node has already been evaluated */
+	prune(w, node, length, branchLength);
+	node = UNDEFREFERENCE; /* to continue the while */
+      }
+      else {
+	if(node != root && (nextbranch = getnextbranch(w, node)) != UNDEFREFERENCE) {
+	  PUSHNODE(nextbranch);
+	  PUSHNODE(length); /* my parent's length */
+	  PUSHNODE(0); /* does not matter, will be branchLenth when evaluated */
 	}
-	else {
-	  if((nextbranch = getnextbranch(node)) != UNDEFREFERENCE) {
-	    PUSHNODE(nextbranch);
-	    PUSHNODE(length); /* my parent's length */
-	    PUSHNODE(0); /* does not matter, will be branchLenth when evaluated */
-	  }
 
-	  if (length < MAX_HEIGHT) {
-	    newNode = evaluatenodeeager(node, &branchLength);
-	    /* DEBUGCODE(showstreetab()); */
-	    /* DEBUGCODE(putchar('\n')); */
-	    if (newNode == UNDEFREFERENCE) { /* all children are leaves */
-	      prune(node, length + branchLength, branchLength);
-	      /* DEBUGCODE(showstreetab()); */
-	      /* DEBUGCODE(putchar('\n')); */
-	    }
-	    else {
-	      PUSHNODE(node);
-	      PUSHNODE(branchLength + length);
-	      PUSHNODE(branchLength);
-	    }
-	    node = newNode;
-	    length += branchLength; /* is the length of the father */
+	if (length < MAX_HEIGHT) {
+	  newNode = evaluatenodeeager(w, node, &branchLength);
+	  if (newNode == UNDEFREFERENCE) { /* all children are leaves */
+	    prune(w, node, length + branchLength, branchLength);
 	  }
 	  else {
-	    prune2(node, length);  
-	    node = UNDEFREFERENCE; 
+	    PUSHNODE(node);
+	    PUSHNODE(branchLength + length);
+	    PUSHNODE(branchLength);
 	  }
+	  node = newNode;
+	  length += branchLength; /* is the length of the father */
+	}
+	else {
+	  prune2(w, node, length);  
+	  node = UNDEFREFERENCE; 
 	}
       }
     }
-    FREE(stack);
-    /* DEBUGCODE(showstreetab()); */
-    /* DEBUGCODE(putchar('\n')); */
+  }
+  FREE(stack);
+}
+
+#ifndef WIN32
+
+/** Subtree of a child of the root built by a thread. */
+typedef struct wotdSubtree {
+  Uint node,                    /**< Index of the child in the tree array of the root. */
+       width,                   /**< Number of suffixes below the child. */
+       start,                   /**< Index of the copy of the child in the tree array of the thread. */
+       end;                     /**< Index after the last node of the subtree in the tree array of the thread. */
+  wotd_t thread;                /**< State of the thread that built the subtree. */
+} wotdSubtree;
+
+/** Subtrees of the children of the root shared by the threads that build them. */
+typedef struct wotdJobs {
+  wotdSubtree *subtrees;        /**< Subtrees, the largest ones first. */
+  Uint count,                   /**< Number of subtrees. */
+       next;                    /**< First subtree not taken by any thread. */
+  Uint *streetab;               /**< Tree array of the root. */
+  pthread_mutex_t lock;         /**< Protects next. */
+} wotdJobs;
+
+/** A thread that builds subtrees. */
+typedef struct wotdThread {
+  wotdJobs *jobs;               /**< Subtrees to build. */
+  struct wotd w;                /**< State of the construction in this thread, it only reads the context. */
+  struct statsBuffer stats;     /**< Statistics released by this thread. */
+  int status;                   /**< CTX_OK or the error that stopped the thread. */
+} wotdThread;
+
+/** Subtrees of the children of the root built in parallel, with all the memory they use. */
+typedef struct wotdParallel {
+  wotd_t w;                     /**< Construction of the calling thread. */
+  Uint firstbranch,             /**< Index of the first branching child of the root. */
+       threads;                 /**< Number of threads, including the calling one. */
+  wotdJobs jobs;                /**< Subtrees to build. */
+  wotdThread *t;                /**< State of each thread. */
+  pthread_t *ids;               /**< Identifiers of the threads. */
+} wotdParallel;
+
+
+/**
+ * Orders subtrees by decreasing number of suffixes, so the largest ones are taken first 
+ * and the threads end at about the same time.
+ * @param[in] a first subtree.
+ * @param[in] b second subtree.
+ * @returns the comparison result as expected by qsort.
+ */
+static int largerSubtree(const void *a, const void *b) {
+  const wotdSubtree *sa = (const wotdSubtree *)a, *sb = (const wotdSubtree *)b;
+
+  if (sa->width != sb->width) {
+    return sa->width > sb->width ? -1 : 1;
+  }
+  return sa->node < sb->node ? -1 : 1;
+}
+
+
+/**
+ * Orders subtrees as their children are in the tree array of the root.
+ * @param[in] a first subtree.
+ * @param[in] b second subtree.
+ * @returns the comparison result as expected by qsort.
+ */
+static int previousSubtree(const void *a, const void *b) {
+  return ((const wotdSubtree *)a)->node < ((const wotdSubtree *)b)->node ? -1 : 1;
+}
+
+
+/**
+ * Builds subtrees until there are none left. Each subtree is built from a copy of the 
+ * unevaluated child of the root placed in the tree array of the thread.
+ * @param[in] data the thread.
+ * @returns CTX_OK.
+ */
+static int evaluateTask(void *data) {
+  wotdThread *t = (wotdThread *)data;
+  wotd_t w = &t->w;
+  wotdSubtree *sub;
+  Uint i;
+
+  while (True) {
+    pthread_mutex_lock(&t->jobs->lock);
+    i = t->jobs->next++;
+    pthread_mutex_unlock(&t->jobs->lock);
+    if (i >= t->jobs->count) {
+      return CTX_OK;
+    }
+    sub = t->jobs->subtrees + i;
+    allocstreetab(w);
+    sub->start = NODEINDEX(w->nextfreeentry);
+    memcpy(w->nextfreeentry, t->jobs->streetab + sub->node, sizeof(Uint) * BRANCHWIDTH);
+    w->nextfreeentry += BRANCHWIDTH;
+    evaluatesubtree(w, sub->start);
+    sub->end = NODEINDEX(w->nextfreeentry);
+    sub->thread = w;
+  }
+}
+
+
+/**
+ * Entry point of the threads.
+ * @param[in] data the thread.
+ * @returns NULL.
+ */
+static void *evaluateThread(void *data) {
+  wotdThread *t = (wotdThread *)data;
+
+  t->status = runProtected(evaluateTask, t);
+  return NULL;
+}
+
+
+/**
+ * Moves the first child of a branching node copied from the tree array of a thread to the 
+ * position where the nodes of the thread are copied.
+ * @param[in,out] nodeptr the node.
+ * @param[in] from index in the array of the thread of the first node copied.
+ * @param[in] to index in the array of the root where it is copied.
+ */
+static void relocate(Uint *nodeptr, Uint from, Uint to) {
+  if (GETFIRSTCHILD(nodeptr) != UNDEFREFERENCE) {
+    SETFIRSTCHILD(nodeptr, GETFIRSTCHILD(nodeptr) - from + to);
+  }
+}
+
+
+/**
+ * Appends a subtree built by a thread to the tree array of the root. The nodes of a pruned 
+ * subtree are released as soon as it is pruned, so the subtree is a sequence of leaves and 
+ * branching nodes and the first child of each branching node can be moved in one pass.
+ * @param[in] sub the subtree.
+ */
+static void appendsubtree(wotd_t w, wotdSubtree *sub) {
+  Uint *from = sub->thread->streetab + sub->start, *nodeptr, *last,
+    length = sub->end - sub->start - BRANCHWIDTH, to = NODEINDEX(w->nextfreeentry);
+
+  memcpy(w->streetab + sub->node, from, sizeof(Uint) * BRANCHWIDTH);
+  relocate(w->streetab + sub->node, sub->start + BRANCHWIDTH, to);
+  memcpy(w->nextfreeentry, from + BRANCHWIDTH, sizeof(Uint) * length);
+  for (nodeptr = w->nextfreeentry, last = nodeptr + length; nodeptr < last; 
+       nodeptr += (ISLEAF(nodeptr) ? 1 : BRANCHWIDTH)) {
+    if (!ISLEAF(nodeptr)) {
+      relocate(nodeptr, sub->start + BRANCHWIDTH, to);
+    }
+  }
+  w->nextfreeentry += length;
+}
+
+
+/**
+ * Builds the subtrees of the branching children of the root in parallel threads. Each 
+ * child has its own range of suffixes, so the threads only share the text and the 
+ * suffixes array, and each one has its own tree array, sort buffer and statistics buffer. 
+ * Free threads take the largest subtree left. The subtrees are then appended to the tree 
+ * array of the root in the order of the children, so the result is the same array built 
+ * by <i>evaluatesubtree</i> in one thread.
+ * @param[in] data the parallel construction, the memory it allocates is released by the caller.
+ * @returns CTX_OK or the error that stopped a thread.
+ */
+static int evaluateTasks(void *data) {
+  wotdParallel *p = (wotdParallel *)data;
+  wotd_t w = p->w;
+  wotdThread *t;
+  Uint i, k, started, size;
+
+  p->jobs.count = 0;
+  for (i=p->firstbranch; i != UNDEFREFERENCE; i=getnextbranch(w, i)) {
+    p->jobs.count++;
+  }
+  CALLOC(p->jobs.subtrees, wotdSubtree, p->jobs.count);
+  for (i=p->firstbranch, k=0; i != UNDEFREFERENCE; i=getnextbranch(w, i), k++) {
+    p->jobs.subtrees[k].node = i;
+    p->jobs.subtrees[k].width = (Uint) (GETRIGHTBOUNDARY(w->streetab + i) - GETLEFTBOUNDARY(w->streetab + i) + 1);
+  }
+  qsort(p->jobs.subtrees, p->jobs.count, sizeof(wotdSubtree), largerSubtree);
+  p->jobs.next = 0;
+  p->jobs.streetab = w->streetab;
+
+  if (p->threads > p->jobs.count) {
+    p->threads = p->jobs.count;
+  }
+  CALLOC(p->ids, pthread_t, p->threads);
+  CALLOC(p->t, wotdThread, p->threads);
+  hAlpha(w->ctx); /* the threads only read the cached values */
+  for (i=0, t=p->t; i<p->threads; i++, t++) {
+    t->jobs = &p->jobs;
+    t->w = *w; /* shares the context, the text and the suffixes */
+    t->w.stats = &t->stats;
+    t->w.shared = True;
+    t->w.sbufferspace = NULL;
+    t->w.sbufferwidth = 0;
+    t->w.streetab = NULL;
+    REALLOC(t->w.streetab, t->w.streetab, Uint, BRANCHWIDTH + MAXSUCCSPACE);
+    t->w.streetabsize = BRANCHWIDTH + MAXSUCCSPACE;
+    t->w.nextfreeentry = t->w.streetab;
+  }
+
+  /* the calling thread builds subtrees too, if a thread can not be started there are fewer */
+  pthread_mutex_init(&p->jobs.lock, NULL);
+  for (started=1; started<p->threads && pthread_create(p->ids + started, NULL, evaluateThread, p->t + started) == 0; started++);
+  evaluateThread(p->t);
+  for (i=1; i<started; i++) {
+    pthread_join(p->ids[i], NULL);
+  }
+  pthread_mutex_destroy(&p->jobs.lock);
+  for (i=0; i<p->threads; i++) {
+    if (p->t[i].status != CTX_OK) {
+      return p->t[i].status;
+    }
+  }
+
+  qsort(p->jobs.subtrees, p->jobs.count, sizeof(wotdSubtree), previousSubtree);
+  size = NODEINDEX(w->nextfreeentry);
+  for (k=0; k<p->jobs.count; k++) {
+    size += p->jobs.subtrees[k].end - p->jobs.subtrees[k].start - BRANCHWIDTH;
+  }
+  i = NODEINDEX(w->nextfreeentry);
+  REALLOC(w->streetab, w->streetab, Uint, size + MAXSUCCSPACE);
+  w->streetabsize = size + MAXSUCCSPACE;
+  w->nextfreeentry = w->streetab + i;
+  for (k=0; k<p->jobs.count; k++) {
+    appendsubtree(w, p->jobs.subtrees + k);
+  }
+  return CTX_OK;
+}
+
+
+/**
+ * Runs <i>evaluateTasks</i> and releases the memory of the threads also when it fails.
+ * @param[in] firstbranch index of the first branching child of the root.
+ * @param[in] threads number of threads, including the calling one.
+ */
+static void evaluateparallel(wotd_t w, Uint firstbranch, Uint threads) {
+  wotdParallel p;
+  Uint i;
+  int status;
+
+  memset(&p, 0, sizeof(wotdParallel));
+  p.w = w;
+  p.firstbranch = firstbranch;
+  p.threads = threads;
+  status = runProtected(evaluateTasks, &p);
+
+  if (p.t != NULL) {
+    for (i=0; i<p.threads; i++) {
+      FREE(p.t[i].w.streetab);
+      FREE(p.t[i].w.sbufferspace);
+      freeBuffer(&p.t[i].stats);
+    }
+  }
+  FREE(p.t);
+  FREE(p.ids);
+  FREE(p.jobs.subtrees);
+  if (status != CTX_OK) {
+    failure(status, "Could not build the context tree");
+  }
+}
+
+#endif
+
+/**
+ * Main method to build and prune the tree.
+ */
+static void evaluateeager(wotd_t w) {
+  Uint firstbranch, node;
+
+  sortByChar0(w);
+  firstbranch = evalrootsuccedges(w, w->suffixes,w->suffixes+w->ctx->textlen-1);
+
+#ifndef WIN32
+  if (w->ctx->threads > 1 && firstbranch != UNDEFREFERENCE && getnextbranch(w, firstbranch) != UNDEFREFERENCE) {
+    evaluateparallel(w, firstbranch, w->ctx->threads);
+    return;
+  }
+#endif
+  for (node=firstbranch; node != UNDEFREFERENCE; node=getnextbranch(w, node)) {
+    evaluatesubtree(w, node);
   }
 }
 
@@ -864,27 +1077,27 @@ static void evaluateeager() {
 /**
  * Initializes the tree array structure and ancillary structures.
  */
-static void inittree()
+static void inittree(wotd_t w)
 {
   Uint i;
 
-  sentinel = text+textlen;
-  REALLOC(streetab,streetab,Uint,BRANCHWIDTH + MAXSUCCSPACE);
-  streetabsize = BRANCHWIDTH + MAXSUCCSPACE;
-  nextfreeentry = streetab;
+  w->sentinel = w->ctx->text+w->ctx->textlen;
+  REALLOC(w->streetab,w->streetab,Uint,BRANCHWIDTH + MAXSUCCSPACE);
+  w->streetabsize = BRANCHWIDTH + MAXSUCCSPACE;
+  w->nextfreeentry = w->streetab;
 
   /* no partition */
-  suffixessize = textlen+1;
-  maxunusedsuffixes = suffixessize >> 1;
-  CALLOC(suffixes, Uchar *, suffixessize);
-  suffixbase = suffixes;
-
-  sbufferwidth = 0;
-  maxsbufferwidth = textlen >> 8;
-  rootevaluated = False;
+  w->suffixessize = w->ctx->textlen+1;
+  w->maxunusedsuffixes = w->suffixessize >> 1;
+  CALLOC(w->suffixes, Uchar *, w->suffixessize);
+  w->suffixbase = w->suffixes;
+
+  w->sbufferwidth = 0;
+  w->maxsbufferwidth = w->ctx->textlen >> 8;
+  w->rootevaluated = False;
   for(i=0; i<=UCHAR_MAX; i++)
   {
-    occurrence[i] = 0;
+    w->occurrence[i] = 0;
   }
 }
 
@@ -892,13 +1105,12 @@ static void inittree()
 /**
  * Builds a pruned context tree.
  */
-static void wotd()
+static void wotd(wotd_t w)
 {
-  inittree();
-  evaluateeager();
-  /* DEBUGCODE(showstreetab()); */
-  FREE(suffixes);
-  FREE(sbufferspace);  
+  inittree(w);
+  evaluateeager(w);
+  FREE(w->suffixes);
+  FREE(w->sbufferspace);  
 }
 
 
@@ -907,8 +1119,8 @@ static void wotd()
  * @param[in] node index of the node in the tree array.
  * @returns index of the first sibling in the tree array.
  */
-Uint getnextsibling(Uint node) {
-  Uint *nodeptr = streetab + node;
+static Uint getnextsibling(wotd_t w, Uint node) {
+  Uint *nodeptr = w->streetab + node;
 
   if(ISRIGHTMOSTCHILD(nodeptr))
   {
@@ -928,11 +1140,12 @@ Uint getnextsibling(Uint node) {
 /** Builds a new fsm tree from the pruned tree array representation.
  * @returns a new fsm tree.
  */
-static fsmTree_t buildTree () {
+static fsmTree_t buildTree (wotd_t w) {
+  context_t ctx = w->ctx;
   Uint stacktop=0, stackalloc=0, *stack = NULL, sibling, child, pos, node, *nodeptr, parentptr;
-  fsmTree_t ret = initFsmTree(), parent;
+  fsmTree_t ret = initFsmTree(w->ctx, NULL), parent, fsmNode;
 
-  if (nextfreeentry == 0) { /* only root */
+  if (w->nextfreeentry == 0) { /* only root */
     return ret;
   }
 
@@ -943,53 +1156,66 @@ static fsmTree_t buildTree () {
     POPNODE(parentptr);
     POPNODE(node);
     parent = (fsmTree_t)parentptr;
-    nodeptr = streetab + node;
+    nodeptr = w->streetab + node;
 
-    if (GETLP(nodeptr) != textlen) { /* ignore $ leaves */
+    if (GETLP(nodeptr) != w->ctx->textlen) { /* ignore $ leaves */
       pos = GETINDEX(GETLP(nodeptr));
-      parent->children[pos] = initFsmTree();
-      parent->children[pos]->parent = parent;
-      parent->children[pos]->left = GETLP(nodeptr); 
+      fsmNode = initFsmTree(w->ctx, ret);
+      setChild(&parent->children, pos, fsmNode);
+      fsmNode->parent = parent;
+      fsmNode->left = GETLP(nodeptr); 
 
       /* push the next sibling */
-      sibling = getnextsibling(node);
+      sibling = getnextsibling(w, node);
       if (sibling != UNDEFREFERENCE) {
 	PUSHNODE(sibling);
 	PUSHNODE(parentptr); 
       }
 
       if (parent->left != -1) { /* != ROOT */
-	parent->children[pos]->length = parent->length + parent->right - parent->left + 1;
+	fsmNode->length = parent->length + parent->right - parent->left + 1;
       }
       if (ISLEAF(nodeptr) || GETFIRSTCHILD(nodeptr) == UNDEFREFERENCE) { /* is a leaf or has been pruned */
-	parent->children[pos]->right = GETLP(nodeptr); /* shorten leaf */
+	fsmNode->right = GETLP(nodeptr); /* shorten leaf */
       }
       else {
 	child = GETFIRSTCHILD(nodeptr);
-	parent->children[pos]->right = GETLP(streetab + child) - 1;
+	fsmNode->right = GETLP(w->streetab + child) - 1;
 
 	/* push this child */
 	PUSHNODE(child);
-	PUSHNODE((Uint)parent->children[pos]);
+	PUSHNODE((Uint)fsmNode);
       }
     }
   }
 
   FREE(stack);
-  FREE(streetab);
   return ret;
 }
 
 
 /**
+ * @param[in] ctx context with the text to model.
  * @returns a new fsm tree.
  */
-fsmTree_t buildSTree ()
+fsmTree_t buildSTree (context_t ctx)
 {
-  wotd();
+  wotd_t w;
+  fsmTree_t ret;
+
+  if (ctx->textlen > MAXTEXTLEN) {
+    failure(CTX_ERR_LIMIT, "Text too long to build its context tree");
+  }
+  CALLOC(w, struct wotd, 1);
+  w->ctx = ctx;
+  w->stats = &ctx->stats;
+  wotd(w);
   /* as the representation has no root it has to be done specifically */
-  pruneRoot();
-  freeBuffer();
+  pruneRoot(w);
+  freeBuffer(w->stats);
 
-  return buildTree();
+  ret = buildTree(w);
+  FREE(w->streetab);
+  FREE(w);
+  return ret;
 }
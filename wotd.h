@@ -22,6 +22,6 @@
 #include "fsmTree.h"
 
 /** Builds a pruned fsm tree from the input text */
-fsmTree_t buildSTree (void);
+fsmTree_t buildSTree (context_t);
 
 #endif